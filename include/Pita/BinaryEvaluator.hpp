@@ -14,6 +14,9 @@ namespace cgl
 
 	Val OrFunc(const Val& lhs, const Val& rhs, Context& env);;
 
+	//数値の等号比較で等しいとみなす誤差（制約が満たされたかどうかの判定にも使う）
+	constexpr double EqualityTolerance = 0.001;
+
 	bool EqualFunc(const Val& lhs, const Val& rhs, Context& env);
 
 	bool NotEqualFunc(const Val& lhs, const Val& rhs, Context& env);
@@ -1,6 +1,7 @@
 #pragma once
 #include <stack>
 #include <map>
+#include <algorithm>
 #include <unordered_set>
 #include <random>
 
@@ -10,139 +11,546 @@ extern bool printAddressInsertion;
 
 namespace cgl
 {
+	//値の表
+	//アドレスはページ単位で確保したスロットの番号と、そのスロットを再利用した世代の組で表す
+	//ページは一度確保したら移動しないので、addしても既存の値への参照は無効にならない
+	//GCのために、値はaddされてから最初のGCを生き延びるまでを若い世代、それ以降を古い世代として区別する
 	template<class ValueType>
 	class Values
 	{
 	public:
-		using ValueList = std::unordered_map<Address, ValueType>;
-
 		Values() = default;
 
 		Address add(const ValueType& value)
 		{
-			m_values.emplace(newAddress(), value);
-			return Address(m_ID);
+			const Address address = newAddress();
+			slotValue(address.slot()) = value;
+			return address;
 		}
 
 		size_t size()const
 		{
-			return m_values.size();
+			return m_size;
+		}
+
+		//若い世代の値の数
+		size_t youngSize()const
+		{
+			return m_youngSlots.size();
+		}
+
+		bool isOld(Address key)const
+		{
+			return isAlive(key) && m_old[key.slot()];
+		}
+
+		//複数のリスト・レコードから同じアドレスで参照されている値に印を付ける（印はスロットが解放されるまで残る）
+		void share(Address key)
+		{
+			if (isAlive(key))
+			{
+				m_shared[key.slot()] = true;
+			}
+		}
+
+		bool isShared(Address key)const
+		{
+			return isAlive(key) && m_shared[key.slot()];
 		}
 
 		ValueType& operator[](Address key)
 		{
-			auto it = m_values.find(key);
-			if (it == m_values.end())
+			if (ValueType* pValue = at(key))
 			{
-				CGL_Error(std::string() + "Address(" + key.toString() + ") is not binded.");
+				return *pValue;
 			}
-			return it->second;
+
+			CGL_Error(std::string() + "Address(" + key.toString() + ") is not binded.");
 		}
 
 		const ValueType& operator[](Address key)const
 		{
-			auto it = m_values.find(key);
-			if (it == m_values.end())
+			if (const ValueType* pValue = at(key))
 			{
-				CGL_Error(std::string() + "Address(" + key.toString() + ") is not binded.");
+				return *pValue;
 			}
-			return it->second;
+
+			CGL_Error(std::string() + "Address(" + key.toString() + ") is not binded.");
 		}
 
 		void bind(Address key, const ValueType& value)
 		{
-			auto it = m_values.find(key);
-			if (it != m_values.end())
+			if (ValueType* pValue = at(key))
 			{
-				it->second = value;
+				*pValue = value;
+				return;
 			}
-			else
+
+			//まだ使われていないアドレスへの束縛（アーカイブの読み込み時など）
+			const unsigned slot = key.slot();
+			if (slot == 0)
 			{
-				try
-				{
-					m_values.emplace(key, value);
-				}
-				catch (std::exception& e)
-				{
-					std::cout << "Values::bind: " << e.what() << std::endl;
-					throw;
-				}
+				CGL_Error(std::string() + "Address(" + key.toString() + ") is invalid.");
 			}
-		}
 
-		typename ValueList::iterator at(Address key)
-		{
-			return m_values.find(key);
+			for (; m_ID < slot; ++m_ID)
+			{
+				ensureSlot(m_ID + 1);
+				m_freeSlots.push_back(m_ID + 1);
+			}
+
+			if (m_alive[slot])
+			{
+				CGL_Error(std::string() + "Address(" + key.toString() + ") is already used by another generation.");
+			}
+
+			//フリーリストに残ったこのスロットはnewAddress()で取り出す時に読み飛ばされる
+			occupy(slot, key.generation());
+			slotValue(slot) = value;
 		}
 
-		typename ValueList::const_iterator at(Address key)const
+		//keyが束縛されていなければnullptrを返す
+		//書き換えられる参照を返すので、若い世代のGCで辿れるように記録しておく
+		//参照はGCをまたいで保持されて書き込まれることがある（値の確保を挟む書き換えなど）ので、記録はスロットが解放されるまで外さない
+		ValueType* at(Address key)
 		{
-			return m_values.find(key);
+			if (!isAlive(key))
+			{
+				return nullptr;
+			}
+
+			remember(key.slot());
+			return &slotValue(key.slot());
 		}
 
-		typename ValueList::const_iterator begin()const
+		const ValueType* at(Address key)const
 		{
-			return m_values.cbegin();
+			return isAlive(key) ? &slotValue(key.slot()) : nullptr;
 		}
 
-		typename ValueList::const_iterator end()const
+		//全ての値のうちramainAddressesに含まれないものを回収し、残ったものは古い世代にする
+		void gc(const std::unordered_set<Address>& ramainAddresses)
 		{
-			return m_values.cend();
+			std::vector<bool> marked(m_alive.size(), false);
+			for (const Address address : ramainAddresses)
+			{
+				if (isAlive(address))
+				{
+					marked[address.slot()] = true;
+				}
+			}
+
+			for (unsigned slot = 1; slot < m_alive.size(); ++slot)
+			{
+				if (m_alive[slot] && !marked[slot])
+				{
+					release(slot);
+				}
+				else if (m_alive[slot])
+				{
+					m_old[slot] = true;
+				}
+			}
+
+			m_youngSlots.clear();
+			compactRememberedSlots();
 		}
 
-		typename ValueList::const_iterator find(const Address address)const
+		//若い世代の値のうちramainAddressesに含まれないものだけを回収し、残ったものは古い世代に移す
+		//回収した数を返す
+		size_t gcYoung(const std::unordered_set<Address>& ramainAddresses)
 		{
-			return m_values.find(address);
+			size_t collected = 0;
+			for (const unsigned slot : m_youngSlots)
+			{
+				if (!m_alive[slot] || m_old[slot])
+				{
+					continue;
+				}
+
+				if (ramainAddresses.find(Address::FromSlot(slot, m_generations[slot])) == ramainAddresses.end())
+				{
+					release(slot);
+					++collected;
+				}
+				else
+				{
+					m_old[slot] = true;
+				}
+			}
+
+			m_youngSlots.clear();
+
+			compactRememberedSlots();
+
+			return collected;
 		}
 
-		void gc(const std::unordered_set<Address>& ramainAddresses)
+		//書き換えられた可能性のある古い世代の値を列挙する（若い世代のGCではこれらも根として扱う）
+		template<class Func>
+		void forEachRemembered(Func func)const
 		{
-			for (auto it = m_values.begin(); it != m_values.end();)
+			for (const unsigned slot : m_rememberedSlots)
 			{
-				if (ramainAddresses.find(it->first) == ramainAddresses.end())
+				if (m_alive[slot] && m_old[slot] && m_remembered[slot])
 				{
-					//std::cout << "remove " << it->first.toString() << "\n";
-					it = m_values.erase(it);
+					func(Address::FromSlot(slot, m_generations[slot]), slotValue(slot));
 				}
-				else
+			}
+		}
+
+		//アーカイブの形式はunordered_map<Address, ValueType>で持っていた時と同じにしておく
+		template <class Archive>
+		void save(Archive & archive)const
+		{
+			std::unordered_map<Address, ValueType> values;
+			for (unsigned slot = 1; slot < m_alive.size(); ++slot)
+			{
+				if (m_alive[slot])
 				{
-					++it;
+					values.emplace(Address::FromSlot(slot, m_generations[slot]), slotValue(slot));
 				}
 			}
+
+			archive(values, m_ID);
 		}
 
 		template <class Archive>
-		void serialize(Archive & archive)
+		void load(Archive & archive)
 		{
-			archive(m_values, m_ID);
+			std::unordered_map<Address, ValueType> values;
+			unsigned id = 0;
+			archive(values, id);
+
+			*this = Values();
+			for (auto& keyval : values)
+			{
+				bind(keyval.first, keyval.second);
+			}
+
+			for (; m_ID < id; ++m_ID)
+			{
+				ensureSlot(m_ID + 1);
+				m_freeSlots.push_back(m_ID + 1);
+			}
+
+			//読み込んだ値は全て古い世代として扱う
+			//どのリスト・レコードと共有しているかは保存していないので、全て共有されているものとして扱う
+			for (const unsigned slot : m_youngSlots)
+			{
+				m_old[slot] = true;
+				m_shared[slot] = true;
+			}
+			m_youngSlots.clear();
 		}
 
 		//変数表の分岐を作るためのコピー
 		Values clone()const
 		{
-			Values inst;
-			inst.m_values = m_values;
-			inst.m_ID = m_ID;
-			return inst;
+			return *this;
 		}
 
 	private:
+		static constexpr unsigned PageBits = 12;
+		static constexpr unsigned PageSize = 1u << PageBits;
+		static constexpr unsigned PageMask = PageSize - 1;
+
+		bool isAlive(Address key)const
+		{
+			const unsigned slot = key.slot();
+			return slot != 0 && slot < m_alive.size() && m_alive[slot] && m_generations[slot] == key.generation();
+		}
+
+		ValueType& slotValue(unsigned slot)
+		{
+			return m_pages[slot >> PageBits][slot & PageMask];
+		}
+
+		const ValueType& slotValue(unsigned slot)const
+		{
+			return m_pages[slot >> PageBits][slot & PageMask];
+		}
+
+		void ensureSlot(unsigned slot)
+		{
+			while (m_pages.size() <= (slot >> PageBits))
+			{
+				m_pages.emplace_back(PageSize);
+			}
+
+			if (m_alive.size() <= slot)
+			{
+				m_alive.resize(slot + 1, false);
+				m_old.resize(slot + 1, false);
+				m_remembered.resize(slot + 1, false);
+				m_shared.resize(slot + 1, false);
+				m_retired.resize(slot + 1, false);
+				m_generations.resize(slot + 1, 0);
+			}
+		}
+
+		void occupy(unsigned slot, unsigned generation)
+		{
+			m_alive[slot] = true;
+			m_old[slot] = false;
+			m_shared[slot] = false;
+			m_generations[slot] = generation;
+			++m_size;
+			m_youngSlots.push_back(slot);
+		}
+
+		void release(unsigned slot)
+		{
+			slotValue(slot) = ValueType();
+			m_alive[slot] = false;
+			m_old[slot] = false;
+			m_remembered[slot] = false;
+			m_shared[slot] = false;
+			m_generations[slot] = (m_generations[slot] + 1) & Address::GenerationMask;
+			--m_size;
+
+			//世代が一周したスロットを再利用すると、まだどこかに残っている古いアドレスと区別できなくなるので二度と使わない
+			//（bind()で積まれたフリーリストの要素が残っている場合があるので、取り出す時にも確認する）
+			if (m_generations[slot] != 0)
+			{
+				m_freeSlots.push_back(slot);
+			}
+			else
+			{
+				m_retired[slot] = true;
+			}
+		}
+
+		void remember(unsigned slot)
+		{
+			if (!m_remembered[slot])
+			{
+				m_remembered[slot] = true;
+				m_rememberedSlots.push_back(slot);
+			}
+		}
+
+		//解放されたスロットの記録だけを取り除く
+		void compactRememberedSlots()
+		{
+			m_rememberedSlots.erase(std::remove_if(m_rememberedSlots.begin(), m_rememberedSlots.end(), [&](unsigned slot) { return !m_remembered[slot]; }), m_rememberedSlots.end());
+		}
+
 		Address newAddress()
 		{
-			return Address(++m_ID);
+			while (!m_freeSlots.empty())
+			{
+				const unsigned slot = m_freeSlots.back();
+				m_freeSlots.pop_back();
+				if (!m_alive[slot] && !m_retired[slot])
+				{
+					occupy(slot, m_generations[slot]);
+					return Address::FromSlot(slot, m_generations[slot]);
+				}
+			}
+
+			if (Address::SlotMask <= m_ID)
+			{
+				CGL_Error("値の表のスロットが足りません");
+			}
+
+			const unsigned slot = ++m_ID;
+			ensureSlot(slot);
+			occupy(slot, 0);
+			return Address::FromSlot(slot, 0);
 		}
 
 		friend class Context;
 		friend class cereal::access;
 
-		ValueList m_values;
-
+		//ページの中身はページを作った時にPageSize個確保し、以降は大きさを変えない
+		std::vector<std::vector<ValueType>> m_pages;
+		std::vector<unsigned> m_generations;
+		std::vector<bool> m_alive;
+		std::vector<bool> m_old;
+		std::vector<bool> m_remembered;
+		std::vector<bool> m_shared;
+		std::vector<bool> m_retired;
+		std::vector<unsigned> m_freeSlots;
+		std::vector<unsigned> m_youngSlots;
+		std::vector<unsigned> m_rememberedSlots;
+
+		//これまでに使ったスロット番号の最大値
 		unsigned m_ID = 0;
+
+		size_t m_size = 0;
+	};
+
+	//GCの記録（プロファイル出力用）
+	struct GCTelemetry
+	{
+		size_t youngCount = 0;//若い世代のGCの回数
+		size_t fullCount = 0;//全体のGCの回数
+		size_t collectedValues = 0;
+		double youngPauseSec = 0.0;
+		double fullPauseSec = 0.0;
+		double maxPauseSec = 0.0;
+
+		void addPause(double sec, bool isFull)
+		{
+			if (isFull)
+			{
+				++fullCount;
+				fullPauseSec += sec;
+			}
+			else
+			{
+				++youngCount;
+				youngPauseSec += sec;
+			}
+			maxPauseSec = std::max(maxPauseSec, sec);
+		}
+	};
+
+	//スコープの変数表
+	//関数呼び出しのたびに作られるスコープは変数が少ないので、名前とアドレスの組を配列で持って先頭から探す
+	//変数の多いスコープ（グローバルスコープなど）だけ名前から配列の位置への索引を作る
+	//引数スコープでは引数を束縛順に並べるので、引数を指す識別子は位置（Identifier::argumentSlot）で引ける
+	class ScopeVariables
+	{
+	public:
+		using value_type = std::pair<std::string, Address>;
+		using iterator = std::vector<value_type>::iterator;
+		using const_iterator = std::vector<value_type>::const_iterator;
+
+		ScopeVariables() = default;
+
+		iterator begin() { return m_variables.begin(); }
+		iterator end() { return m_variables.end(); }
+		const_iterator begin()const { return m_variables.cbegin(); }
+		const_iterator end()const { return m_variables.cend(); }
+
+		size_t size()const
+		{
+			return m_variables.size();
+		}
+
+		bool empty()const
+		{
+			return m_variables.empty();
+		}
+
+		//束縛した順の位置で引く（位置は変数を追加しても変わらない）
+		const value_type& at(size_t index)const
+		{
+			return m_variables[index];
+		}
+
+		//書き換えに備えて探すので、継承元のメンバだった名前はここで変数表に加える
+		iterator find(const std::string& name)
+		{
+			const size_t index = indexOf(name);
+			if (index == m_variables.size() && !m_inherited.empty())
+			{
+				const auto it = m_inherited.find(name);
+				if (it != m_inherited.end())
+				{
+					(*this)[name] = it->second;
+				}
+			}
+			return m_variables.begin() + index;
+		}
+
+		//変数表だけを探す（継承元のメンバも含めて引く時はlookup()を使う）
+		const_iterator find(const std::string& name)const
+		{
+			return m_variables.cbegin() + indexOf(name);
+		}
+
+		boost::optional<Address> lookup(const std::string& name)const
+		{
+			const size_t index = indexOf(name);
+			if (index != m_variables.size())
+			{
+				return m_variables[index].second;
+			}
+
+			if (!m_inherited.empty())
+			{
+				const auto it = m_inherited.find(name);
+				if (it != m_inherited.end())
+				{
+					return it->second;
+				}
+			}
+
+			return boost::none;
+		}
+
+		//レコード継承の本体を評価する間、継承元のメンバを変数として見せる
+		//メンバ表はコピーせずに共有し、書き換えのために探された名前だけを変数表に加える
+		void inherit(const RecordMembers<Address>& members)
+		{
+			m_inherited = members;
+		}
+
+		const RecordMembers<Address>& inherited()const
+		{
+			return m_inherited;
+		}
+
+		Address& operator[](const std::string& name)
+		{
+			const size_t index = indexOf(name);
+			if (index != m_variables.size())
+			{
+				return m_variables[index].second;
+			}
+
+			if (m_index)
+			{
+				m_index.get().emplace(name, m_variables.size());
+			}
+			m_variables.emplace_back(name, Address());
+
+			if (!m_index && IndexThreshold < m_variables.size())
+			{
+				m_index = std::unordered_map<std::string, size_t>();
+				for (size_t i = 0; i < m_variables.size(); ++i)
+				{
+					m_index.get().emplace(m_variables[i].first, i);
+				}
+			}
+
+			return m_variables.back().second;
+		}
+
+	private:
+		static constexpr size_t IndexThreshold = 16;
+
+		//見つからなければsize()を返す
+		size_t indexOf(const std::string& name)const
+		{
+			if (m_index)
+			{
+				const auto it = m_index.get().find(name);
+				return it == m_index.get().end() ? m_variables.size() : it->second;
+			}
+
+			for (size_t i = 0; i < m_variables.size(); ++i)
+			{
+				if (m_variables[i].first == name)
+				{
+					return i;
+				}
+			}
+
+			return m_variables.size();
+		}
+
+		std::vector<value_type> m_variables;
+		boost::optional<std::unordered_map<std::string, size_t>> m_index;
+		RecordMembers<Address> m_inherited;
 	};
 
 	struct Scope
 	{
-		using VariableMap = std::unordered_map<std::string, Address>;
+		using VariableMap = ScopeVariables;
 
 		Scope() = default;
 
@@ -166,6 +574,12 @@ namespace cgl
 		{
 			localEnv().emplace_back();
 		}
+		//レコード継承の本体を評価するスコープに入る（継承元のメンバは書き換えのために探されるまで変数表にコピーしない）
+		void enterScope(const RecordMembers<Address>& inheritedMembers)
+		{
+			localEnv().emplace_back();
+			localEnv().back().variables.inherit(inheritedMembers);
+		}
 		void exitScope()
 		{
 			localEnv().pop_back();
@@ -181,7 +595,23 @@ namespace cgl
 			m_localEnvStack.pop_back();
 		}
 
-		void registerBuiltInFunction(const std::string& name, const BuiltInFunction& function, bool isPlateausFunction);
+		struct BuiltInFunctionInfo
+		{
+			std::string name;
+			BuiltInFunction function;
+			bool isPlateausFunction;
+		};
+
+		//組み込み関数の表は全てのContextで共有し、生成後は変更しない
+		//i番目の組み込み関数は全てのContextでAddress(i + 1)に束縛される
+		using BuiltInFunctionTable = std::vector<BuiltInFunctionInfo>;
+		static const BuiltInFunctionTable& BuiltInFunctions();
+
+		static Address BuiltInFunctionAddress(size_t index)
+		{
+			return Address(static_cast<unsigned>(index + 1));
+		}
+		static size_t BuiltInFunctionIndex(Address functionAddress);
 
 		Val callBuiltInFunction(Address functionAddress, const std::vector<Address>& arguments, const LocationInfo& info);
 		bool isPlateausBuiltInFunction(Address functionAddress);
@@ -252,6 +682,27 @@ namespace cgl
 			m_values.bind(address, newValue);
 		}
 
+		//Cloneでクローンと元のリスト・レコードが同じアドレスのまま持つ値に印を付ける
+		void shareValue(Address address)
+		{
+			m_values.share(address);
+		}
+
+		bool isSharedValue(Address address)const
+		{
+			return m_values.isShared(address);
+		}
+
+		//addressにあるリスト・レコードが共有している値を、そのリスト・レコードだけが持つ値に置き換える
+		//solverや参照はメンバのアドレスを通して値をその場で書き換えるので、アドレスを渡す前に呼ぶ（recursiveなら中のリスト・レコードも辿る）
+		void unshareMembers(Address address, bool recursive);
+
+		//現在のスコープの変数表（継承元から引き継いだだけで探されていないメンバは含まない）
+		const ScopeVariables& currentScopeVariables()const
+		{
+			return localEnv().back().variables;
+		}
+
 		//Accessorの示すリスト or レコードの持つアドレスを書き換える
 		void assignToAccessor(const Accessor& accessor, const LRValue& newValue, const LocationInfo& info);
 		//Referenceの示すアドレスを書き換える
@@ -271,7 +722,17 @@ namespace cgl
 
 		Address findAddress(const std::string& name)const;
 
+		//AssignArgumentSlotsで引数の位置が決まった識別子は、フレームの引数スコープから直接引く
+		Address findArgumentAddress(const Identifier& identifier)const;
+
 		void garbageCollect(bool force = false);
+		void garbageCollectYoung();
+
+		//若い世代のGC中は、古い世代の値は生きているものとして辿らない
+		bool isSkippedByYoungGC(Address address)const
+		{
+			return m_markingYoungGeneration && m_values.isOld(address);
+		}
 
 		bool isAutomaticExtendMode()const
 		{
@@ -293,6 +754,21 @@ namespace cgl
 			m_solveTimeLimit = limitSec;
 		}
 
+		void addSolverTelemetry(const SolverTelemetry& telemetry)
+		{
+			m_solverTelemetry.push_back(telemetry);
+		}
+
+		const std::vector<SolverTelemetry>& solverTelemetry()const
+		{
+			return m_solverTelemetry;
+		}
+
+		const GCTelemetry& gcTelemetry()const
+		{
+			return m_gcTelemetry;
+		}
+
 		std::string makeLabel(const Address& address)const;
 
 		std::shared_ptr<Context> cloneContext();
@@ -309,6 +785,8 @@ namespace cgl
 		boost::optional<const DefFuncWithScopeInfo&> getDeferredFunction(const Identifier& deferredIdentifier)const;
 
 	private:
+		static BuiltInFunctionTable MakeBuiltInFunctionTable();
+
 		void initialize();
 
 		LocalContext& localEnv()
@@ -321,6 +799,9 @@ namespace cgl
 			return m_localEnvStack.back();
 		}
 
+		//GCの根から辿れるアドレスを集める
+		void markReachableAddresses(std::unordered_set<Address>& referenceableAddresses)const;
+
 		//外部の変更を参照変数で捕捉
 		void changeAddress(Address addressFrom, Address addressTo);
 
@@ -328,7 +809,7 @@ namespace cgl
 		void replaceGlobalContextAddress(Address addressFrom, Address addressTo);
 
 	public:
-		Values<BuiltInFunction> m_functions;
+		//組み込み関数の表に移したので使っていないが、PitaStdのアーカイブとの互換のために残している
 		std::unordered_map<Address, std::string> m_plateausFunctions;
 
 		//TODO: ローカルスコープに常にグローバル関数のリストは入れておくようにする
@@ -353,9 +834,14 @@ namespace cgl
 
 		bool m_automaticExtendMode = true;
 		bool m_automaticGC = true;
+		bool m_markingYoungGeneration = false;
 
 		boost::optional<double> m_solveTimeLimit;
 
+		//解いた制約ごとの記録（cloneContextでは引き継がない）
+		std::vector<SolverTelemetry> m_solverTelemetry;
+		GCTelemetry m_gcTelemetry;
+
 		std::uniform_real_distribution<double> m_dist;
 		std::mt19937 m_random;
 
@@ -387,13 +873,33 @@ namespace cgl
 
 namespace cereal
 {
+	//変数表のアーカイブの形式はunordered_map<std::string, Address>で持っていた時と同じにしておく
 	template<class Archive>
-	inline void serialize(Archive& ar, cgl::Scope& scope)
+	inline void save(Archive& ar, const cgl::Scope& scope)
 	{
-		ar(scope.variables);
+		std::unordered_map<std::string, cgl::Address> variables(scope.variables.inherited().begin(), scope.variables.inherited().end());
+		for (const auto& keyval : scope.variables)
+		{
+			variables[keyval.first] = keyval.second;
+		}
+		ar(variables);
 		ar(scope.temporaryAddresses);
 	}
 
+	template<class Archive>
+	inline void load(Archive& ar, cgl::Scope& scope)
+	{
+		std::unordered_map<std::string, cgl::Address> variables;
+		ar(variables);
+		ar(scope.temporaryAddresses);
+
+		scope.variables = cgl::ScopeVariables();
+		for (const auto& keyval : variables)
+		{
+			scope.variables[keyval.first] = keyval.second;
+		}
+	}
+
 	template<class Archive>
 	inline void serialize(Archive& ar, cgl::Context& context)
 	{
@@ -6,16 +6,59 @@ struct stbtt_fontinfo;
 
 namespace cgl
 {
-	static unsigned char current_buffer[1 << 25];
-
 	bool IsClockWise(const Vector<Eigen::Vector2d>& closedPath);
 
+	//読み込み済みのフォント
+	//生成後は変更しないので、FontRegistryを通して全スレッドで共有する
+	class FontFace
+	{
+	public:
+		FontFace();
+		FontFace(const std::string& fontPath);
+		~FontFace();
+
+		FontFace(const FontFace&) = delete;
+		FontFace& operator=(const FontFace&) = delete;
+
+		//フォント単位（y軸を反転した座標）でのグリフの輪郭
+		Geometries makeGlyph(int codePoint, int quality)const;
+
+		//フォント単位でのグリフの幅
+		int glyphWidth(int codePoint)const;
+
+		int ascent()const
+		{
+			return std::max(ascent1, ascent2);
+		}
+
+		int descent()const
+		{
+			return std::min(descent1, descent2);
+		}
+
+		int lineGap()const
+		{
+			return std::max(lineGap1, lineGap2);
+		}
+
+	private:
+		bool findGlyph(int codePoint, const stbtt_fontinfo*& fontInfo, int& glyphIndex)const;
+
+		void checkClockWise();
+
+		//パス指定で読み込んだフォントのデータ（埋め込みフォントは静的な配列を直接参照する）
+		std::string fontDataRaw;
+		stbtt_fontinfo *fontInfo1 = nullptr, *fontInfo2 = nullptr;
+		int ascent1 = 0, descent1 = 0, lineGap1 = 0;
+		int ascent2 = 0, descent2 = 0, lineGap2 = 0;
+		bool clockWisePolygons;
+	};
+
 	class FontBuilder
 	{
 	public:
 		FontBuilder();
 		FontBuilder(const std::string& fontPath);
-		~FontBuilder();
 
 		Geometries makePolygon(int codePoint, int quality = 1, double offsetX = 0, double offsetY = 0);
 
@@ -25,35 +68,29 @@ namespace cgl
 
 		int ascent()const
 		{
-			return std::max(ascent1, ascent2);
+			return pFace->ascent();
 		}
 
 		int descent()const
 		{
-			return std::min(descent1, descent2);
+			return pFace->descent();
 		}
 
 		int lineGap()const
 		{
-			return std::max(lineGap1, lineGap2);
+			return pFace->lineGap();
 		}
 
 		double scaledHeight()const;
 		void setScaledHeight(double newScale);
 
 	private:
-		void checkClockWise();
-
 		double fontSizeToReal(int fontSize)const
 		{
 			return fontSize * baseScale;
 		}
 
-		std::string fontDataRawEN, fontDataRawJP;
-		stbtt_fontinfo *fontInfo1 = nullptr, *fontInfo2 = nullptr;
-		int ascent1 = 0, descent1 = 0, lineGap1 = 0;
-		int ascent2 = 0, descent2 = 0, lineGap2 = 0;
-		bool clockWisePolygons;
+		std::shared_ptr<const FontFace> pFace;
 		double baseScale = 0.05;
 	};
 }
@@ -10,6 +10,10 @@ namespace cgl
 
 	double ShapeAvoid(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext);
 
+	//図形のリストに対するNear/Avoid（外接矩形によるブロードフェーズで厳密な判定を行う組を絞り込む）
+	double ShapeNearAll(const PackedList& shapes, std::shared_ptr<Context> pContext);
+	double ShapeAvoidAll(const PackedList& shapes, std::shared_ptr<Context> pContext);
+
 	PackedRecord ShapeDiff(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext);
 	PackedRecord ShapeUnion(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext);
 	PackedRecord ShapeIntersect(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext);
@@ -52,7 +56,7 @@ namespace cgl
 
 	PackedRecord GetTransformedShape(const PackedRecord& shape, const PackedRecord& pos, const PackedRecord& scale, double angle, std::shared_ptr<Context> pContext);
 
-	PackedList GetPolygon(const PackedRecord& shape, std::shared_ptr<Context> pContext);
+	PackedVal GetPolygon(const PackedRecord& shape, std::shared_ptr<Context> pContext);
 
 	PackedRecord GetBaseLineDeformedShape(const PackedRecord& shape, const PackedRecord& targetPath, std::shared_ptr<Context> pContext);
 	PackedRecord GetCenterLineDeformedShape(const PackedRecord& shape, const PackedRecord& targetPath, std::shared_ptr<Context> pContext);
@@ -7,6 +7,7 @@
 
 #include <cmath>
 #include <cfloat>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <functional>
@@ -20,6 +21,9 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
 
 #include <boost/version.hpp>
 #define CGL_BOOST_MAJOR_VERSION (BOOST_VERSION / 100000)
@@ -269,6 +273,10 @@ namespace cgl
 
 	//private:
 		std::string name;
+
+		//関数の引数を指す識別子であれば、関数呼び出しのフレームの引数スコープ内での位置（AssignArgumentSlotsで決める）
+		//決まっていない識別子は-1で、名前からスコープを辿って探す
+		int argumentSlot = -1;
 	};
 
 	struct Address
@@ -276,7 +284,7 @@ namespace cgl
 	public:
 		Address() :valueID(0) {}
 
-		explicit Address(unsigned valueID) :
+		explicit Address(std::uint64_t valueID) :
 			valueID(valueID)
 		{}
 
@@ -310,6 +318,27 @@ namespace cgl
 			return Address();
 		}
 
+		//valueIDの下位32ビットは値の表のスロット番号、上位32ビットはスロットを再利用した世代を表す
+		//（世代が0のアドレスはスロット番号とvalueIDが一致する）
+		static constexpr unsigned SlotBits = 32;
+		static constexpr unsigned SlotMask = 0xFFFFFFFFu;
+		static constexpr unsigned GenerationMask = 0xFFFFFFFFu;
+
+		static Address FromSlot(unsigned slot, unsigned generation)
+		{
+			return Address((static_cast<std::uint64_t>(generation) << SlotBits) | slot);
+		}
+
+		unsigned slot()const
+		{
+			return static_cast<unsigned>(valueID & SlotMask);
+		}
+
+		unsigned generation()const
+		{
+			return static_cast<unsigned>(valueID >> SlotBits);
+		}
+
 		std::string toString()const
 		{
 			return std::to_string(valueID);
@@ -318,7 +347,7 @@ namespace cgl
 	//private:
 		friend struct std::hash<Address>;
 
-		unsigned valueID;
+		std::uint64_t valueID;
 	};
 
 	struct Reference
@@ -360,7 +389,7 @@ namespace std
 	public:
 		size_t operator()(const cgl::Address& address)const
 		{
-			return hash<size_t>()(static_cast<size_t>(address.valueID));
+			return hash<std::uint64_t>()(address.valueID);
 		}
 	};
 
@@ -450,6 +479,7 @@ namespace cgl
 
 	struct PackedList;
 	struct PackedRecord;
+	struct PackedVertices;
 	using PackedVal = boost::variant<
 		CharString,
 		int,
@@ -459,7 +489,8 @@ namespace cgl
 		boost::recursive_wrapper<PackedList>,
 		boost::recursive_wrapper<PackedRecord>,
 		boost::recursive_wrapper<FuncVal>,
-		boost::recursive_wrapper<Jump>
+		boost::recursive_wrapper<Jump>,
+		boost::recursive_wrapper<PackedVertices>
 	>;
 
 	class Context;
@@ -854,6 +885,82 @@ namespace cgl
 		size_t seed;
 	};
 
+	//sat式を最適化の前に一度だけ変換したレジスタ形式の命令列
+	//i番目の命令の結果はi番目のレジスタに入り、最後のレジスタが式全体の評価値になる
+	struct SatExprTape
+	{
+		enum class OpCode : unsigned char
+		{
+			Constant,//value
+			Load,//data[lhs]
+			Minus,
+			Add, Sub, Mul, Div, Pow,
+			Min, Max, Abs,
+			Call,//func(lhs)
+		};
+
+		struct Instruction
+		{
+			OpCode op;
+			int lhs = -1;
+			int rhs = -1;
+			double value = 0.0;
+			double(*func)(double) = nullptr;
+			double(*derivative)(double) = nullptr;//funcの導関数
+		};
+
+		std::vector<Instruction> instructions;
+		std::vector<double> registers;
+		std::vector<double> adjoints;
+
+		bool isCompiled()const
+		{
+			return !instructions.empty();
+		}
+
+		void clear()
+		{
+			instructions.clear();
+			registers.clear();
+			adjoints.clear();
+		}
+
+		int push(const Instruction& instruction)
+		{
+			instructions.push_back(instruction);
+			return static_cast<int>(instructions.size()) - 1;
+		}
+
+		double evaluate(const std::vector<double>& data);
+
+		//リバースモードの自動微分で、評価値のdataに関する勾配をgradに書き込み評価値を返す
+		double gradient(const std::vector<double>& data, std::vector<double>& grad);
+	};
+
+	//制約の求解に使うソルバー
+	enum class SolverType { BFGS, CMAES };
+
+	std::string SolverTypeToStr(SolverType type);
+
+	//制約1つ分の求解の記録
+	struct SolverTelemetry
+	{
+		LocationInfo location;
+		size_t numOfFreeVariables = 0;
+		std::string solver;
+		size_t evaluationCount = 0;//コスト関数の評価回数
+		double evaluationSec = 0.0;//コスト関数の評価にかかった時間の合計
+		size_t iterationCount = 0;
+		double finalCost = 0.0;
+		bool isSatisfied = false;
+		double wallSec = 0.0;
+
+		double meanEvaluationSec()const
+		{
+			return evaluationCount == 0 ? 0.0 : evaluationSec / evaluationCount;
+		}
+	};
+
 	struct OptimizationProblemSat
 	{
 	public:
@@ -873,6 +980,33 @@ namespace cgl
 
 		bool hasPlateausFunction = false;
 
+		//exprをコンパイルした命令列（コンパイルできなかった場合は空で、木の評価にフォールバックする）
+		SatExprTape tape;
+
+		//ポートフォリオモードで最初に収束したソルバー（設定されていれば以降の求解ではこのソルバーを直接使う）
+		boost::optional<SolverType> preferredSolver;
+
+		//直前のsolveの記録（isSatisfiedは呼び出し側で設定する）
+		SolverTelemetry telemetry;
+
+		//木の評価で解く場合に、単位制約ごとの評価値を保持して変化した変数に依存する単位制約だけを評価し直すための状態
+		struct UnitConstraintCache
+		{
+			std::vector<Expr> units;
+			std::vector<std::vector<int>> dependencies;//単位制約->依存する参照ID
+			std::vector<double> costs;//単位制約->前回の評価値
+			std::vector<double> lastData;//前回評価した時のdata
+			//前回評価したContext（値を書き込んだContextが変わった場合は全て評価し直す）
+			//生ポインタでは破棄されたContextと同じアドレスに作られた別のContextを区別できないため、所有権を持たない参照で同一性を判定する
+			std::weak_ptr<Context> context;
+
+			bool isEvaluatedIn(const std::shared_ptr<Context>& pEnv)const
+			{
+				return !context.expired() && !context.owner_before(pEnv) && !pEnv.owner_before(context);
+			}
+		};
+		UnitConstraintCache unitCache;
+
 		void addUnitConstraint(const Expr& logicExpr);
 		//void constructConstraint(std::shared_ptr<Context> pEnv, std::vector<std::pair<Address, VariableRange>>& freeVariables);
 
@@ -889,6 +1023,14 @@ namespace cgl
 		}
 
 		double eval(std::shared_ptr<Context> pEnv, const LocationInfo& info);
+
+		//現在のdataでのコストを返す
+		double evalCandidate(std::shared_ptr<Context> pEnv, const LocationInfo& info);
+
+		//exprを単位制約に分割してそれぞれが依存する参照IDを求める
+		void prepareUnitConstraints(std::shared_ptr<Context> pEnv);
+
+		double evalUnitConstraints(std::shared_ptr<Context> pEnv, const LocationInfo& info);
 	};
 
 	struct UnaryExpr : public LocationInfo
@@ -1159,6 +1301,10 @@ namespace cgl
 		}
 	};
 
+	//関数本体の中で引数を指す識別子に、引数スコープ内での位置を割り当てた式を返す
+	//引数と同名の変数を束縛し得る式（キー式、ループカウンタ）がある場合や、評価時のスコープが静的に決まらない式（レコード、制約、内側の関数）の中は名前のまま残す
+	Expr AssignArgumentSlots(const std::vector<Identifier>& arguments, const Expr& expr);
+
 	struct DefFunc : public LocationInfo
 	{
 		std::vector<Identifier> arguments;
@@ -1583,6 +1729,54 @@ namespace cgl
 		return instance;
 	}
 
+	//{x: _, y: _}のみからなる頂点のリスト
+	//頂点ごとにPackedRecordを作らず、座標を連続したバッファに並べて保持する
+	//Valに戻すときは通常の頂点レコードのリストに展開されるので、Pitaのコードからはpolygon[i].xのようにアクセスできる
+	struct PackedVertices
+	{
+		//x0, y0, x1, y1, ... の順に並んだ座標
+		std::vector<double> coords;
+
+		//Valから変換した場合の元のアドレス（頂点ごとに 頂点レコード, x, y の3つずつ並ぶ）
+		//ネイティブに生成した頂点列では空
+		std::vector<Address> addresses;
+
+		PackedVertices() = default;
+
+		size_t size()const
+		{
+			return coords.size() / 2;
+		}
+
+		bool empty()const
+		{
+			return coords.empty();
+		}
+
+		double x(size_t index)const
+		{
+			return coords[index * 2 + 0];
+		}
+
+		double y(size_t index)const
+		{
+			return coords[index * 2 + 1];
+		}
+
+		void reserve(size_t numOfVertices)
+		{
+			coords.reserve(numOfVertices * 2);
+		}
+
+		void add(double x, double y)
+		{
+			coords.push_back(x);
+			coords.push_back(y);
+		}
+
+		Val unpacked(Context& context)const;
+	};
+
 	struct List
 	{
 		std::vector<Address> data;
@@ -1978,6 +2172,375 @@ namespace cgl
 		std::vector<ConstraintGroup> constraintGroups;
 	};
 
+	//レコードのメンバ表
+	//Vec2や座標変換など殆どのレコードはメンバが数個しかないので、ハッシュ表ではなく名前でソートした配列で持つ
+	//クローンや継承でレコードは頻繁にコピーされるので、コピーは元の配列を共有し、共有している配列には書き込まない
+	//共有中の書き込みは上書き・追加したメンバだけを小さな差分の配列に持ち、差分が大きくなったら一つの配列にまとめ直す
+	//（継承で数個のメンバを上書きする時には、元のメンバ数によらずその数個分の手間で済む）
+	//メンバはoperator[]/insert/insertOrAssignで書き換え、イテレータからは読むだけにする
+	template<class T>
+	class RecordMembers
+	{
+	public:
+		using value_type = std::pair<std::string, T>;
+
+	private:
+		using Table = std::vector<value_type>;
+		using TableIterator = typename Table::const_iterator;
+
+	public:
+		//共有している配列と差分の配列を名前順に合わせて辿る（同じ名前は差分の方を返す）
+		class const_iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = typename RecordMembers::value_type;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const value_type*;
+			using reference = const value_type&;
+
+			const_iterator() = default;
+
+			reference operator*()const { return *current(); }
+			pointer operator->()const { return &*current(); }
+
+			const_iterator& operator++()
+			{
+				if (takesOverlay())
+				{
+					if (m_base != m_baseEnd && m_base->first == m_overlay->first)
+					{
+						++m_base;
+					}
+					++m_overlay;
+				}
+				else
+				{
+					++m_base;
+				}
+				return *this;
+			}
+
+			const_iterator operator++(int)
+			{
+				const_iterator result = *this;
+				++*this;
+				return result;
+			}
+
+			bool operator==(const const_iterator& other)const
+			{
+				return m_base == other.m_base && m_overlay == other.m_overlay;
+			}
+
+			bool operator!=(const const_iterator& other)const
+			{
+				return !(*this == other);
+			}
+
+		private:
+			friend class RecordMembers;
+
+			const_iterator(TableIterator base, TableIterator baseEnd, TableIterator overlay, TableIterator overlayEnd) :
+				m_base(base),
+				m_baseEnd(baseEnd),
+				m_overlay(overlay),
+				m_overlayEnd(overlayEnd)
+			{}
+
+			bool takesOverlay()const
+			{
+				return m_overlay != m_overlayEnd && (m_base == m_baseEnd || !(m_base->first < m_overlay->first));
+			}
+
+			TableIterator current()const
+			{
+				return takesOverlay() ? m_overlay : m_base;
+			}
+
+			TableIterator m_base, m_baseEnd, m_overlay, m_overlayEnd;
+		};
+
+		using iterator = const_iterator;
+
+		RecordMembers() = default;
+
+		const_iterator begin()const
+		{
+			return const_iterator(base().cbegin(), base().cend(), overlay().cbegin(), overlay().cend());
+		}
+
+		const_iterator end()const
+		{
+			return const_iterator(base().cend(), base().cend(), overlay().cend(), overlay().cend());
+		}
+
+		size_t size()const
+		{
+			return m_size;
+		}
+
+		bool empty()const
+		{
+			return m_size == 0;
+		}
+
+		void clear()
+		{
+			m_base.reset();
+			m_overlay.reset();
+			m_size = 0;
+		}
+
+		const_iterator find(const std::string& key)const
+		{
+			const auto overlayIt = lowerBound(overlay(), key);
+			const auto baseIt = lowerBound(base(), key);
+			const bool inOverlay = overlayIt != overlay().cend() && overlayIt->first == key;
+			const bool inBase = baseIt != base().cend() && baseIt->first == key;
+			if (!inOverlay && !inBase)
+			{
+				return end();
+			}
+			return const_iterator(baseIt, base().cend(), overlayIt, overlay().cend());
+		}
+
+		size_t count(const std::string& key)const
+		{
+			return find(key) == end() ? 0 : 1;
+		}
+
+		const T& at(const std::string& key)const
+		{
+			const auto it = find(key);
+			if (it == end())
+			{
+				throw std::out_of_range("RecordMembers::at");
+			}
+			return it->second;
+		}
+
+		T& operator[](const std::string& key)
+		{
+			return mutableMember(key).second;
+		}
+
+		std::pair<const_iterator, bool> insert(const value_type& value)
+		{
+			const auto it = find(value.first);
+			if (it != end())
+			{
+				return { it, false };
+			}
+			mutableMember(value.first).second = value.second;
+			return { find(value.first), true };
+		}
+
+		//複数のメンバをまとめて追加し、既にあるキーは書き換える（同じキーが複数あれば後のものを使う）
+		//名前順でないメンバを一つずつoperator[]で足すと挿入のたびに後ろの要素をずらすので、まとめてソートしてから今のメンバと併合する
+		void insertOrAssign(std::vector<value_type> newMembers)
+		{
+			if (newMembers.empty())
+			{
+				return;
+			}
+
+			std::stable_sort(newMembers.begin(), newMembers.end(),
+				[](const value_type& a, const value_type& b) { return a.first < b.first; });
+
+			//同じキーは後のものだけ残す
+			std::vector<value_type> uniqueMembers;
+			uniqueMembers.reserve(newMembers.size());
+			for (auto it = newMembers.begin(); it != newMembers.end(); ++it)
+			{
+				const auto next = std::next(it);
+				if (next == newMembers.end() || next->first != it->first)
+				{
+					uniqueMembers.push_back(std::move(*it));
+				}
+			}
+
+			if (ownsBase())
+			{
+				const size_t oldSize = base().size();
+				m_base = std::make_shared<Table>(Merged(base(), std::move(uniqueMembers)));
+				m_size += m_base->size() - oldSize;
+				return;
+			}
+
+			for (const auto& member : uniqueMembers)
+			{
+				if (!contains(member.first))
+				{
+					++m_size;
+				}
+			}
+
+			m_overlay = std::make_shared<Table>(Merged(overlay(), std::move(uniqueMembers)));
+			flattenIfLarge();
+		}
+
+		//アーカイブの形式はunordered_map<std::string, T>で持っていた時と同じにしておく
+		template <class Archive>
+		void save(Archive& archive)const
+		{
+			archive(cereal::make_size_tag(static_cast<cereal::size_type>(size())));
+			for (const auto& member : *this)
+			{
+				archive(cereal::make_map_item(member.first, member.second));
+			}
+		}
+
+		template <class Archive>
+		void load(Archive& archive)
+		{
+			cereal::size_type size;
+			archive(cereal::make_size_tag(size));
+
+			//unordered_mapから書き出したアーカイブは名前順に並んでいないので、全て読んでから一度にソートする
+			std::vector<value_type> loaded(static_cast<size_t>(size));
+			for (auto& member : loaded)
+			{
+				archive(cereal::make_map_item(member.first, member.second));
+			}
+
+			clear();
+			insertOrAssign(std::move(loaded));
+		}
+
+	private:
+		//差分の配列がこの数と元の配列の1/4を両方超えたら一つにまとめる
+		static constexpr size_t MinOverlaySize = 8;
+
+		static const Table& EmptyTable()
+		{
+			static const Table emptyTable;
+			return emptyTable;
+		}
+
+		const Table& base()const
+		{
+			return m_base ? *m_base : EmptyTable();
+		}
+
+		const Table& overlay()const
+		{
+			return m_overlay ? *m_overlay : EmptyTable();
+		}
+
+		//差分が無く、どのコピーとも共有していない配列はその場で書き換える
+		bool ownsBase()const
+		{
+			return !m_overlay && (!m_base || m_base.use_count() == 1);
+		}
+
+		bool contains(const std::string& key)const
+		{
+			return find(key) != end();
+		}
+
+		//oldMembersとnewMembers（どちらも名前順で重複なし）を併合する（同じキーはnewMembersの方を使う）
+		static Table Merged(const Table& oldMembers, std::vector<value_type> newMembers)
+		{
+			Table merged;
+			merged.reserve(oldMembers.size() + newMembers.size());
+
+			auto oldIt = oldMembers.begin();
+			for (auto& member : newMembers)
+			{
+				while (oldIt != oldMembers.end() && oldIt->first < member.first)
+				{
+					merged.push_back(*oldIt++);
+				}
+				if (oldIt != oldMembers.end() && oldIt->first == member.first)
+				{
+					++oldIt;
+				}
+				merged.push_back(std::move(member));
+			}
+			merged.insert(merged.end(), oldIt, oldMembers.end());
+
+			return merged;
+		}
+
+		value_type& mutableMember(const std::string& key)
+		{
+			if (ownsBase())
+			{
+				if (!m_base)
+				{
+					m_base = std::make_shared<Table>();
+				}
+
+				auto& data = *m_base;
+				auto it = lowerBound(data, key);
+				if (it == data.end() || it->first != key)
+				{
+					it = data.emplace(it, key, T());
+					++m_size;
+				}
+				return *it;
+			}
+
+			if (!m_overlay)
+			{
+				m_overlay = std::make_shared<Table>();
+			}
+			else if (m_overlay.use_count() != 1)
+			{
+				m_overlay = std::make_shared<Table>(*m_overlay);
+			}
+
+			auto& data = *m_overlay;
+			auto it = lowerBound(data, key);
+			if (it != data.end() && it->first == key)
+			{
+				return *it;
+			}
+
+			const auto baseIt = lowerBound(base(), key);
+			const bool inBase = baseIt != base().cend() && baseIt->first == key;
+			it = data.emplace(it, key, inBase ? baseIt->second : T());
+			if (!inBase)
+			{
+				++m_size;
+			}
+
+			if (!flattenIfLarge())
+			{
+				return *it;
+			}
+
+			//まとめ直した配列はこのメンバ表だけが持っている
+			return *lowerBound(*m_base, key);
+		}
+
+		bool flattenIfLarge()
+		{
+			const size_t overlaySize = overlay().size();
+			if (overlaySize <= MinOverlaySize || overlaySize <= base().size() / 4)
+			{
+				return false;
+			}
+
+			m_base = std::make_shared<Table>(Merged(base(), overlay()));
+			m_overlay.reset();
+			return true;
+		}
+
+		template<class Members>
+		static auto lowerBound(Members& data, const std::string& key) -> decltype(data.begin())
+		{
+			return std::lower_bound(data.begin(), data.end(), key,
+				[](const value_type& member, const std::string& name) { return member.first < name; });
+		}
+
+		//空のレコードでは確保しない
+		std::shared_ptr<Table> m_base;
+		std::shared_ptr<Table> m_overlay;
+		size_t m_size = 0;
+	};
+
 	struct PackedRecord
 	{
 		struct Data
@@ -1990,7 +2553,7 @@ namespace cgl
 				address(address)
 			{}
 		};
-		std::unordered_map<std::string, Data> values;
+		RecordMembers<Data> values;
 
 		std::vector<OptimizationProblemSat> problems;
 		boost::optional<Expr> constraint;
@@ -2055,7 +2618,7 @@ namespace cgl
 
 	struct Record
 	{
-		std::unordered_map<std::string, Address> values;
+		RecordMembers<Address> values;
 
 		std::vector<OptimizationProblemSat> problems;
 		boost::optional<Expr> constraint;
@@ -2077,7 +2640,7 @@ namespace cgl
 		Vector<Eigen::Vector2d> pathPoints;
 
 		Record() = default;
-		explicit Record(const std::unordered_map<std::string, Address>& values) :
+		explicit Record(const RecordMembers<Address>& values) :
 			values(values)
 		{}
 
@@ -2478,6 +3041,13 @@ namespace cereal
 		ar(node.data);
 	}
 
+	template<class Archive>
+	inline void serialize(Archive& ar, cgl::PackedVertices& node)
+	{
+		ar(node.coords);
+		ar(node.addresses);
+	}
+
 	template<class Archive>
 	inline void serialize(Archive& ar, cgl::KeyValue& node)
 	{
@@ -2518,11 +3088,21 @@ namespace cereal
 	}
 
 	template<class Archive>
-	inline void serialize(Archive& ar, cgl::FuncVal& node)
+	inline void save(Archive& ar, const cgl::FuncVal& node)
+	{
+		ar(node.arguments);
+		ar(node.expr);
+		ar(node.builtinFuncAddress);
+	}
+
+	//引数の位置はアーカイブに含めないので、読み込んだ関数本体に割り当て直す
+	template<class Archive>
+	inline void load(Archive& ar, cgl::FuncVal& node)
 	{
 		ar(node.arguments);
 		ar(node.expr);
 		ar(node.builtinFuncAddress);
+		node.expr = cgl::AssignArgumentSlots(node.arguments, node.expr);
 	}
 
 	template<class Archive>
@@ -139,6 +139,168 @@ namespace cgl
 	private:
 	};
 
+	//free変数に依存しない部分式を最適化の前に一度だけ評価して定数に置き換える
+	//式は葉から一度だけ辿り、独立な部分式は子から順に定数へ置き換えるので、依存性の判定と評価は部分式の数に比例する
+	//EvalSatExprとEvalで評価結果が変わらないアクセッサと算術演算だけを対象にし、結果が数値か真偽値の場合のみ置き換える
+	//（レコードやリストは一時的なアドレスを含み、求解中のGCで回収されうるので置き換えない）
+	class SatExprHoister : public boost::static_visitor<Expr>
+	{
+	public:
+		std::shared_ptr<Context> pEnv;
+		const std::vector<RegionVariable>& freeVariables;
+
+		//置き換えた部分式の数
+		size_t hoistedCount = 0;
+
+		SatExprHoister(std::shared_ptr<Context> pEnv, const std::vector<RegionVariable>& freeVariables) :
+			pEnv(pEnv),
+			freeVariables(freeVariables)
+		{}
+
+		Expr operator()(const LRValue& node) { return leaf(node); }
+		Expr operator()(const Identifier& node) { return leaf(node); }
+		Expr operator()(const Import& node) { return leaf(node); }
+		Expr operator()(const UnaryExpr& node);
+		Expr operator()(const BinaryExpr& node);
+		Expr operator()(const DefFunc& node) { return leaf(node); }
+		Expr operator()(const Range& node) { return leaf(node); }
+		Expr operator()(const Lines& node) { return leaf(node); }
+		Expr operator()(const If& node) { return leaf(node); }
+		Expr operator()(const For& node) { return leaf(node); }
+		Expr operator()(const Return& node) { return leaf(node); }
+		Expr operator()(const ListConstractor& node) { return leaf(node); }
+		Expr operator()(const KeyExpr& node) { return leaf(node); }
+		Expr operator()(const RecordConstractor& node) { return leaf(node); }
+		Expr operator()(const DeclSat& node) { return leaf(node); }
+		Expr operator()(const DeclFree& node) { return leaf(node); }
+		Expr operator()(const Accessor& node);
+
+	private:
+		//直前に辿った部分式がfree変数に依存するか、定数に置き換えたか（親は子を辿った後にこれを読む）
+		bool isDependent = false;
+		bool isFolded = false;
+
+		Expr leaf(const Expr& node);
+		bool dependsOnFreeVariable(const Expr& node)const;
+		boost::optional<Expr> tryFold(const Expr& node, const LocationInfo& info, size_t foldedChildren);
+	};
+
+	//sat式をSatExprTapeに変換する
+	//free変数以外の参照はコンパイル時の値で定数に置き換え、組み込み関数は関数ポインタに、Min/Maxの形をした関数はMin/Max命令に解決しておく
+	//変換できない式を含む場合はfalseを返す（その場合はEvalSatExprで評価する）
+	class SatExprCompiler : public boost::static_visitor<bool>
+	{
+	public:
+		//コンパイル時に値が決まる場合はconstantに、決まらない場合はregに結果が入る
+		struct Operand
+		{
+			int reg = -1;
+			boost::optional<Val> constant;
+		};
+
+		std::shared_ptr<Context> pEnv;
+		const std::unordered_map<Address, int>& invRefs;
+		SatExprTape& tape;
+
+		Operand result;
+
+		SatExprCompiler(std::shared_ptr<Context> pEnv, const std::unordered_map<Address, int>& invRefs, SatExprTape& tape) :
+			pEnv(pEnv),
+			invRefs(invRefs),
+			tape(tape)
+		{}
+
+		static bool Compile(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs, SatExprTape& tape);
+
+		bool operator()(const LRValue& node);
+		bool operator()(const Identifier& node);
+		bool operator()(const Import& node) { return false; }
+		bool operator()(const UnaryExpr& node);
+		bool operator()(const BinaryExpr& node);
+		bool operator()(const DefFunc& node) { return false; }
+		bool operator()(const Range& node) { return false; }
+		bool operator()(const Lines& node) { return false; }
+		bool operator()(const If& node) { return false; }
+		bool operator()(const For& node) { return false; }
+		bool operator()(const Return& node) { return false; }
+		bool operator()(const ListConstractor& node) { return false; }
+		bool operator()(const KeyExpr& node) { return false; }
+		bool operator()(const RecordConstractor& node) { return false; }
+		bool operator()(const DeclSat& node) { return false; }
+		bool operator()(const DeclFree& node) { return false; }
+		bool operator()(const Accessor& node);
+
+	private:
+		bool compileAddress(Address address);
+		bool compileBuiltInCall(Address functionAddress, const std::vector<Expr>& actualArguments);
+		bool compileMinMaxCall(const FuncVal& function, const std::vector<Expr>& actualArguments);
+		int toRegister(const Operand& operand);
+		int pushBinary(SatExprTape::OpCode op, int lhs, int rhs);
+	};
+
+	//同じリストの全ての要素の組に対するAvoid(list[i], list[j])の論理積を、ブロードフェーズで評価するAvoid(list)にまとめる
+	//引数が同じリストの要素を定数の添字で指すアクセッサで、i < jの各組がちょうど1回ずつ現れる場合のみ置き換える（コストは変わらない）
+	class PairwiseAvoidRewriter
+	{
+	public:
+		//置き換えた場合のみ新しい式を返す
+		static boost::optional<Expr> Rewrite(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs);
+
+	private:
+		struct Pair
+		{
+			Address list;
+			int i, j;
+		};
+
+		static boost::optional<Address> ResolveAddress(std::shared_ptr<Context> pEnv, const Expr& expr);
+		static bool IsAvoidFunction(std::shared_ptr<Context> pEnv, const Expr& head);
+		static boost::optional<std::pair<Address, int>> MatchListElement(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs);
+		static boost::optional<Pair> MatchPairwiseAvoid(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs);
+	};
+
+	//制約解のキャッシュのキーにするための、アドレスの割り当てに依存しない制約式の文字列表現を作る
+	//free変数は参照IDに、それ以外の参照は現在の値に置き換える
+	class SatExprCanonicalizer : public boost::static_visitor<void>
+	{
+	public:
+		std::shared_ptr<Context> pEnv;
+		const std::unordered_map<Address, int>& invRefs;
+		std::ostream& os;
+
+		SatExprCanonicalizer(std::shared_ptr<Context> pEnv, const std::unordered_map<Address, int>& invRefs, std::ostream& os) :
+			pEnv(pEnv),
+			invRefs(invRefs),
+			os(os)
+		{}
+
+		static std::string Canonicalize(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs);
+
+		void operator()(const LRValue& node);
+		void operator()(const Identifier& node);
+		void operator()(const Import& node) { writeOther(node); }
+		void operator()(const UnaryExpr& node);
+		void operator()(const BinaryExpr& node);
+		void operator()(const DefFunc& node) { writeOther(node); }
+		void operator()(const Range& node) { writeOther(node); }
+		void operator()(const Lines& node) { writeOther(node); }
+		void operator()(const If& node) { writeOther(node); }
+		void operator()(const For& node) { writeOther(node); }
+		void operator()(const Return& node) { writeOther(node); }
+		void operator()(const ListConstractor& node);
+		void operator()(const KeyExpr& node) { writeOther(node); }
+		void operator()(const RecordConstractor& node) { writeOther(node); }
+		void operator()(const DeclSat& node) { writeOther(node); }
+		void operator()(const DeclFree& node) { writeOther(node); }
+		void operator()(const Accessor& node);
+
+	private:
+		void writeAddress(Address address);
+
+		//sat式に現れることが少ない式はそのまま出力する（アドレスが含まれる場合はキャッシュに当たりにくくなるだけで、誤った解は返さない）
+		void writeOther(const Expr& node);
+	};
+
 	class EvalSatExpr : public Eval
 	{
 	public:
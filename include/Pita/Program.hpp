@@ -64,11 +64,25 @@ namespace cgl
 
 		bool preEvaluate(const std::string& input_filename, const std::string& output_filename, bool logOutput = true);
 
+		//--preEvaluation --binarySnapshotの出力をバイト列に戻したものからContextを復元する
+		void loadBinarySnapshot(const unsigned char* data, size_t size);
+
+		//現在のContextを--binarySnapshotと同じ形式で出力する
+		bool writeBinarySnapshot(const std::string& output_filename)const;
+
 		const ProfileResult& profileResult()const
 		{
 			return profileTime;
 		}
 
+		const std::vector<SolverTelemetry>& solverTelemetry()const
+		{
+			return pEnv->solverTelemetry();
+		}
+
+		//ProfileResult、GCの記録と制約ごとの求解の記録をJSON形式で出力する
+		void outputSolverTelemetry(std::ostream& os)const;
+
 	private:
 		ProfileResult profileTime;
 		std::shared_ptr<Context> pEnv;
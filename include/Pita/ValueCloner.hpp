@@ -7,4 +7,7 @@
 namespace cgl
 {
 	Val Clone(std::shared_ptr<Context> pEnv, const Val& value, const LocationInfo& info);
+
+	//sharesValuesがfalseなら、数値などの値も共有せずに全て複製する（クローンに後から制約を付ける時など）
+	Val Clone(std::shared_ptr<Context> pEnv, const Val& value, const LocationInfo& info, bool sharesValues);
 }
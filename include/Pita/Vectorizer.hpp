@@ -70,6 +70,11 @@ namespace cgl
 			return gs[index].get();
 		}
 
+		gg::Geometry* refer(size_t index)
+		{
+			return gs[index].get();
+		}
+
 		void insert(size_t index, GeometryPtr g)
 		{
 			gs.insert(gs.begin() + index, std::move(g));
@@ -218,6 +223,14 @@ namespace cgl
 				&& std::max(m_min.y(), other.m_min.y()) < std::min(m_max.y(), other.m_max.y());
 		}
 
+		//矩形同士の距離（重なっていれば0）
+		double distance(const BoundingRect& other)const
+		{
+			const double dx = std::max(0.0, std::max(other.m_min.x() - m_max.x(), m_min.x() - other.m_max.x()));
+			const double dy = std::max(0.0, std::max(other.m_min.y() - m_max.y(), m_min.y() - other.m_max.y()));
+			return std::sqrt(dx*dx + dy*dy);
+		}
+
 		bool includes(const Eigen::Vector2d& point)const
 		{
 			return m_min.x() < point.x() && point.x() < m_max.x()
@@ -293,21 +306,51 @@ namespace cgl
 
 		Eigen::Vector2d product(const Eigen::Vector2d& v)const;
 
+		//線形部分の行列式（負であれば鏡映を含み、ポリゴンの向きが反転する）
+		double linearDeterminant()const
+		{
+			return mat(0, 0)*mat(1, 1) - mat(0, 1)*mat(1, 0);
+		}
+
 		void printMat()const;
 
 	private:
 		Mat3x3 mat;
 	};
 
+	//座標列だけで表したジオメトリ（点・線・ポリゴンの外周と穴）
+	//GEOSのジオメトリは生成したGeometryFactoryを非アトミックな参照カウントで共有するので、スレッド間で共有するキャッシュにはこちらを保持し、
+	//取り出す側が呼び出しごとに作るファクトリでジオメトリを組み立てる
+	class GeometryCoordinates
+	{
+	public:
+		//点・線・ポリゴン以外のジオメトリを含む場合はfalseを返す
+		bool assign(const Geometries& geometries);
+
+		Geometries build(const TransformPacked& transform)const;
+
+	private:
+		enum class ShapeType { Point, LineString, LinearRing, Polygon };
+
+		struct Shape
+		{
+			ShapeType type;
+			//ポリゴンの場合は先頭が外周で残りが穴
+			std::vector<Vector<Eigen::Vector2d>> rings;
+		};
+
+		std::vector<Shape> m_shapes;
+	};
+
 	GeometryPtr MakeLine(const Eigen::Vector2d& p0, const Eigen::Vector2d& p1);
 
 	//Compress to ShapeRecord
 	PackedRecord WritePathPacked(const Path& path);
 	//PackedRecord GetPolygonPacked(const gg::Polygon* poly);
 
-	using PackedPolyData = std::vector<PackedList>;
-	//最終的にShapeに変換する個所以外では、再利用性を考えPackedListは内部に頂点のみを持つものとし、
-	//複数のポリゴンはstd::vector<PackedList>で表現する
+	using PackedPolyData = std::vector<PackedVertices>;
+	//最終的にShapeに変換する個所以外では、再利用性を考えPackedVerticesは内部に頂点のみを持つものとし、
+	//複数のポリゴンはstd::vector<PackedVertices>で表現する
 	PackedPolyData GetPolygonVertices(const gg::Polygon* poly);
 	//PackedList GetShapesFromGeosPacked(const std::vector<gg::Geometry*>& polygons);
 
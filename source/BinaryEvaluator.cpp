@@ -111,7 +111,7 @@ namespace cgl
 
 	bool EqualFunc(const Val& lhs, const Val& rhs, Context& env)
 	{
-		const double eps = 0.001;
+		const double eps = EqualityTolerance;
 
 		if (IsType<int>(lhs))
 		{
@@ -438,4 +438,134 @@ namespace cgl
 		ClosureMaker maker(context, functionArguments);
 		return boost::apply_visitor(maker, expr);
 	}
+
+	//関数呼び出しでは引数スコープがフレームの最も外側のスコープになるので、引数を指す識別子はその中の位置で引ける
+	class ArgumentSlotAssigner : public ExprTransformer
+	{
+	public:
+		//引数名から引数スコープ内の位置への表
+		std::unordered_map<std::string, int> slots;
+
+		//関数本体の中で引数と同名の変数を束縛する式があった引数名
+		std::set<std::string> shadowedNames;
+
+		//importしたファイルはどの名前を束縛するか分からない
+		bool hasImport = false;
+
+		ArgumentSlotAssigner(const std::vector<Identifier>& arguments)
+		{
+			std::set<std::string> duplicatedNames;
+			for (size_t i = 0; i < arguments.size(); ++i)
+			{
+				if (!slots.emplace(arguments[i].name, static_cast<int>(i)).second)
+				{
+					duplicatedNames.insert(arguments[i].name);
+				}
+			}
+
+			//同名の引数は後から束縛したものが前の位置を上書きするので、位置を決めない
+			for (const auto& name : duplicatedNames)
+			{
+				slots.erase(name);
+			}
+		}
+
+		Expr operator()(const Identifier& node)override
+		{
+			const auto it = slots.find(node.name);
+			if (it == slots.end())
+			{
+				return node;
+			}
+
+			Identifier result(node);
+			result.argumentSlot = it->second;
+			return result;
+		}
+
+		Expr operator()(const UnaryExpr& node)override
+		{
+			//参照演算子の右辺は名前から参照を作るので残す
+			if (node.op == UnaryOp::Dynamic)
+			{
+				return node;
+			}
+			return ExprTransformer::operator()(node);
+		}
+
+		Expr operator()(const BinaryExpr& node)override
+		{
+			//代入式の左辺の識別子は名前で束縛し直すので残す
+			if (node.op == BinaryOp::Assign && IsType<Identifier>(node.lhs))
+			{
+				return BinaryExpr(node.lhs, boost::apply_visitor(*this, node.rhs), node.op).setLocation(node);
+			}
+			return ExprTransformer::operator()(node);
+		}
+
+		Expr operator()(const For& node)override
+		{
+			if (slots.find(node.loopCounter.name) != slots.end())
+			{
+				shadowedNames.insert(node.loopCounter.name);
+			}
+			return ExprTransformer::operator()(node);
+		}
+
+		Expr operator()(const KeyExpr& node)override
+		{
+			if (slots.find(node.name.name) != slots.end())
+			{
+				shadowedNames.insert(node.name.name);
+			}
+			return ExprTransformer::operator()(node);
+		}
+
+		Expr operator()(const Import& node)override
+		{
+			hasImport = true;
+			return node;
+		}
+
+		//以下の式は評価時にスコープを作るかどうかが継承の有無で変わったり、別のフレームや後で閉じた式として評価されるので中に入らない
+		Expr operator()(const DefFunc& node)override { return node; }
+		Expr operator()(const RecordConstractor& node)override { return node; }
+		Expr operator()(const DeclSat& node)override { return node; }
+		Expr operator()(const DeclFree& node)override { return node; }
+
+		Expr operator()(const LRValue& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const Lines& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const If& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const ListConstractor& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const Accessor& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const Range& node)override { return ExprTransformer::operator()(node); }
+		Expr operator()(const Return& node)override { return ExprTransformer::operator()(node); }
+	};
+
+	Expr AssignArgumentSlots(const std::vector<Identifier>& arguments, const Expr& expr)
+	{
+		ArgumentSlotAssigner assigner(arguments);
+		if (assigner.slots.empty())
+		{
+			return expr;
+		}
+
+		const Expr result = boost::apply_visitor(assigner, expr);
+		if (assigner.hasImport)
+		{
+			return expr;
+		}
+		if (assigner.shadowedNames.empty())
+		{
+			return result;
+		}
+
+		//遮蔽される引数名を外してもう一度割り当てる
+		ArgumentSlotAssigner retry(arguments);
+		for (const auto& name : assigner.shadowedNames)
+		{
+			retry.slots.erase(name);
+		}
+		return retry.slots.empty() ? expr : boost::apply_visitor(retry, expr);
+	}
 }
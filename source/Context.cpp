@@ -57,7 +57,7 @@ namespace cgl
 
 		void update(Address address)
 		{
-			if (!isMarked(address))
+			if (!isMarked(address) && !context.isSkippedByYoungGC(address))
 			{
 				reachableAddressSet.emplace(address);
 				newAddressSet.emplace(address);
@@ -245,7 +245,7 @@ namespace cgl
 
 		void update(Address address)
 		{
-			if (!isMarked(address))
+			if (!isMarked(address) && !context.isSkippedByYoungGC(address))
 			{
 				reachableAddressSet.emplace(address);
 				newAddressSet.emplace(address);
@@ -546,34 +546,31 @@ namespace cgl
 		//TODO: ここの引数にfunctionArgumentsが入っていないのは正しい？
 		const Expr closedFuncExpr = AsClosure(*pEnv, expr);
 
-		FuncVal funcVal(arguments, closedFuncExpr);
+		FuncVal funcVal(arguments, AssignArgumentSlots(arguments, closedFuncExpr));
 		return makeTemporaryValue(funcVal);
 	}
 
-	void Context::registerBuiltInFunction(const std::string& name, const BuiltInFunction& function, bool isPlateausFunction)
+	const Context::BuiltInFunctionTable& Context::BuiltInFunctions()
 	{
-		const Address address1 = m_functions.add(function);
-		const Address address2 = m_values.add(FuncVal(address1));
+		static const BuiltInFunctionTable builtInFunctions = MakeBuiltInFunctionTable();
+		return builtInFunctions;
+	}
 
-		if (address1 != address2)
+	size_t Context::BuiltInFunctionIndex(Address functionAddress)
+	{
+		if (!functionAddress.isValid() || BuiltInFunctions().size() < functionAddress.valueID)
 		{
-			CGL_Error("組み込み関数の追加に失敗");
+			CGL_Error(std::string() + "Address(" + functionAddress.toString() + ") is not a built-in function.");
 		}
 
-		bindValueID(name, address1);
-		m_globalFunctions[name] = address1;
-
-		if (isPlateausFunction)
-		{
-			m_plateausFunctions[address1] = name;
-		}
+		return static_cast<size_t>(functionAddress.valueID - 1);
 	}
 
 	Val Context::callBuiltInFunction(Address functionAddress, const std::vector<Address>& arguments, const LocationInfo& info)
 	{
 		if (std::shared_ptr<Context> pEnv = m_weakThis.lock())
 		{
-			return m_functions[functionAddress](pEnv, arguments, info);
+			return BuiltInFunctions()[BuiltInFunctionIndex(functionAddress)].function(pEnv, arguments, info);
 		}
 			
 		CGL_Error("ここは通らないはず");
@@ -582,7 +579,7 @@ namespace cgl
 
 	bool Context::isPlateausBuiltInFunction(Address functionAddress)
 	{
-		return m_plateausFunctions.find(functionAddress) != m_plateausFunctions.end();
+		return BuiltInFunctions()[BuiltInFunctionIndex(functionAddress)].isPlateausFunction;
 	}
 
 	const Val& Context::expand(const LRValue& lrvalue, const LocationInfo& info)const
@@ -597,10 +594,9 @@ namespace cgl
 			}
 			else if (lrvalue.eitherReference().replaced.isValid())
 			{
-				auto it = m_values.at(lrvalue.eitherReference().replaced);
-				if (it != m_values.end())
+				if (auto pValue = m_values.at(lrvalue.eitherReference().replaced))
 				{
-					return it->second;
+					return *pValue;
 				}
 			}
 
@@ -608,10 +604,9 @@ namespace cgl
 		}
 		else if (lrvalue.isLValue())
 		{
-			auto it = m_values.at(lrvalue.address(*this));
-			if (it != m_values.end())
+			if (auto pValue = m_values.at(lrvalue.address(*this)))
 			{
-				return it->second;
+				return *pValue;
 			}
 
 			CGL_ErrorNode(info, std::string("値") + lrvalue.toString() + "の参照に失敗しました。");
@@ -633,18 +628,16 @@ namespace cgl
 			}
 			else if (lrvalue.eitherReference().replaced.isValid())
 			{
-				auto it = m_values.at(lrvalue.eitherReference().replaced);
-				if (it != m_values.end())
+				if (auto pValue = m_values.at(lrvalue.eitherReference().replaced))
 				{
-					return it->second;
+					return *pValue;
 				}
 			}*/
 			if (lrvalue.eitherReference().replaced.isValid())
 			{
-				auto it = m_values.at(lrvalue.eitherReference().replaced);
-				if (it != m_values.end())
+				if (auto pValue = m_values.at(lrvalue.eitherReference().replaced))
 				{
-					return it->second;
+					return *pValue;
 				}
 			}
 
@@ -652,10 +645,9 @@ namespace cgl
 		}
 		else if (lrvalue.isLValue())
 		{
-			auto it = m_values.at(lrvalue.address(*this));
-			if (it != m_values.end())
+			if (auto pValue = m_values.at(lrvalue.address(*this)))
 			{
-				return it->second;
+				return *pValue;
 			}
 
 			CGL_ErrorNode(info, std::string("値") + lrvalue.toString() + "の参照に失敗しました。");
@@ -676,10 +668,9 @@ namespace cgl
 			}
 			else if (lrvalue.eitherReference().replaced.isValid())
 			{
-				auto it = m_values.at(lrvalue.eitherReference().replaced);
-				if (it != m_values.end())
+				if (auto pValue = m_values.at(lrvalue.eitherReference().replaced))
 				{
-					return it->second;
+					return *pValue;
 				}
 			}
 
@@ -687,10 +678,9 @@ namespace cgl
 		}
 		else if (lrvalue.isLValue())
 		{
-			auto it = m_values.at(lrvalue.address(*this));
-			if (it != m_values.end())
+			if (auto pValue = m_values.at(lrvalue.address(*this)))
 			{
-				return it->second;
+				return *pValue;
 			}
 
 			return boost::none;
@@ -711,10 +701,9 @@ namespace cgl
 			}
 			else*/ if (lrvalue.eitherReference().replaced.isValid())
 			{
-				auto it = m_values.at(lrvalue.eitherReference().replaced);
-				if (it != m_values.end())
+				if (auto pValue = m_values.at(lrvalue.eitherReference().replaced))
 				{
-					return it->second;
+					return *pValue;
 				}
 			}
 
@@ -722,10 +711,9 @@ namespace cgl
 		}
 		else if (lrvalue.isLValue())
 		{
-			auto it = m_values.at(lrvalue.address(*this));
-			if (it != m_values.end())
+			if (auto pValue = m_values.at(lrvalue.address(*this)))
 			{
-				return it->second;
+				return *pValue;
 			}
 
 			return boost::none;
@@ -757,9 +745,93 @@ namespace cgl
 	//オブジェクトの中にある全ての値への参照をリストで取得する
 	std::vector<RegionVariable> Context::expandReferences(Address address, const LocationInfo& info, RegionVariable::Attribute attribute)
 	{
+		//solverが書き込むアドレスを他のレコードと共有していてはいけない
+		unshareMembers(address, true);
 		return GetConstraintAddressesFrom(address, *m_weakThis.lock(), attribute);
 	}
 
+	void Context::unshareMembers(Address address, bool recursive)
+	{
+		std::vector<Address> containers({ address });
+		std::unordered_set<Address> visited;
+
+		while (!containers.empty())
+		{
+			const Address current = containers.back();
+			containers.pop_back();
+			if (!visited.insert(current).second)
+			{
+				continue;
+			}
+
+			const auto valueOpt = expandOpt(LRValue(current));
+			if (!valueOpt || !(IsType<List>(valueOpt.get()) || IsType<Record>(valueOpt.get())))
+			{
+				continue;
+			}
+			const Val* pValue = &valueOpt.get();
+
+			//共有している値は複製し、中のリスト・レコードは（recursiveなら）後で辿る
+			//複製を作る時にGCが走ってもスロットは動かないが、読んだ値への参照は持ち越さずに名前と位置だけ控える
+			const auto privateCopy = [&](Address child)->boost::optional<Address>
+			{
+				const Val& childValue = expand(LRValue(child), LocationInfo());
+				if (IsType<List>(childValue) || IsType<Record>(childValue))
+				{
+					if (recursive)
+					{
+						containers.push_back(child);
+					}
+					return boost::none;
+				}
+				if (!m_values.isShared(child))
+				{
+					return boost::none;
+				}
+				return makeTemporaryValue(Val(childValue));
+			};
+
+			if (IsType<List>(*pValue))
+			{
+				const std::vector<Address> data = As<List>(*pValue).data;
+				std::vector<std::pair<size_t, Address>> replaced;
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					if (const auto newAddress = privateCopy(data[i]))
+					{
+						replaced.emplace_back(i, newAddress.get());
+					}
+				}
+
+				if (!replaced.empty())
+				{
+					List& list = As<List>(*m_values.at(current));
+					for (const auto& indexAddress : replaced)
+					{
+						list.data[indexAddress.first] = indexAddress.second;
+					}
+				}
+			}
+			else
+			{
+				std::vector<std::pair<std::string, Address>> replaced;
+				const RecordMembers<Address> members = As<Record>(*pValue).values;
+				for (const auto& member : members)
+				{
+					if (const auto newAddress = privateCopy(member.second))
+					{
+						replaced.emplace_back(member.first, newAddress.get());
+					}
+				}
+
+				if (!replaced.empty())
+				{
+					As<Record>(*m_values.at(current)).values.insertOrAssign(std::move(replaced));
+				}
+			}
+		}
+	}
+
 	std::vector<RegionVariable> Context::expandReferences2(const Accessor& accessor, const LocationInfo& info)
 	{
 		auto sharedThis = m_weakThis.lock();
@@ -813,6 +885,9 @@ namespace cgl
 			{
 				const Address address = readBuffer()[i].first;
 
+				//辿った先のアドレスはsolverが書き込むので、共有している値はこのリスト・レコード専用にしておく
+				unshareMembers(address, false);
+
 				boost::optional<const Val&> objOpt = expandOpt(LRValue(address));
 				if (!objOpt)
 				{
@@ -1002,6 +1077,9 @@ namespace cgl
 
 			for (const auto& access : accessor.accesses)
 			{
+				//参照は辿った各アドレスに紐づけられ、他のレコードでの代入に追従してしまうので、共有している値はこのリスト・レコード専用にしておく
+				unshareMembers(address, false);
+
 				boost::optional<const Val&> objOpt = pEnv->expandOpt(LRValue(address));
 				if (!objOpt)
 				{
@@ -1142,12 +1220,12 @@ namespace cgl
 
 	bool Context::existsInCurrentScope(const std::string& name)const
 	{
-		return localEnv().back().variables.find(name) != localEnv().back().variables.end();
+		return static_cast<bool>(localEnv().back().variables.lookup(name));
 	}
 
 	bool Context::existsInLocalScope(const std::string& name)const
 	{
-		return std::any_of(localEnv().begin(), localEnv().end(), [&](const Scope& scope) {return scope.variables.find(name) != scope.variables.end(); });
+		return std::any_of(localEnv().begin(), localEnv().end(), [&](const Scope& scope) {return static_cast<bool>(scope.variables.lookup(name)); });
 	}
 
 	void Context::printContext(bool flag)const {}
@@ -1258,8 +1336,9 @@ namespace cgl
 						CGL_Error("オブジェクトがレコードでない");
 					}
 
-					Record& record = As<Record>(objRef);
-					auto it = record.values.find(recordAccessOpt.get().name);
+					//途中のメンバは読むだけなので、共有されているメンバ表を複製しないようにconstで探す
+					const Record& record = As<Record>(objRef);
+					const auto it = record.values.find(recordAccessOpt.get().name);
 					if (it == record.values.end())
 					{
 						CGL_Error("指定された識別子がレコード中に存在しない");
@@ -1270,7 +1349,7 @@ namespace cgl
 						const Address oldAddress = it->second;
 						const Address newAddress = newValue.isLValue() ? newValue.address(*this) : makeTemporaryValue(newValue.evaluated());
 						changeAddress(oldAddress, newAddress);
-						it->second = newAddress;
+						As<Record>(objRef).values[recordAccessOpt.get().name] = newAddress;
 					}
 					else
 					{
@@ -1319,25 +1398,48 @@ namespace cgl
 
 		localEnv().back().temporaryAddresses.push_back(address);
 
-		const int thresholdGC = 20000;
-		//const int thresholdGC = 5000;
-		if (thresholdGC <= static_cast<int>(m_values.size()) - static_cast<int>(m_lastGCValueSize))
+		//若い世代が溜まったらそれだけを回収し、古い世代が前回の全体GCから十分増えていたら全体を回収する
+		const size_t youngThresholdGC = 20000;
+		const size_t fullThresholdGC = 200000;
+		if (youngThresholdGC <= m_values.youngSize())
 		{
-			garbageCollect();
-			m_lastGCValueSize = m_values.size();
+			if (fullThresholdGC <= m_values.size() - std::min(m_values.size(), m_lastGCValueSize + m_values.youngSize()))
+			{
+				garbageCollect();
+			}
+			else
+			{
+				garbageCollectYoung();
+			}
 		}
 
 		return address;
 	}
 
+	Address Context::findArgumentAddress(const Identifier& identifier)const
+	{
+		//関数呼び出しのフレームでは最も外側のスコープが引数スコープになっている
+		//フレームが違う形をしていて位置の名前が合わない場合は、名前から探し直す
+		if (0 <= identifier.argumentSlot && !localEnv().empty())
+		{
+			const ScopeVariables& arguments = localEnv().front().variables;
+			const size_t slot = static_cast<size_t>(identifier.argumentSlot);
+			if (slot < arguments.size() && arguments.at(slot).first == identifier.name)
+			{
+				return arguments.at(slot).second;
+			}
+		}
+
+		return findAddress(identifier.name);
+	}
+
 	Address Context::findAddress(const std::string& name)const
 	{
 		for (auto scopeIt = localEnv().rbegin(); scopeIt != localEnv().rend(); ++scopeIt)
 		{
-			auto variableIt = scopeIt->variables.find(name);
-			if (variableIt != scopeIt->variables.end())
+			if (const auto address = scopeIt->variables.lookup(name))
 			{
-				return variableIt->second;
+				return address.get();
 			}
 		}
 
@@ -1364,6 +1466,10 @@ namespace cgl
 				{
 					result.insert(nameVal.first);
 				}
+				for (const auto& nameVal : scopeIt->variables.inherited())
+				{
+					result.insert(nameVal.first);
+				}
 			}
 		}
 		return result;
@@ -1508,6 +1614,30 @@ namespace cgl
 	{
 		m_random.seed(1);
 
+		//組み込み関数の本体は共有の表にあるので、ここではFuncValを作って名前を束縛するだけ
+		const BuiltInFunctionTable& builtInFunctions = BuiltInFunctions();
+		for (size_t i = 0; i < builtInFunctions.size(); ++i)
+		{
+			const Address address = m_values.add(FuncVal(BuiltInFunctionAddress(i)));
+			if (address != BuiltInFunctionAddress(i))
+			{
+				CGL_Error("組み込み関数の追加に失敗");
+			}
+
+			bindValueID(builtInFunctions[i].name, address);
+			m_globalFunctions[builtInFunctions[i].name] = address;
+		}
+	}
+
+	Context::BuiltInFunctionTable Context::MakeBuiltInFunctionTable()
+	{
+		BuiltInFunctionTable builtInFunctions;
+
+		const auto registerBuiltInFunction = [&](const std::string& name, const BuiltInFunction& function, bool isPlateausFunction)
+		{
+			builtInFunctions.push_back(BuiltInFunctionInfo{ name, function, isPlateausFunction });
+		};
+
 		registerBuiltInFunction(
 			"Print",
 			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
@@ -1563,14 +1693,14 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"PrintContext",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 0)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			printContext(std::cout);
+			pEnv->printContext(std::cout);
 
 			return 0;
 		},
@@ -1643,7 +1773,8 @@ namespace cgl
 			const Val& value = pEnv->expand(LRValue(arguments[1]), info);
 
 			List& original = As<List>(listValue);
-			original.data.push_back(pEnv->makeTemporaryValue(value));
+			const Address newAddress = pEnv->makeTemporaryValue(value);
+			original.data.push_back(newAddress);
 			return original;
 		},
 			false
@@ -1963,15 +2094,15 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Random",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			const Val& v0 = expand(LRValue(arguments[0]), info);
-			const Val& v1 = expand(LRValue(arguments[1]), info);
+			const Val& v0 = pEnv->expand(LRValue(arguments[0]), info);
+			const Val& v1 = pEnv->expand(LRValue(arguments[1]), info);
 
 			if (!IsNum(v0) || !IsNum(v1))
 			{
@@ -1981,12 +2112,12 @@ namespace cgl
 			if (IsType<int>(v0) && IsType<int>(v1))
 			{
 				std::uniform_int_distribution<int> distInt(As<int>(v0), As<int>(v1));
-				return distInt(m_random);
+				return distInt(pEnv->m_random);
 			}
 
 			const double x0 = AsDouble(v0);
 			const double x1 = AsDouble(v1);
-			const double x01 = m_dist(m_random);
+			const double x01 = pEnv->m_dist(pEnv->m_random);
 			return x0 + (x1 - x0)*x01;
 		},
 			false
@@ -1994,7 +2125,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"RandomSeed",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 0 && arguments.size() != 1)
 			{
@@ -2004,16 +2135,16 @@ namespace cgl
 			if (arguments.empty())
 			{
 				std::random_device randomDevice;
-				m_random.seed(randomDevice());
+				pEnv->m_random.seed(randomDevice());
 			}
 			else
 			{
-				const Val& value = expand(LRValue(arguments[0]), info);
+				const Val& value = pEnv->expand(LRValue(arguments[0]), info);
 				if (!IsType<int>(value))
 				{
 					CGL_ErrorNode(info, "引数の型が正しくありません");
 				}
-				m_random.seed(As<int>(value));
+				pEnv->m_random.seed(As<int>(value));
 			}
 
 			return 0;
@@ -2023,7 +2154,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"BuildPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2 && arguments.size() != 3)
 			{
@@ -2046,16 +2177,16 @@ namespace cgl
 
 			if (obstaclesValOpt)
 			{
-				return BuildPath(As<PackedList>(As<List>(passesVal).packed(*this)), pEnv, As<int>(numVal), As<PackedList>(As<List>(obstaclesValOpt.get()).packed(*this))).unpacked(*this);
+				return BuildPath(As<PackedList>(As<List>(passesVal).packed(*pEnv)), pEnv, As<int>(numVal), As<PackedList>(As<List>(obstaclesValOpt.get()).packed(*pEnv))).unpacked(*pEnv);
 			}
-			return BuildPath(As<PackedList>(As<List>(passesVal).packed(*this)), pEnv, As<int>(numVal)).unpacked(*this);
+			return BuildPath(As<PackedList>(As<List>(passesVal).packed(*pEnv)), pEnv, As<int>(numVal)).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Free",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2080,7 +2211,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Fixed",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
@@ -2112,7 +2243,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Text",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1 && arguments.size() != 2 && arguments.size() != 3 && arguments.size() != 4)
 			{
@@ -2127,7 +2258,7 @@ namespace cgl
 			if (!IsType<CharString>(strVal))
 			{
 				std::stringstream ss;
-				ValuePrinter2 printer(m_weakThis.lock(), ss, 0);
+				ValuePrinter2 printer(pEnv, ss, 0);
 				boost::apply_visitor(printer, strVal);
 				CharString printedStr(AsUtf32(ss.str()));
 				strVal = printedStr;
@@ -2150,26 +2281,26 @@ namespace cgl
 				return BuildText(
 					As<CharString>(strVal), 
 					AsDouble(heightOpt.get()),
-					As<PackedRecord>(As<Record>(baseLineOpt.get()).packed(*this)), 
+					As<PackedRecord>(As<Record>(baseLineOpt.get()).packed(*pEnv)), 
 					As<CharString>(fontNameOpt.get())
-				).unpacked(*this);
+				).unpacked(*pEnv);
 			}
 			else if (3 <= arguments.size())
 			{
-				return BuildText(As<CharString>(strVal), AsDouble(heightOpt.get()), As<PackedRecord>(As<Record>(baseLineOpt.get()).packed(*this))).unpacked(*this);
+				return BuildText(As<CharString>(strVal), AsDouble(heightOpt.get()), As<PackedRecord>(As<Record>(baseLineOpt.get()).packed(*pEnv))).unpacked(*pEnv);
 			}
 			else if (2 <= arguments.size())
 			{
-				return BuildText(As<CharString>(strVal), AsDouble(heightOpt.get())).unpacked(*this);
+				return BuildText(As<CharString>(strVal), AsDouble(heightOpt.get())).unpacked(*pEnv);
 			}
-			return BuildText(As<CharString>(strVal)).unpacked(*this);
+			return BuildText(As<CharString>(strVal)).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"OffsetPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
@@ -2188,14 +2319,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetOffsetPath(As<PackedRecord>(As<Record>(arg1).packed(*this)), AsDouble(arg2)).unpacked(*this);
+			return GetOffsetPath(As<PackedRecord>(As<Record>(arg1).packed(*pEnv)), AsDouble(arg2)).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"SubPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 3)
 			{
@@ -2215,14 +2346,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetSubPath(As<PackedRecord>(As<Record>(arg1).packed(*this)), AsDouble(arg2), AsDouble(arg3)).unpacked(*this);
+			return GetSubPath(As<PackedRecord>(As<Record>(arg1).packed(*pEnv)), AsDouble(arg2), AsDouble(arg3)).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"FunctionPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 4)
 			{
@@ -2239,14 +2370,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetFunctionPath(m_weakThis.lock(), info, As<FuncVal>(func), AsDouble(beginX), AsDouble(endX), As<int>(numOfPoints)).unpacked(*this);
+			return GetFunctionPath(pEnv, info, As<FuncVal>(func), AsDouble(beginX), AsDouble(endX), As<int>(numOfPoints)).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"ShapeOuterPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2260,14 +2391,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 			
-			return GetShapeOuterPaths(As<PackedRecord>(As<Record>(arg1).packed(*this)), pEnv).unpacked(*this);
+			return GetShapeOuterPaths(As<PackedRecord>(As<Record>(arg1).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"ShapeInnerPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2281,14 +2412,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetShapeInnerPaths(As<PackedRecord>(As<Record>(arg1).packed(*this)), pEnv).unpacked(*this);
+			return GetShapeInnerPaths(As<PackedRecord>(As<Record>(arg1).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"ShapePath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2302,14 +2433,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetShapePaths(As<PackedRecord>(As<Record>(arg1).packed(*this)), pEnv).unpacked(*this);
+			return GetShapePaths(As<PackedRecord>(As<Record>(arg1).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Touch",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
@@ -2323,8 +2454,20 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Near",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
+			//図形のリストを1つだけ渡した場合は全ての組に対して評価する
+			if (arguments.size() == 1)
+			{
+				const Val& shapes = pEnv->expand(LRValue(arguments[0]), info);
+				if (!IsType<List>(shapes))
+				{
+					CGL_ErrorNode(info, "引数の型が正しくありません");
+				}
+
+				return ShapeNearAll(As<PackedList>(As<List>(shapes).packed(*pEnv)), pEnv);
+			}
+
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
@@ -2337,8 +2480,20 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Avoid",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
+			//図形のリストを1つだけ渡した場合は全ての組に対して評価する
+			if (arguments.size() == 1)
+			{
+				const Val& shapes = pEnv->expand(LRValue(arguments[0]), info);
+				if (!IsType<List>(shapes))
+				{
+					CGL_ErrorNode(info, "引数の型が正しくありません");
+				}
+
+				return ShapeAvoidAll(As<PackedList>(As<List>(shapes).packed(*pEnv)), pEnv);
+			}
+
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
@@ -2351,77 +2506,77 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Diff",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return Unpacked(ShapeDiff(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv), *this);
+			return Unpacked(ShapeDiff(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv), *pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Union",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return Unpacked(ShapeUnion(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv), *this);
+			return Unpacked(ShapeUnion(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv), *pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Intersect",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return Unpacked(ShapeIntersect(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv), *this);
+			return Unpacked(ShapeIntersect(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv), *pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"SymDiff",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return Unpacked(ShapeSymDiff(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv), *this);
+			return Unpacked(ShapeSymDiff(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv), *pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Buffer",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return Unpacked(ShapeBuffer(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv), *this);
+			return Unpacked(ShapeBuffer(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv), *pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"DeformShapeByPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
@@ -2436,14 +2591,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetBaseLineDeformedShape(As<PackedRecord>(As<Record>(shape).packed(*this)), As<PackedRecord>(As<Record>(path).packed(*this)), pEnv).unpacked(*this);
+			return GetBaseLineDeformedShape(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), As<PackedRecord>(As<Record>(path).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"DeformShapeByPath2",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 4)
 			{
@@ -2461,17 +2616,17 @@ namespace cgl
 			}
 
 			return GetDeformedPathShape(
-				As<PackedRecord>(As<Record>(shape).packed(*this)),
-				As<PackedRecord>(As<Record>(p0).packed(*this)),
-				As<PackedRecord>(As<Record>(p1).packed(*this)),
-				As<PackedRecord>(As<Record>(path).packed(*this)), pEnv).unpacked(*this);
+				As<PackedRecord>(As<Record>(shape).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p0).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p1).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(path).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"BezierPath",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 5)
 			{
@@ -2490,19 +2645,19 @@ namespace cgl
 			}
 
 			return GetBezierPath(
-				As<PackedRecord>(As<Record>(p0).packed(*this)),
-				As<PackedRecord>(As<Record>(n0).packed(*this)),
-				As<PackedRecord>(As<Record>(p1).packed(*this)),
-				As<PackedRecord>(As<Record>(n1).packed(*this)),
+				As<PackedRecord>(As<Record>(p0).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(n0).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p1).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(n1).packed(*pEnv)),
 				As<int>(num)
-			).unpacked(*this);
+			).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"CubicBezier",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 5)
 			{
@@ -2521,19 +2676,19 @@ namespace cgl
 			}
 
 			return GetCubicBezier(
-				As<PackedRecord>(As<Record>(p0).packed(*this)),
-				As<PackedRecord>(As<Record>(p1).packed(*this)),
-				As<PackedRecord>(As<Record>(p2).packed(*this)),
-				As<PackedRecord>(As<Record>(p3).packed(*this)),
+				As<PackedRecord>(As<Record>(p0).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p1).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p2).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(p3).packed(*pEnv)),
 				As<int>(num)
-			).unpacked(*this);
+			).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"SubDiv",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
@@ -2549,58 +2704,58 @@ namespace cgl
 			}
 
 			return ShapeSubDiv(
-				As<PackedRecord>(As<Record>(shape).packed(*this)),
+				As<PackedRecord>(As<Record>(shape).packed(*pEnv)),
 				As<int>(num), pEnv
-			).unpacked(*this);
+			).unpacked(*pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Area",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return ShapeArea(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), pEnv);
+			return ShapeArea(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), pEnv);
 		},
 			true
 			);
 
 		registerBuiltInFunction(
 			"Distance",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return ShapeDistance(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv);
+			return ShapeDistance(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"ClosestPoints",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 2)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			return ShapeClosestPoints(Packed(pEnv->expand(LRValue(arguments[0]), info), *this), Packed(pEnv->expand(LRValue(arguments[1]), info), *this), pEnv).unpacked(*this);
+			return ShapeClosestPoints(Packed(pEnv->expand(LRValue(arguments[0]), info), *pEnv), Packed(pEnv->expand(LRValue(arguments[1]), info), *pEnv), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignH",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2614,14 +2769,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignH(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignH(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignHTop",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2635,14 +2790,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignHTop(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignHTop(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignHBottom",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2656,14 +2811,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignHBottom(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignHBottom(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignHCenter",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2677,14 +2832,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignHCenter(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignHCenter(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignV",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2698,14 +2853,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignV(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignV(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignVLeft",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2719,14 +2874,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignVLeft(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignVLeft(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignVRight",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2740,14 +2895,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignVRight(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignVRight(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"AlignVCenter",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2761,14 +2916,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return AlignVCenter(As<PackedList>(As<List>(shape).packed(*this)), pEnv).unpacked(*this);
+			return AlignVCenter(As<PackedList>(As<List>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"Left",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2782,14 +2937,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeLeft(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeLeft(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"Right",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2803,14 +2958,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeRight(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeRight(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"Top",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2824,14 +2979,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeTop(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeTop(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"Bottom",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2845,14 +3000,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeBottom(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeBottom(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"TopLeft",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2866,14 +3021,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeTopLeft(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeTopLeft(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"TopRight",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2887,14 +3042,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeTopRight(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeTopRight(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"BottomLeft",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2908,14 +3063,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeBottomLeft(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeBottomLeft(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"BottomRight",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2929,14 +3084,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return ShapeBottomRight(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return ShapeBottomRight(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"BoundingBox",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2950,14 +3105,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetBoundingBox(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return GetBoundingBox(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"ConvexHull",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2971,14 +3126,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetConvexHull(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return GetConvexHull(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"GlobalShape",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -2992,14 +3147,14 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetGlobalShape(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return GetGlobalShape(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"TransformShape",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 4)
 			{
@@ -3017,18 +3172,18 @@ namespace cgl
 			}
 
 			return GetTransformedShape(
-				As<PackedRecord>(As<Record>(shape).packed(*this)),
-				As<PackedRecord>(As<Record>(pos).packed(*this)),
-				As<PackedRecord>(As<Record>(scale).packed(*this)),
+				As<PackedRecord>(As<Record>(shape).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(pos).packed(*pEnv)),
+				As<PackedRecord>(As<Record>(scale).packed(*pEnv)),
 				AsDouble(angle), pEnv
-			).unpacked(*this);
+			).unpacked(*pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"GetPolygon",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -3042,21 +3197,21 @@ namespace cgl
 				CGL_ErrorNode(info, "引数の型が正しくありません");
 			}
 
-			return GetPolygon(As<PackedRecord>(As<Record>(shape).packed(*this)), pEnv).unpacked(*this);
+			return Unpacked(GetPolygon(As<PackedRecord>(As<Record>(shape).packed(*pEnv)), pEnv), *pEnv);
 		},
 			false
 			);
 
 		registerBuiltInFunction(
 			"GC",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 0)
 			{
 				CGL_ErrorNode(info, "引数の数が正しくありません");
 			}
 
-			garbageCollect();
+			pEnv->garbageCollect();
 
 			return 0;
 		},
@@ -3065,7 +3220,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"EnableGC",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() != 1)
 			{
@@ -3074,7 +3229,7 @@ namespace cgl
 
 			if (auto opt = AsOpt<bool>(pEnv->expand(LRValue(arguments[0]), info)))
 			{
-				m_automaticGC = opt.get();
+				pEnv->m_automaticGC = opt.get();
 			}
 
 			return 0;
@@ -3084,7 +3239,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Error",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() == 0)
 			{
@@ -3094,7 +3249,7 @@ namespace cgl
 			{
 				std::stringstream ss;
 				ss << "Error() called: ";
-				printVal2(pEnv->expand(LRValue(arguments[0]), info), m_weakThis.lock(), ss);
+				printVal2(pEnv->expand(LRValue(arguments[0]), info), pEnv, ss);
 				CGL_ErrorNode(info, ss.str());
 			}
 
@@ -3105,7 +3260,7 @@ namespace cgl
 
 		registerBuiltInFunction(
 			"Assert",
-			[&](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
+			[](std::shared_ptr<Context> pEnv, const std::vector<Address>& arguments, const LocationInfo& info)->Val
 		{
 			if (arguments.size() == 0 || 3 <= arguments.size())
 			{
@@ -3114,7 +3269,7 @@ namespace cgl
 
 			if (arguments.size() == 1)
 			{
-				if (EqualFunc(pEnv->expand(LRValue(arguments[0]), info), true, *this))
+				if (EqualFunc(pEnv->expand(LRValue(arguments[0]), info), true, *pEnv))
 				{
 					return 0;
 				}
@@ -3125,7 +3280,7 @@ namespace cgl
 			}
 			else
 			{
-				if (EqualFunc(pEnv->expand(LRValue(arguments[0]), info), true, *this))
+				if (EqualFunc(pEnv->expand(LRValue(arguments[0]), info), true, *pEnv))
 				{
 					return 0;
 				}
@@ -3133,7 +3288,7 @@ namespace cgl
 				{
 					std::stringstream ss;
 					ss << "Assertion failed: ";
-					printVal2(pEnv->expand(LRValue(arguments[1]), info), m_weakThis.lock(), ss);
+					printVal2(pEnv->expand(LRValue(arguments[1]), info), pEnv, ss);
 					CGL_ErrorNode(info, ss.str());
 				}
 			}
@@ -3142,6 +3297,8 @@ namespace cgl
 		},
 			false
 			);
+
+		return builtInFunctions;
 	}
 
 	void Context::changeAddress(Address addressFrom, Address addressTo)
@@ -3265,21 +3422,8 @@ namespace cgl
 		//TODO: GCと同じ要領で環境から参照可能な全てのアドレスを参照し、該当アドレスを書き換える
 	}
 
-	void Context::garbageCollect(bool force)
+	void Context::markReachableAddresses(std::unordered_set<Address>& referenceableAddresses)const
 	{
-		if (!m_automaticGC)
-		{
-			return;
-		}
-
-		static int count = 0;
-		//std::cout << "garbageCollect(" << count << ")" << std::endl;
-		//printContext(std::cout);
-
-		//printContext(std::cout);
-		//CGL_DBG1("GC begin");
-		std::unordered_set<Address> referenceableAddresses;
-
 		const auto isReachable = [&](const Address address)
 		{
 			return referenceableAddresses.find(address) != referenceableAddresses.end();
@@ -3287,15 +3431,10 @@ namespace cgl
 
 		{
 			std::unordered_set<Address> addressesDelta;
-			//std::cout << "Whole Local Env Stack Size: " << m_localEnvStack.size() << std::endl;
 			for (const auto& env : m_localEnvStack)
 			{
-				int scopeCount = 0;
-
-				//std::cout << "Current Scope Depth: " << env.size() << ", ";
 				for (auto scopeIt = env.rbegin(); scopeIt != env.rend(); ++scopeIt)
 				{
-					const int varCount = scopeIt->variables.size() + scopeIt->temporaryAddresses.size();
 					for (const auto& var : scopeIt->variables)
 					{
 						const Address address = var.second;
@@ -3305,18 +3444,23 @@ namespace cgl
 						}
 					}
 
-					for (const Address address : scopeIt->temporaryAddresses)
+					for (const auto& var : scopeIt->variables.inherited())
 					{
+						const Address address = var.second;
 						if (!isReachable(address))
 						{
 							addressesDelta.emplace(address);
 						}
 					}
 
-					//std::cout << "var(" << varCount << "), ";
+					for (const Address address : scopeIt->temporaryAddresses)
+					{
+						if (!isReachable(address))
+						{
+							addressesDelta.emplace(address);
+						}
+					}
 				}
-
-				//std::cout << "\n";
 			}
 
 			GetReachableAddressesFrom(referenceableAddresses, addressesDelta, *this);
@@ -3325,7 +3469,7 @@ namespace cgl
 		{
 			for (size_t i = 0; i < currentRecords.size(); ++i)
 			{
-				Record& record = currentRecords[i];
+				const Record& record = currentRecords[i];
 				Val evaluated = record;
 				std::unordered_set<Address> addressesDelta;
 				CheckValue(evaluated, *this, referenceableAddresses, addressesDelta, RegionVariable::Attribute::Other);
@@ -3342,27 +3486,70 @@ namespace cgl
 			}
 		}
 
-		for (const auto& keyval : m_functions)
+		//若い世代のGCでは、書き換えられた古い世代の値から若い世代の値への参照も根になる
+		if (m_markingYoungGeneration)
 		{
-			referenceableAddresses.emplace(keyval.first);
+			m_values.forEachRemembered([&](Address address, const Val& value)
+			{
+				std::unordered_set<Address> addressesDelta;
+				CheckValue(value, *this, referenceableAddresses, addressesDelta, RegionVariable::Attribute::Other);
+
+				GetReachableAddressesFrom(referenceableAddresses, addressesDelta, *this);
+			});
 		}
 
-		const size_t prevGC = m_values.size();
+		for (size_t i = 0; i < BuiltInFunctions().size(); ++i)
+		{
+			referenceableAddresses.emplace(BuiltInFunctionAddress(i));
+		}
+	}
 
-		/*CGL_DBG1("referenceableAddresses: ");
-		for (const Address add : referenceableAddresses)
+	void Context::garbageCollect(bool force)
+	{
+		if (!m_automaticGC)
 		{
-			std::cout << "Address(" << add.toString() << ")\n";
-		}*/
+			return;
+		}
 
-		m_values.gc(referenceableAddresses);
+		const double beginSec = GetSec();
 
+		std::unordered_set<Address> referenceableAddresses;
+		markReachableAddresses(referenceableAddresses);
+
+		const size_t prevGC = m_values.size();
+		m_values.gc(referenceableAddresses);
 		const size_t postGC = m_values.size();
 
-		//CGL_DBG1("GC end");
+		m_gcTelemetry.collectedValues += prevGC - postGC;
+		m_gcTelemetry.addPause(GetSec() - beginSec, true);
+		m_lastGCValueSize = postGC;
+	}
+
+	void Context::garbageCollectYoung()
+	{
+		if (!m_automaticGC)
+		{
+			return;
+		}
+
+		const double beginSec = GetSec();
+
+		//古い世代の値は辿らないので、若い世代の大きさと書き換えられた古い値の数に比例する時間で済む
+		std::unordered_set<Address> referenceableAddresses;
+		m_markingYoungGeneration = true;
+		try
+		{
+			markReachableAddresses(referenceableAddresses);
+		}
+		catch (...)
+		{
+			m_markingYoungGeneration = false;
+			throw;
+		}
+		m_markingYoungGeneration = false;
 
-		++count;
-		//std::cout << "GC: ValueSize(" << prevGC << " -> " << postGC << ")\n";
+		m_gcTelemetry.collectedValues += m_values.gcYoung(referenceableAddresses);
+		m_gcTelemetry.addPause(GetSec() - beginSec, false);
 	}
 
 	class ValueAccessorSearcher : public boost::static_visitor<bool>
@@ -3525,11 +3712,12 @@ namespace cgl
 
 	std::shared_ptr<Context> Context::cloneContext()
 	{
-		std::shared_ptr<Context> inst = Context::Make();
+		//組み込み関数は共有の表にあり、そのFuncValもm_valuesごとコピーされるので、Make()で登録し直す必要はない
+		std::shared_ptr<Context> inst = std::make_shared<Context>();
 		inst->currentRecords = currentRecords;
 		inst->temporaryRecord = temporaryRecord;
-		inst->m_functions = m_functions;
 		inst->m_plateausFunctions = m_plateausFunctions;
+		inst->m_globalFunctions = m_globalFunctions;
 		inst->m_refAddressMap = m_refAddressMap;
 		inst->m_addressRefMap = m_addressRefMap;
 		inst->m_values = m_values.clone();
@@ -1,5 +1,8 @@
 #pragma warning(disable:4996)
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <exception>
 
 #include <boost/algorithm/string.hpp>
 
@@ -851,7 +854,8 @@ namespace cgl
 }
 
 extern int constraintViolationCount;
-extern bool isInConstraint;
+extern thread_local bool isInConstraint;
+extern bool useParallelConstraintGroups;
 
 namespace cgl
 {
@@ -1102,7 +1106,7 @@ namespace cgl
 			return LRValue(0);
 		}
 
-		const Address address = pEnv->findAddress(node);
+		const Address address = 0 <= node.argumentSlot ? pEnv->findArgumentAddress(node) : pEnv->findAddress(node);
 		if (address.isValid())
 		{
 			return LRValue(address);
@@ -1306,7 +1310,8 @@ namespace cgl
 			12/14
 			引数はスコープをまたぐ時に参照先が変わらないように全てIDで渡すことにする。
 			*/
-			pEnv->bindValueID(funcVal.arguments[i], arguments[i]);
+			//切り替えた直後のスコープには引数しかないので、外側のスコープを探さずに直接束縛する
+			pEnv->makeVariable(funcVal.arguments[i], arguments[i]);
 		}
 
 		CGL_DebugLog("Function Definition:");
@@ -2041,6 +2046,76 @@ namespace cgl
 			return { currentConstraintRegionVars, currentConstraintOptimizeRegions };
 		};
 
+		//独立な制約グループを解く
+		//グループ同士はfree変数を共有しないので、それぞれ複製したContext上で並列に解き、結果は呼び出し側でグループ順に書き戻す
+		const auto solveConstraintGroups = [&](std::vector<OptimizationProblemSat>& problems)->std::vector<std::vector<double>>
+		{
+			std::vector<std::vector<double>> results(problems.size());
+
+			const size_t numOfThreads = std::min<size_t>(problems.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+			//デバッグ出力やHTMLログは出力先を共有しているので逐次的に解く
+			if (numOfThreads <= 1 || !useParallelConstraintGroups || isDebugMode || TreeLogger::instance().isEnable())
+			{
+				for (size_t i = 0; i < problems.size(); ++i)
+				{
+					results[i] = problems[i].solve(pEnv, recordConsractor, record, keyList);
+				}
+				return results;
+			}
+
+			//solve中にrecord(およびrecord.problems)を各スレッドから読むので、書き換えは作業用のコピーに対して行う
+			std::vector<OptimizationProblemSat> groupProblems = problems;
+
+			//Contextの複製は元のContextを読むので、ワーカーを起動する前にこのスレッドで全て作っておく
+			std::vector<std::shared_ptr<Context>> groupEnvs;
+			groupEnvs.reserve(groupProblems.size());
+			for (size_t i = 0; i < groupProblems.size(); ++i)
+			{
+				groupEnvs.push_back(pEnv->cloneContext());
+			}
+
+			std::atomic<size_t> nextProblemID(0);
+			std::vector<std::exception_ptr> errors(problems.size());
+
+			const auto worker = [&]()
+			{
+				for (size_t i = nextProblemID++; i < groupProblems.size(); i = nextProblemID++)
+				{
+					try
+					{
+						results[i] = groupProblems[i].solve(groupEnvs[i], recordConsractor, record, keyList);
+					}
+					catch (...)
+					{
+						errors[i] = std::current_exception();
+					}
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (size_t i = 0; i < numOfThreads; ++i)
+			{
+				workers.emplace_back(worker);
+			}
+			for (auto& thread : workers)
+			{
+				thread.join();
+			}
+
+			for (const auto& error : errors)
+			{
+				if (error)
+				{
+					std::rethrow_exception(error);
+				}
+			}
+
+			problems = std::move(groupProblems);
+
+			return results;
+		};
+
 		auto& original = record.original;
 		
 		//TODO: record.constraintには継承時のoriginalが持つ制約は含まれていないものとする
@@ -2326,11 +2401,19 @@ namespace cgl
 
 						std::cout << "Current constraint freeVariablesSize: " << std::to_string(currentProblem.freeVariableRefs.size()) << std::endl;
 						std::cout << "2 mergedRegionVars.size(): " << mergedRegionVars.size() << "\n";
-						std::vector<double> resultxs = currentProblem.solve(pEnv, recordConsractor, record, keyList);
+					}
+
+					const auto results = solveConstraintGroups(record.problems);
 
-						readResult(pEnv, resultxs, currentProblem);
+					for (size_t constraintGroupID = 0; constraintGroupID < record.problems.size(); ++constraintGroupID)
+					{
+						auto& currentProblem = record.problems[constraintGroupID];
+
+						readResult(pEnv, results[constraintGroupID], currentProblem);
 
 						const bool currentConstraintIsSatisfied = checkSatisfied(pEnv, currentProblem);
+						currentProblem.telemetry.isSatisfied = currentConstraintIsSatisfied;
+						pEnv->addSolverTelemetry(currentProblem.telemetry);
 						record.isSatisfied = record.isSatisfied && currentConstraintIsSatisfied;
 						if (!currentConstraintIsSatisfied)
 						{
@@ -2388,6 +2471,8 @@ namespace cgl
 							readResult(pEnv, resultxs, oldConstraint);
 
 							const bool currentConstraintIsSatisfied = checkSatisfied(pEnv, oldConstraint);
+							oldConstraint.telemetry.isSatisfied = currentConstraintIsSatisfied;
+							pEnv->addSolverTelemetry(oldConstraint.telemetry);
 							record.isSatisfied = record.isSatisfied && currentConstraintIsSatisfied;
 							if (!currentConstraintIsSatisfied)
 							{
@@ -2451,12 +2536,19 @@ namespace cgl
 
 						currentProblem.freeVariableRefs = maskedVars.first;
 						currentProblem.optimizeRegions = maskedVars.second;
+					}
 
-						std::vector<double> resultxs = currentProblem.solve(pEnv, recordConsractor, record, keyList);
+					const auto results = solveConstraintGroups(record.problems);
 
-						readResult(pEnv, resultxs, currentProblem);
+					for (size_t constraintGroupID = 0; constraintGroupID < record.problems.size(); ++constraintGroupID)
+					{
+						auto& currentProblem = record.problems[constraintGroupID];
+
+						readResult(pEnv, results[constraintGroupID], currentProblem);
 
 						const bool currentConstraintIsSatisfied = checkSatisfied(pEnv, currentProblem);
+						currentProblem.telemetry.isSatisfied = currentConstraintIsSatisfied;
+						pEnv->addSolverTelemetry(currentProblem.telemetry);
 						record.isSatisfied = record.isSatisfied && currentConstraintIsSatisfied;
 						if (!currentConstraintIsSatisfied)
 						{
@@ -2477,6 +2569,9 @@ namespace cgl
 			scopeLog.write("Constraints Solved");
 		}
 		
+		//キーはソース上の順に並んでいるので、まとめてソートしてからレコードのメンバ表に併合する
+		std::vector<std::pair<std::string, Address>> keyValues;
+		keyValues.reserve(keyList.size());
 		for (const auto& key : keyList)
 		{
 			//record.append(key.name, pEnv->dereference(key));
@@ -2488,8 +2583,9 @@ namespace cgl
 			record.append(key, pEnv->makeTemporaryValue(opt.get()));*/
 
 			Address address = pEnv->findAddress(key);
-			record.append(key, address);
+			keyValues.emplace_back(key.name, address);
 		}
+		record.values.insertOrAssign(std::move(keyValues));
 
 		pEnv->printContext();
 
@@ -2504,7 +2600,8 @@ namespace cgl
 
 		{
 			scopeLog.write("RecordConstractor result: ");
-			for (const auto& keyval : record.values)
+			const auto& values = record.values;
+			for (const auto& keyval : values)
 			{
 				scopeLog.write("    " + keyval.first + ": " + exprStr2(LRValue(keyval.second), pEnv));
 			}
@@ -2522,12 +2619,55 @@ namespace cgl
 		return LRValue(address);
 	}
 
+	namespace
+	{
+		//継承式の中にvar宣言か参照演算子があるかを調べる（関数定義の中は呼ばれるまで評価されないので見ない）
+		//これらはクローンのメンバのアドレスをsolverや参照に渡すので、その時はクローンの値を元のレコードと共有しない
+		class MemberAddressUseFinder : public ExprTransformer
+		{
+		public:
+			bool found = false;
+
+			Expr operator()(const LRValue& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Identifier& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Import& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const UnaryExpr& node)override
+			{
+				found = found || node.op == UnaryOp::Dynamic;
+				return ExprTransformer::operator()(node);
+			}
+			Expr operator()(const BinaryExpr& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Range& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Lines& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const DefFunc& node)override { return node; }
+			Expr operator()(const If& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const For& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Return& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const ListConstractor& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const KeyExpr& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const RecordConstractor& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const Accessor& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const DeclSat& node)override { return ExprTransformer::operator()(node); }
+			Expr operator()(const DeclFree& node)override
+			{
+				found = true;
+				return node;
+			}
+		};
+	}
+
 	LRValue Eval::inheritRecord(const LocationInfo& info, const Record& original, const RecordConstractor& adder)
 	{
 		auto scopeLog = ScopeLog("Eval::inheritRecord(const LocationInfo& info, const Record& original, const RecordConstractor& adder)");
 
 		//(1)オリジナルのレコードaのクローン(a')を作る
-		Record clone = As<Record>(Clone(pEnv, original, info));
+		//クローンは制約を持たないメンバの数値などを元のレコードと共有するので、継承式がメンバのアドレスを使う時だけ全て複製する
+		MemberAddressUseFinder finder;
+		{
+			const Expr adderExpr = adder;
+			boost::apply_visitor(finder, adderExpr);
+		}
+		Record clone = As<Record>(Clone(pEnv, original, info, !finder.found));
 
 		CGL_DebugLog("Clone:");
 		printVal(clone, pEnv);
@@ -2538,14 +2678,9 @@ namespace cgl
 		}
 		pEnv->temporaryRecord = clone;
 
-		//(2) a'の各キーと値に対する参照をローカルスコープに追加する
-		pEnv->enterScope();
-		for (auto& keyval : clone.values)
-		{
-			pEnv->makeVariable(keyval.first, keyval.second);
-
-			CGL_DebugLog(std::string("Bind ") + keyval.first + " -> " + "Address(" + keyval.second.toString() + ")");
-		}
+		//(2) a'の各キーと値に対する参照をローカルスコープから見えるようにする
+		//メンバ表はクローンと共有し、継承式の中で書き換えられる名前だけがローカルスコープの変数表に入る
+		pEnv->enterScope(clone.values);
 
 		//(3) 追加するレコードの中身を評価する
 		Expr expr = adder;
@@ -2554,15 +2689,18 @@ namespace cgl
 		//(4) ローカルスコープの参照値を読みレコードに上書きする
 		//レコード中のコロン式はレコードの最後でkeylistを見て値が紐づけられるので問題ないが
 		//レコード中の代入式については、そのローカル環境の更新を手動でレコードに反映する必要がある
+		//書き換えられた可能性があるのは変数表に入った名前だけなので、それだけを見る
 		if (auto opt = AsOpt<Record>(recordValue))
 		{
 			Record& newRecord = opt.get();
-			for (const auto& keyval : clone.values)
+			const auto& cloneMembers = clone.values;
+			for (const auto& keyval : pEnv->currentScopeVariables())
 			{
-				const Address newAddress = pEnv->findAddress(keyval.first);
-				if (newAddress.isValid() && newAddress != keyval.second)
+				const auto it = cloneMembers.find(keyval.first);
+				const Address newAddress = keyval.second;
+				if (it != cloneMembers.end() && newAddress.isValid() && newAddress != it->second)
 				{
-					CGL_DebugLog(std::string("Updated ") + keyval.first + ": " + "Address(" + keyval.second.toString() + ") -> Address(" + newAddress.toString() + ")");
+					CGL_DebugLog(std::string("Updated ") + keyval.first + ": " + "Address(" + it->second.toString() + ") -> Address(" + newAddress.toString() + ")");
 					newRecord.values[keyval.first] = newAddress;
 				}
 			}
@@ -2851,7 +2989,8 @@ namespace cgl
 					{
 						while (static_cast<int>(list.data.size()) - 1 < indexValue)
 						{
-							list.data.push_back(pEnv->makeTemporaryValue(0));
+							const Address newAddress = pEnv->makeTemporaryValue(0);
+							list.data.push_back(newAddress);
 						}
 						address = list.get(indexValue);
 					}
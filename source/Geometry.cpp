@@ -369,6 +369,121 @@ namespace cgl
 		std::cout << ")\n";
 	}
 
+	bool GeometryCoordinates::assign(const Geometries& geometries)
+	{
+		m_shapes.clear();
+
+		const auto readRing = [](const gg::LineString* lineString)
+		{
+			Vector<Eigen::Vector2d> points(lineString->getNumPoints());
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				const gg::Coordinate& coord = lineString->getCoordinateN(i);
+				points[i] = EigenVec2(coord.x, coord.y);
+			}
+			return points;
+		};
+
+		for (size_t i = 0; i < geometries.size(); ++i)
+		{
+			const gg::Geometry* pGeometry = geometries.refer(i);
+
+			Shape shape;
+			switch (pGeometry->getGeometryTypeId())
+			{
+			case gg::GEOS_POINT:
+			{
+				if (pGeometry->isEmpty())
+				{
+					m_shapes.clear();
+					return false;
+				}
+				const gg::Point* point = dynamic_cast<const gg::Point*>(pGeometry);
+				shape.type = ShapeType::Point;
+				shape.rings.emplace_back(1, EigenVec2(point->getX(), point->getY()));
+				break;
+			}
+			case gg::GEOS_LINESTRING:
+				shape.type = ShapeType::LineString;
+				shape.rings.push_back(readRing(dynamic_cast<const gg::LineString*>(pGeometry)));
+				break;
+			case gg::GEOS_LINEARRING:
+				shape.type = ShapeType::LinearRing;
+				shape.rings.push_back(readRing(dynamic_cast<const gg::LineString*>(pGeometry)));
+				break;
+			case gg::GEOS_POLYGON:
+			{
+				const gg::Polygon* polygon = dynamic_cast<const gg::Polygon*>(pGeometry);
+				shape.type = ShapeType::Polygon;
+				shape.rings.push_back(readRing(polygon->getExteriorRing()));
+				for (size_t h = 0; h < polygon->getNumInteriorRing(); ++h)
+				{
+					shape.rings.push_back(readRing(polygon->getInteriorRingN(h)));
+				}
+				break;
+			}
+			default:
+				m_shapes.clear();
+				return false;
+			}
+
+			m_shapes.push_back(std::move(shape));
+		}
+
+		return true;
+	}
+
+	Geometries GeometryCoordinates::build(const TransformPacked& transform)const
+	{
+		//ファクトリはこの呼び出しで作ったジオメトリの間でだけ共有される
+		auto factory = gg::GeometryFactory::create();
+
+		const auto makeSequence = [&](const Vector<Eigen::Vector2d>& points)
+		{
+			gg::CoordinateArraySequence pts;
+			for (const auto& point : points)
+			{
+				const auto pos = transform.product(point);
+				pts.add(gg::Coordinate(pos.x(), pos.y()));
+			}
+			return pts;
+		};
+
+		Geometries result;
+		for (const auto& shape : m_shapes)
+		{
+			switch (shape.type)
+			{
+			case ShapeType::Point:
+			{
+				const auto pos = transform.product(shape.rings.front().front());
+				result.push_back_raw(factory->createPoint(gg::Coordinate(pos.x(), pos.y())));
+				break;
+			}
+			case ShapeType::LineString:
+				result.push_back_raw(factory->createLineString(makeSequence(shape.rings.front())));
+				break;
+			case ShapeType::LinearRing:
+				result.push_back_raw(factory->createLinearRing(makeSequence(shape.rings.front())));
+				break;
+			case ShapeType::Polygon:
+			{
+				Geometries holes;
+				for (size_t h = 1; h < shape.rings.size(); ++h)
+				{
+					holes.push_back_raw(factory->createLinearRing(makeSequence(shape.rings[h])));
+				}
+				auto holePtrs = holes.releaseAsRawPtrs();
+
+				result.push_back_raw(factory->createPolygon(factory->createLinearRing(makeSequence(shape.rings.front())), &holePtrs));
+				break;
+			}
+			}
+		}
+
+		return result;
+	}
+
 	GeometryPtr MakeLine(const Eigen::Vector2d& p0, const Eigen::Vector2d& p1)
 	{
 		gg::CoordinateArraySequence pts;
@@ -1,3 +1,7 @@
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+
 #include <cppoptlib/meta.h>
 #include <cppoptlib/problem.h>
 #include <cppoptlib/solver/bfgssolver.h>
@@ -6,6 +10,9 @@
 #include <geos/opBuffer.h>
 #include <geos/opDistance.h>
 #include <geos/operation/union/CascadedUnion.h>
+#include <geos/geom/prep/PreparedGeometry.h>
+#include <geos/geom/prep/PreparedGeometryFactory.h>
+#include <geos/index/strtree/STRtree.h>
 
 #include <cmaes.h>
 
@@ -18,6 +25,8 @@
 #include <Pita/Evaluator.hpp>
 #include <Pita/Parser.hpp>
 
+extern bool useConvexFastPath;
+
 namespace
 {
 	inline double Combination(int n, int k)
@@ -377,7 +386,7 @@ namespace cgl
 		}
 	};
 
-	PackedList GetPolygon(const Geometries& originalPolygons)
+	PackedVal GetPolygon(const Geometries& originalPolygons)
 	{
 		try
 		{
@@ -408,7 +417,7 @@ namespace cgl
 			throw;
 		}
 
-		std::vector<PackedList> polygons;
+		PackedPolyData polygons;
 		try
 		{
 			for (size_t i = 0; i < originalPolygons.size(); ++i)
@@ -448,7 +457,7 @@ namespace cgl
 		}
 	}
 
-	PackedList GetPolygon(const PackedRecord& shape, std::shared_ptr<Context> pContext)
+	PackedVal GetPolygon(const PackedRecord& shape, std::shared_ptr<Context> pContext)
 	{
 		return GetPolygon(GeosFromRecordPacked(shape, pContext));
 	}
@@ -781,21 +790,272 @@ namespace cgl
 		}
 	}
 
-	double ShapeNear(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext)
+	//凸多角形同士の距離・交差面積をGEOSを経由せずに頂点列から直接求める
+	//穴を持つ多角形や凹多角形はReadConvexPolygonがfalseを返すので、呼び出し側でGEOSにフォールバックする
+	struct ConvexPolygon
 	{
-		if ((!IsType<PackedRecord>(lhs) && !IsType<PackedList>(lhs)) || (!IsType<PackedRecord>(rhs) && !IsType<PackedList>(rhs)))
+		//反時計回りに並んだ頂点座標 x0, y0, x1, y1, ...（終点の重複は含まない）
+		std::vector<double> coords;
+
+		size_t size()const
 		{
-			CGL_Error("不正な式です");
+			return coords.size() / 2;
 		}
 
-		Geometries lhsPolygon(GeosFromRecordPacked(lhs, pContext));
-		Geometries rhsPolygon(GeosFromRecordPacked(rhs, pContext));
+		double x(size_t i)const
+		{
+			return coords[2 * i + 0];
+		}
+
+		double y(size_t i)const
+		{
+			return coords[2 * i + 1];
+		}
+	};
+
+	bool ReadConvexPolygon(const gg::Geometry* geometry, ConvexPolygon& result)
+	{
+		if (geometry->getGeometryTypeId() != gg::GEOS_POLYGON)
+		{
+			return false;
+		}
+
+		const gg::Polygon* polygon = dynamic_cast<const gg::Polygon*>(geometry);
+		if (polygon->getNumInteriorRing() != 0)
+		{
+			return false;
+		}
+
+		const gg::CoordinateSequence* cs = polygon->getExteriorRing()->getCoordinatesRO();
+		const size_t numPoints = cs->getSize();
+		if (numPoints < 4)
+		{
+			return false;
+		}
+
+		auto& coords = result.coords;
+		coords.clear();
+		coords.reserve(2 * (numPoints - 1));
+		for (size_t i = 0; i + 1 < numPoints; ++i)
+		{
+			const gg::Coordinate& p = cs->getAt(i);
+			if (!coords.empty() && coords[coords.size() - 2] == p.x && coords.back() == p.y)
+			{
+				continue;
+			}
+			coords.push_back(p.x);
+			coords.push_back(p.y);
+		}
+
+		const size_t n = result.size();
+		if (n < 3)
+		{
+			return false;
+		}
+
+		double signedArea2 = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t j = (i + 1) % n;
+			signedArea2 += result.x(i)*result.y(j) - result.x(j)*result.y(i);
+		}
+		if (signedArea2 == 0)
+		{
+			return false;
+		}
 
+		//時計回りなら反時計回りに並べ替える
+		if (signedArea2 < 0)
+		{
+			for (size_t i = 0, j = n - 1; i < j; ++i, --j)
+			{
+				std::swap(coords[2 * i + 0], coords[2 * j + 0]);
+				std::swap(coords[2 * i + 1], coords[2 * j + 1]);
+			}
+		}
+
+		//全ての角が左折（または直進）で、かつ辺のx方向の符号の反転が2回以下なら単純な凸多角形
+		int xSignChanges = 0;
+		int prevXSign = 0;
+		int firstXSign = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t j = (i + 1) % n;
+			const size_t k = (i + 2) % n;
+			const double ex1 = result.x(j) - result.x(i), ey1 = result.y(j) - result.y(i);
+			const double ex2 = result.x(k) - result.x(j), ey2 = result.y(k) - result.y(j);
+
+			const double cross = ex1 * ey2 - ey1 * ex2;
+			const double tolerance = 1.e-9*std::sqrt((ex1*ex1 + ey1 * ey1)*(ex2*ex2 + ey2 * ey2));
+			if (cross < -tolerance)
+			{
+				return false;
+			}
+
+			const int xSign = (0 < ex1) - (ex1 < 0);
+			if (xSign != 0)
+			{
+				if (prevXSign == 0)
+				{
+					firstXSign = xSign;
+				}
+				else if (xSign != prevXSign)
+				{
+					++xSignChanges;
+				}
+				prevXSign = xSign;
+			}
+		}
+		if (prevXSign != firstXSign)
+		{
+			++xSignChanges;
+		}
+
+		return xSignChanges <= 2;
+	}
+
+	//polygonの各辺の外向き法線を分離軸として、otherの全頂点がその外側にあればtrue
+	bool HasSeparatingEdge(const ConvexPolygon& polygon, const ConvexPolygon& other)
+	{
+		const size_t n = polygon.size();
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t j = (i + 1) % n;
+			const double nx = polygon.y(j) - polygon.y(i);
+			const double ny = polygon.x(i) - polygon.x(j);
+
+			bool separated = true;
+			for (size_t k = 0; k < other.size(); ++k)
+			{
+				if ((other.x(k) - polygon.x(i))*nx + (other.y(k) - polygon.y(i))*ny <= 0)
+				{
+					separated = false;
+					break;
+				}
+			}
+
+			if (separated)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//閉領域として共通部分を持たなければtrue
+	bool ConvexDisjoint(const ConvexPolygon& lhs, const ConvexPolygon& rhs)
+	{
+		return HasSeparatingEdge(lhs, rhs) || HasSeparatingEdge(rhs, lhs);
+	}
+
+	double PointSegmentDistanceSq(double px, double py, double x0, double y0, double x1, double y1)
+	{
+		const double dx = x1 - x0, dy = y1 - y0;
+		const double lengthSq = dx * dx + dy * dy;
+		double t = lengthSq == 0 ? 0 : ((px - x0)*dx + (py - y0)*dy) / lengthSq;
+		t = std::max(0.0, std::min(1.0, t));
+		const double rx = px - (x0 + dx * t), ry = py - (y0 + dy * t);
+		return rx * rx + ry * ry;
+	}
+
+	//交差しない凸多角形同士の距離（最近点対は必ず一方の頂点ともう一方の辺の組になる）
+	double ConvexDistance(const ConvexPolygon& lhs, const ConvexPolygon& rhs)
+	{
+		if (!ConvexDisjoint(lhs, rhs))
+		{
+			return 0.0;
+		}
+
+		const auto vertexToEdges = [](const ConvexPolygon& vertices, const ConvexPolygon& edges, double currentMinSq)
+		{
+			const size_t n = edges.size();
+			for (size_t k = 0; k < vertices.size(); ++k)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					const size_t j = (i + 1) % n;
+					currentMinSq = std::min(currentMinSq, PointSegmentDistanceSq(vertices.x(k), vertices.y(k), edges.x(i), edges.y(i), edges.x(j), edges.y(j)));
+				}
+			}
+			return currentMinSq;
+		};
+
+		double minDistanceSq = DBL_MAX;
+		minDistanceSq = vertexToEdges(lhs, rhs, minDistanceSq);
+		minDistanceSq = vertexToEdges(rhs, lhs, minDistanceSq);
+		return std::sqrt(minDistanceSq);
+	}
+
+	//Sutherland-Hodgman法でsubjectをclipの内側に切り取った凸多角形の面積
+	double ConvexIntersectionArea(const ConvexPolygon& subject, const ConvexPolygon& clip)
+	{
+		std::vector<double> current(subject.coords);
+		std::vector<double> next;
+		next.reserve(current.size() + 2 * clip.size());
+
+		const size_t clipSize = clip.size();
+		for (size_t i = 0; i < clipSize && !current.empty(); ++i)
+		{
+			const size_t j = (i + 1) % clipSize;
+			const double ax = clip.x(i), ay = clip.y(i);
+			const double ex = clip.x(j) - ax, ey = clip.y(j) - ay;
+
+			const auto side = [&](double px, double py)
+			{
+				return ex * (py - ay) - ey * (px - ax);
+			};
+
+			next.clear();
+			const size_t n = current.size() / 2;
+			for (size_t k = 0; k < n; ++k)
+			{
+				const size_t l = (k + 1) % n;
+				const double px = current[2 * k], py = current[2 * k + 1];
+				const double qx = current[2 * l], qy = current[2 * l + 1];
+				const double sp = side(px, py);
+				const double sq = side(qx, qy);
+
+				if (0 <= sp)
+				{
+					next.push_back(px);
+					next.push_back(py);
+				}
+				if ((0 <= sp) != (0 <= sq))
+				{
+					const double t = sp / (sp - sq);
+					next.push_back(px + (qx - px)*t);
+					next.push_back(py + (qy - py)*t);
+				}
+			}
+
+			std::swap(current, next);
+		}
+
+		double area2 = 0;
+		const size_t n = current.size() / 2;
+		for (size_t k = 0; k < n; ++k)
+		{
+			const size_t l = (k + 1) % n;
+			area2 += current[2 * k] * current[2 * l + 1] - current[2 * l] * current[2 * k + 1];
+		}
+
+		return std::abs(area2)*0.5;
+	}
+
+	double GeometryNear(const gg::Geometry* lhs, const gg::Geometry* rhs)
+	{
 		const double margin = 5.0;
 
-		if (lhsPolygon.size() != 1 || rhsPolygon.size() != 1)
+		ConvexPolygon lhsConvex, rhsConvex;
+		if (useConvexFastPath && ReadConvexPolygon(lhs, lhsConvex) && ReadConvexPolygon(rhs, rhsConvex))
 		{
-			CGL_Error("未対応の形状です");
+			//交差している場合はGEOSの結果（交差部分の長さ・エラー）に合わせるためフォールバックする
+			const double distance = ConvexDistance(lhsConvex, rhsConvex);
+			if (0.0 < distance)
+			{
+				return std::max(distance - margin, 0.0);
+			}
 		}
 
 		const auto toEigen = [](const gg::Coordinate& p)
@@ -1032,11 +1292,11 @@ namespace cgl
 			{}
 		};
 
-		const GeoType type1 = getGeoType(lhsPolygon.refer(0));
-		const GeoType type2 = getGeoType(rhsPolygon.refer(0));
+		const GeoType type1 = getGeoType(lhs);
+		const GeoType type2 = getGeoType(rhs);
 
-		const TypeGeometry smallerTypePoly = (type1 <= type2 ? TypeGeometry(type1, lhsPolygon.refer(0)) : TypeGeometry(type2, rhsPolygon.refer(0)));
-		const TypeGeometry largerTypePoly = (type1 <= type2 ? TypeGeometry(type2, rhsPolygon.refer(0)) : TypeGeometry(type1, lhsPolygon.refer(0)));
+		const TypeGeometry smallerTypePoly = (type1 <= type2 ? TypeGeometry(type1, lhs) : TypeGeometry(type2, rhs));
+		const TypeGeometry largerTypePoly = (type1 <= type2 ? TypeGeometry(type2, rhs) : TypeGeometry(type1, lhs));
 
 		try
 		{
@@ -1075,7 +1335,7 @@ namespace cgl
 		}
 	}
 
-	double ShapeAvoid(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext)
+	double ShapeNear(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext)
 	{
 		if ((!IsType<PackedRecord>(lhs) && !IsType<PackedList>(lhs)) || (!IsType<PackedRecord>(rhs) && !IsType<PackedList>(rhs)))
 		{
@@ -1090,6 +1350,27 @@ namespace cgl
 			CGL_Error("未対応の形状です");
 		}
 
+		return GeometryNear(lhsPolygon.refer(0), rhsPolygon.refer(0));
+	}
+
+	double GeometryAvoid(const gg::Geometry* lhs, const gg::Geometry* rhs)
+	{
+		ConvexPolygon lhsConvex, rhsConvex;
+		if (useConvexFastPath && ReadConvexPolygon(lhs, lhsConvex) && ReadConvexPolygon(rhs, rhsConvex))
+		{
+			if (ConvexDisjoint(lhsConvex, rhsConvex))
+			{
+				return 0.0;
+			}
+
+			//辺で接しているだけの場合はGEOSの結果（線分）に合わせるためフォールバックする
+			const double area = ConvexIntersectionArea(lhsConvex, rhsConvex);
+			if (0.0 < area)
+			{
+				return area;
+			}
+		}
+
 		const auto toEigen = [](const gg::Coordinate& p)
 		{
 			return EigenVec2(p.x, p.y);
@@ -1327,11 +1608,11 @@ namespace cgl
 			{}
 		};
 
-		const GeoType type1 = getGeoType(lhsPolygon.refer(0));
-		const GeoType type2 = getGeoType(rhsPolygon.refer(0));
+		const GeoType type1 = getGeoType(lhs);
+		const GeoType type2 = getGeoType(rhs);
 
-		const TypeGeometry smallerTypePoly = (type1 <= type2 ? TypeGeometry(type1, lhsPolygon.refer(0)) : TypeGeometry(type2, rhsPolygon.refer(0)));
-		const TypeGeometry largerTypePoly = (type1 <= type2 ? TypeGeometry(type2, rhsPolygon.refer(0)) : TypeGeometry(type1, lhsPolygon.refer(0)));
+		const TypeGeometry smallerTypePoly = (type1 <= type2 ? TypeGeometry(type1, lhs) : TypeGeometry(type2, rhs));
+		const TypeGeometry largerTypePoly = (type1 <= type2 ? TypeGeometry(type2, rhs) : TypeGeometry(type1, lhs));
 
 		try
 		{
@@ -1370,6 +1651,194 @@ namespace cgl
 		}
 	}
 
+	double ShapeAvoid(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext)
+	{
+		if ((!IsType<PackedRecord>(lhs) && !IsType<PackedList>(lhs)) || (!IsType<PackedRecord>(rhs) && !IsType<PackedList>(rhs)))
+		{
+			CGL_Error("不正な式です");
+		}
+
+		Geometries lhsPolygon(GeosFromRecordPacked(lhs, pContext));
+		Geometries rhsPolygon(GeosFromRecordPacked(rhs, pContext));
+
+		if (lhsPolygon.size() != 1 || rhsPolygon.size() != 1)
+		{
+			CGL_Error("未対応の形状です");
+		}
+
+		return GeometryAvoid(lhsPolygon.refer(0), rhsPolygon.refer(0));
+	}
+
+	struct BroadPhaseShape
+	{
+		Geometries geometries;
+		BoundingRect rect;
+		bool isPolygon = false;
+	};
+
+	std::vector<BroadPhaseShape> ReadBroadPhaseShapes(const PackedList& shapes, std::shared_ptr<Context> pContext)
+	{
+		std::vector<BroadPhaseShape> result(shapes.data.size());
+
+		for (size_t i = 0; i < shapes.data.size(); ++i)
+		{
+			const PackedVal& shape = shapes.data[i].value;
+			if (!IsType<PackedRecord>(shape) && !IsType<PackedList>(shape))
+			{
+				CGL_Error("不正な式です");
+			}
+
+			auto& current = result[i];
+			current.geometries = GeosFromRecordPacked(shape, pContext);
+			if (current.geometries.size() != 1)
+			{
+				CGL_Error("未対応の形状です");
+			}
+
+			const gg::Geometry* pGeometry = current.geometries.refer(0);
+			const gg::Envelope* pEnvelope = pGeometry->getEnvelopeInternal();
+			current.rect = BoundingRect(pEnvelope->getMinX(), pEnvelope->getMinY(), pEnvelope->getMaxX(), pEnvelope->getMaxY());
+			current.isPolygon = pGeometry->getGeometryTypeId() == gg::GEOS_POLYGON;
+		}
+
+		return result;
+	}
+
+	//外接矩形をx方向にソートして掃引し、矩形同士の距離がmargin以下の組(i < j)を列挙する
+	std::vector<std::pair<size_t, size_t>> BroadPhasePairs(const std::vector<BroadPhaseShape>& shapes, double margin)
+	{
+		std::vector<size_t> order(shapes.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{
+			return shapes[a].rect.minPos().x() < shapes[b].rect.minPos().x();
+		});
+
+		std::vector<std::pair<size_t, size_t>> pairs;
+		for (size_t a = 0; a < order.size(); ++a)
+		{
+			const BoundingRect& rectA = shapes[order[a]].rect;
+			for (size_t b = a + 1; b < order.size(); ++b)
+			{
+				const BoundingRect& rectB = shapes[order[b]].rect;
+				if (rectA.maxPos().x() + margin < rectB.minPos().x())
+				{
+					break;
+				}
+
+				if (rectA.distance(rectB) <= margin)
+				{
+					pairs.emplace_back(std::min(order[a], order[b]), std::max(order[a], order[b]));
+				}
+			}
+		}
+
+		//評価順を入力順に揃える
+		std::sort(pairs.begin(), pairs.end());
+
+		return pairs;
+	}
+
+	//Avoid(shapes[i], shapes[j]) (i < j) の総和
+	double ShapeAvoidAll(const PackedList& shapes, std::shared_ptr<Context> pContext)
+	{
+		const auto broadPhaseShapes = ReadBroadPhaseShapes(shapes, pContext);
+
+		const auto avoidCost = [&](size_t i, size_t j)
+		{
+			return GeometryAvoid(broadPhaseShapes[i].geometries.refer(0), broadPhaseShapes[j].geometries.refer(0));
+		};
+
+		double cost = 0.0;
+
+		//ポリゴン同士のAvoidは交差しなければ0なので、外接矩形が重なる組だけを評価すればよい
+		for (const auto& pair : BroadPhasePairs(broadPhaseShapes, 0.0))
+		{
+			if (broadPhaseShapes[pair.first].isPolygon && broadPhaseShapes[pair.second].isPolygon)
+			{
+				cost += avoidCost(pair.first, pair.second);
+			}
+		}
+
+		//点や線を含む組は離れていてもコストを持つので全て評価する
+		for (size_t i = 0; i < broadPhaseShapes.size(); ++i)
+		{
+			for (size_t j = i + 1; j < broadPhaseShapes.size(); ++j)
+			{
+				if (!broadPhaseShapes[i].isPolygon || !broadPhaseShapes[j].isPolygon)
+				{
+					cost += avoidCost(i, j);
+				}
+			}
+		}
+
+		return cost;
+	}
+
+	//各図形について、最も近い他の図形とのNearのコストの総和
+	double ShapeNearAll(const PackedList& shapes, std::shared_ptr<Context> pContext)
+	{
+		const auto broadPhaseShapes = ReadBroadPhaseShapes(shapes, pContext);
+		if (broadPhaseShapes.size() < 2)
+		{
+			return 0.0;
+		}
+
+		//GeometryNearのmarginと同じ値
+		const double margin = 5.0;
+
+		const auto nearCost = [&](size_t i, size_t j)
+		{
+			return GeometryNear(broadPhaseShapes[std::min(i, j)].geometries.refer(0), broadPhaseShapes[std::max(i, j)].geometries.refer(0));
+		};
+
+		std::vector<double> nearestCosts(broadPhaseShapes.size(), DBL_MAX);
+
+		//外接矩形がmargin以内にある組を先に評価する
+		for (const auto& pair : BroadPhasePairs(broadPhaseShapes, margin))
+		{
+			const double cost = nearCost(pair.first, pair.second);
+			nearestCosts[pair.first] = std::min(nearestCosts[pair.first], cost);
+			nearestCosts[pair.second] = std::min(nearestCosts[pair.second], cost);
+		}
+
+		//コストが0にならなかった図形は、外接矩形の距離から求めたコストの下界が小さい順に探索し、
+		//下界が現在の最小コスト以上になったら打ち切る
+		for (size_t i = 0; i < broadPhaseShapes.size(); ++i)
+		{
+			if (nearestCosts[i] == 0.0)
+			{
+				continue;
+			}
+
+			std::vector<std::pair<double, size_t>> candidates;
+			for (size_t j = 0; j < broadPhaseShapes.size(); ++j)
+			{
+				if (i == j)
+				{
+					continue;
+				}
+
+				//ポリゴン同士のコストは max(距離 - margin, 0) なので外接矩形の距離で下から抑えられる
+				const bool isPolygonPair = broadPhaseShapes[i].isPolygon && broadPhaseShapes[j].isPolygon;
+				const double lowerBound = isPolygonPair ? std::max(broadPhaseShapes[i].rect.distance(broadPhaseShapes[j].rect) - margin, 0.0) : 0.0;
+				candidates.emplace_back(lowerBound, j);
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			for (const auto& candidate : candidates)
+			{
+				if (nearestCosts[i] <= candidate.first)
+				{
+					break;
+				}
+				nearestCosts[i] = std::min(nearestCosts[i], nearCost(i, candidate.second));
+			}
+		}
+
+		return std::accumulate(nearestCosts.begin(), nearestCosts.end(), 0.0);
+	}
+
 	PackedRecord ShapeDiff(const PackedVal& lhs, const PackedVal& rhs, std::shared_ptr<Context> pContext)
 	{
 		if ((!IsType<PackedRecord>(lhs) && !IsType<PackedList>(lhs)) || (!IsType<PackedRecord>(rhs) && !IsType<PackedList>(rhs)))
@@ -1721,6 +2190,15 @@ namespace cgl
 		Geometries lhsPolygon(GeosFromRecordPacked(lhs, pContext));
 		Geometries rhsPolygon(GeosFromRecordPacked(rhs, pContext));
 
+		if (useConvexFastPath && lhsPolygon.size() == 1 && rhsPolygon.size() == 1)
+		{
+			ConvexPolygon lhsConvex, rhsConvex;
+			if (ReadConvexPolygon(lhsPolygon.refer(0), lhsConvex) && ReadConvexPolygon(rhsPolygon.refer(0), rhsConvex))
+			{
+				return ConvexDistance(lhsConvex, rhsConvex);
+			}
+		}
+
 		std::vector<gg::Geometry*> lhsPtrs = lhsPolygon.releaseAsRawPtrs();
 		geos::operation::geounion::CascadedUnion unionCalcLhs(&lhsPtrs);
 		auto lhsResult = ToUnique<GeometryDeleter>(unionCalcLhs.Union());
@@ -1805,12 +2283,244 @@ namespace cgl
 		CGL_Error("TODO:未対応");
 	}
 
-	PackedRecord BuildPath(const PackedList& passes, std::shared_ptr<Context> pContext, int numOfPoints, const PackedList& obstacleList)
+	//BuildPathの障害物は最適化中に変化しないので、R木に入れておき
+	//候補となる経路のエンベロープと重なる障害物だけを調べる
+	//多角形の障害物は頂点列を持っておき、線分が内部を通る長さをGEOSを経由せずに求める
+	class ObstacleIndex
 	{
-		auto factory = gg::GeometryFactory::create();
+	public:
+		//評価スレッドごとの作業領域（世代をまたいで使い回すので評価中の確保は起きない）
+		struct Scratch
+		{
+			std::vector<void*> candidates;
+			std::vector<double> ts;
+		};
+
+		ObstacleIndex(const Geometries& obstacles) :
+			m_tree(10)
+		{
+			m_obstacles.reserve(obstacles.size());
+			for (size_t i = 0; i < obstacles.size(); ++i)
+			{
+				const gg::Geometry* geometry = obstacles.refer(i);
+				m_obstacles.emplace_back(geometry, std::unique_ptr<const gg::prep::PreparedGeometry>(gg::prep::PreparedGeometryFactory::prepare(geometry)));
+
+				if (geometry->getGeometryTypeId() == gg::GEOS_POLYGON)
+				{
+					const gg::Polygon* polygon = dynamic_cast<const gg::Polygon*>(geometry);
+					auto& obstacle = m_obstacles.back();
+					obstacle.isPolygon = true;
+					obstacle.addRing(polygon->getExteriorRing());
+					for (size_t r = 0; r < polygon->getNumInteriorRing(); ++r)
+					{
+						obstacle.addRing(polygon->getInteriorRingN(r));
+					}
+				}
+			}
+
+			//STRtreeは最初の問い合わせで構築されるので、ここで構築を済ませておく（以降の問い合わせは読み取りのみ）
+			for (auto& obstacle : m_obstacles)
+			{
+				m_tree.insert(obstacle.geometry->getEnvelopeInternal(), &obstacle);
+			}
+			std::vector<void*> dummy;
+			gg::Envelope emptyEnvelope;
+			m_tree.query(&emptyEnvelope, dummy);
+		}
+
+		bool empty()const
+		{
+			return m_obstacles.empty();
+		}
+
+		//coords = x0, y0, x1, y1, ... の折れ線が障害物の内部を通る長さの合計
+		//多角形以外の障害物はGEOSで交差を求め、失敗した場合は折れ線の長さを加える
+		double intersectionLength(const std::vector<double>& coords, double pathLength, Scratch& scratch)
+		{
+			const size_t numPoints = coords.size() / 2;
+
+			double minX = DBL_MAX, minY = DBL_MAX, maxX = -DBL_MAX, maxY = -DBL_MAX;
+			for (size_t i = 0; i < numPoints; ++i)
+			{
+				minX = std::min(minX, coords[2 * i]);
+				maxX = std::max(maxX, coords[2 * i]);
+				minY = std::min(minY, coords[2 * i + 1]);
+				maxY = std::max(maxY, coords[2 * i + 1]);
+			}
+
+			const gg::Envelope pathEnvelope(minX, maxX, minY, maxY);
+			scratch.candidates.clear();
+			m_tree.query(&pathEnvelope, scratch.candidates);
+
+			double totalLength = 0;
+			for (void* candidate : scratch.candidates)
+			{
+				const Obstacle& obstacle = *static_cast<const Obstacle*>(candidate);
+				if (obstacle.isPolygon)
+				{
+					for (size_t i = 0; i + 1 < numPoints; ++i)
+					{
+						totalLength += obstacle.insideLength(coords[2 * i], coords[2 * i + 1], coords[2 * i + 2], coords[2 * i + 3], scratch.ts);
+					}
+				}
+				else
+				{
+					totalLength += geometryIntersectionLength(obstacle, coords, pathLength);
+				}
+			}
+
+			return totalLength;
+		}
+
+	private:
+		struct Obstacle
+		{
+			Obstacle(const gg::Geometry* geometry, std::unique_ptr<const gg::prep::PreparedGeometry> prepared) :
+				geometry(geometry),
+				prepared(std::move(prepared))
+			{}
+
+			void addRing(const gg::LineString* ring)
+			{
+				const gg::CoordinateSequence* cs = ring->getCoordinatesRO();
+				for (size_t i = 0; i < cs->getSize(); ++i)
+				{
+					ringCoords.push_back(cs->getAt(i).x);
+					ringCoords.push_back(cs->getAt(i).y);
+				}
+				ringEnds.push_back(ringCoords.size() / 2);
+			}
 
-		//std::vector<gg::Coordinate> originalPoints;
-		Geometries originalPoints;
+			//偶奇規則による内外判定（穴も含めて全てのリングの辺との交差を数える）
+			bool contains(double px, double py)const
+			{
+				bool inside = false;
+				size_t begin = 0;
+				for (size_t end : ringEnds)
+				{
+					for (size_t i = begin; i + 1 < end; ++i)
+					{
+						const double ax = ringCoords[2 * i], ay = ringCoords[2 * i + 1];
+						const double bx = ringCoords[2 * i + 2], by = ringCoords[2 * i + 3];
+						if ((py < ay) != (py < by) && px < ax + (py - ay)*(bx - ax) / (by - ay))
+						{
+							inside = !inside;
+						}
+					}
+					begin = end;
+				}
+				return inside;
+			}
+
+			//線分(x0, y0)-(x1, y1)を全てのリングの辺で分割し、内部にある区間の長さを足し合わせる
+			double insideLength(double x0, double y0, double x1, double y1, std::vector<double>& ts)const
+			{
+				const gg::Envelope& envelope = *geometry->getEnvelopeInternal();
+				if (std::max(x0, x1) < envelope.getMinX() || envelope.getMaxX() < std::min(x0, x1) ||
+					std::max(y0, y1) < envelope.getMinY() || envelope.getMaxY() < std::min(y0, y1))
+				{
+					return 0.0;
+				}
+
+				const double dx = x1 - x0, dy = y1 - y0;
+
+				ts.clear();
+				ts.push_back(0.0);
+				ts.push_back(1.0);
+
+				size_t begin = 0;
+				for (size_t end : ringEnds)
+				{
+					for (size_t i = begin; i + 1 < end; ++i)
+					{
+						const double ax = ringCoords[2 * i], ay = ringCoords[2 * i + 1];
+						const double ex = ringCoords[2 * i + 2] - ax, ey = ringCoords[2 * i + 3] - ay;
+
+						const double denom = dx * ey - dy * ex;
+						if (denom == 0)
+						{
+							continue;
+						}
+
+						const double t = ((ax - x0)*ey - (ay - y0)*ex) / denom;
+						const double u = ((ax - x0)*dy - (ay - y0)*dx) / denom;
+						if (0.0 < t && t < 1.0 && 0.0 <= u && u <= 1.0)
+						{
+							ts.push_back(t);
+						}
+					}
+					begin = end;
+				}
+
+				std::sort(ts.begin(), ts.end());
+
+				double insideT = 0;
+				for (size_t i = 0; i + 1 < ts.size(); ++i)
+				{
+					const double tMid = (ts[i] + ts[i + 1])*0.5;
+					if (ts[i] < ts[i + 1] && contains(x0 + dx * tMid, y0 + dy * tMid))
+					{
+						insideT += ts[i + 1] - ts[i];
+					}
+				}
+
+				return insideT * std::sqrt(dx * dx + dy * dy);
+			}
+
+			const gg::Geometry* geometry;
+			std::unique_ptr<const gg::prep::PreparedGeometry> prepared;
+
+			bool isPolygon = false;
+			std::vector<double> ringCoords;
+			std::vector<size_t> ringEnds;
+		};
+
+		//PreparedGeometryの遅延初期化やGeometryFactoryの参照カウントはスレッドセーフでないので排他する
+		double geometryIntersectionLength(const Obstacle& obstacle, const std::vector<double>& coords, double pathLength)
+		{
+			std::lock_guard<std::mutex> lock(m_geosMutex);
+
+			try
+			{
+				gg::CoordinateArraySequence cs;
+				for (size_t i = 0; i * 2 < coords.size(); ++i)
+				{
+					cs.add(gg::Coordinate(coords[2 * i], coords[2 * i + 1]));
+				}
+				auto path = ToUnique<GeometryDeleter>(obstacle.geometry->getFactory()->createLineString(cs));
+
+				if (!obstacle.prepared->intersects(path.get()))
+				{
+					return 0.0;
+				}
+
+				auto g = ToUnique<GeometryDeleter>(obstacle.geometry->intersection(path.get()));
+				if (g->getGeometryTypeId() == gg::GEOS_LINESTRING)
+				{
+					const gg::LineString* intersections = dynamic_cast<const gg::LineString*>(g.get());
+					return intersections->getLength();
+				}
+				else if (g->getGeometryTypeId() == gg::GEOS_MULTILINESTRING)
+				{
+					const gg::MultiLineString* intersections = dynamic_cast<const gg::MultiLineString*>(g.get());
+					return intersections->getLength();
+				}
+			}
+			catch (const std::exception& e)
+			{
+				return pathLength;
+			}
+
+			return 0.0;
+		}
+
+		std::vector<Obstacle> m_obstacles;
+		geos::index::strtree::STRtree m_tree;
+		std::mutex m_geosMutex;
+	};
+
+	PackedRecord BuildPath(const PackedList& passes, std::shared_ptr<Context> pContext, int numOfPoints, const PackedList& obstacleList)
+	{
 		Vector<Eigen::Vector2d> points;
 		{
 			if (passes.data.size() < 2)
@@ -1829,8 +2539,6 @@ namespace cgl
 					Eigen::Vector2d v2d;
 					v2d << x, y;
 					points.push_back(v2d);
-
-					originalPoints.push_back_raw(factory->createPoint(gg::Coordinate(x, y)));
 				}
 				else
 				{
@@ -1843,14 +2551,13 @@ namespace cgl
 		std::vector<double> angles2(numOfPoints / 2);
 
 		Geometries obstacles(GeosFromRecordPacked(obstacleList, pContext));
+		ObstacleIndex obstacleIndex(obstacles);
 
 		const gg::Coordinate beginPos(points.front().x(), points.front().y());
 		const gg::Coordinate endPos(points.back().x(), points.back().y());
 
 		points.erase(points.end() - 1);
 		points.erase(points.begin());
-		originalPoints.erase(originalPoints.size() - 1);
-		originalPoints.erase(0);
 
 		PackedRecord result;
 		PackedList polygonList;
@@ -1920,6 +2627,25 @@ namespace cgl
 		}
 		//*/
 
+		//1世代分の候補を並列に評価する
+		//折れ線の座標や交差計算の作業領域は評価スレッドごとに持たせて使い回す
+		const bool parallelEvaluation = !isDebugMode && 1 < std::thread::hardware_concurrency();
+
+		struct PathScratch
+		{
+			std::vector<double> coords;
+			std::vector<double> endChain;
+			ObstacleIndex::Scratch obstacle;
+		};
+
+		std::mutex scratchMutex;
+		std::unordered_map<std::thread::id, PathScratch> scratches;
+		const auto currentScratch = [&]()->PathScratch&
+		{
+			std::lock_guard<std::mutex> lock(scratchMutex);
+			return scratches[std::this_thread::get_id()];
+		};
+
 		//*
 		libcmaes::FitFunc func = [&](const double *x, const int N)->double
 		{
@@ -1927,79 +2653,74 @@ namespace cgl
 
 			const double rodLength = std::abs(x[N - 1]) + 1.0;
 
-			gg::CoordinateArraySequence cs2;
-			cs2.add(beginPos);
+			PathScratch& scratch = currentScratch();
+			auto& coords = scratch.coords;
+			auto& endChain = scratch.endChain;
+
+			coords.clear();
+			coords.push_back(beginPos.x);
+			coords.push_back(beginPos.y);
 			for (int i = 0; i < halfindex; ++i)
 			{
-				const auto& lastPos = cs2.back();
 				const double angle = x[i];
-				const double dx = rodLength * cos(angle);
-				const double dy = rodLength * sin(angle);
-				cs2.add(gg::Coordinate(lastPos.x + dx, lastPos.y + dy));
+				const double lastX = coords[coords.size() - 2];
+				const double lastY = coords.back();
+				coords.push_back(lastX + rodLength * cos(angle));
+				coords.push_back(lastY + rodLength * sin(angle));
 			}
-			const auto ik1Last = cs2.back();
+			const double ik1LastX = coords[coords.size() - 2];
+			const double ik1LastY = coords.back();
 
-			Vector<Eigen::Vector2d> cs3;
-			cs3.push_back(EigenVec2(endPos.x, endPos.y));
+			endChain.clear();
+			endChain.push_back(endPos.x);
+			endChain.push_back(endPos.y);
 			for (int i = 0; i < halfindex; ++i)
 			{
 				const int currentIndex = i + halfindex;
-				const auto& lastPos = cs3.back();
 				const double angle = x[currentIndex];
-				const double dx = rodLength * cos(angle);
-				const double dy = rodLength * sin(angle);
-
-				const double lastX = lastPos.x();
-				const double lastY = lastPos.y();
-				cs3.push_back(EigenVec2(lastX + dx, lastY + dy));
+				const double lastX = endChain[endChain.size() - 2];
+				const double lastY = endChain.back();
+				endChain.push_back(lastX + rodLength * cos(angle));
+				endChain.push_back(lastY + rodLength * sin(angle));
 			}
-			const auto ik2Last = cs3.back();
+			const double ik2LastX = endChain[endChain.size() - 2];
+			const double ik2LastY = endChain.back();
 
-			for (auto it = cs3.rbegin(); it != cs3.rend(); ++it)
+			for (size_t i = endChain.size() / 2; 0 < i; --i)
 			{
-				cs2.add(gg::Coordinate(it->x(), it->y()));
+				coords.push_back(endChain[2 * (i - 1) + 0]);
+				coords.push_back(endChain[2 * (i - 1) + 1]);
 			}
 
-			auto ls2 = ToUnique<GeometryDeleter>(factory->createLineString(cs2));
+			const size_t numPoints = coords.size() / 2;
 
-			double pathLength = ls2->getLength();
-			const double pathLengthSqrt = sqrt(pathLength);
+			double pathLength = 0;
+			for (size_t i = 0; i + 1 < numPoints; ++i)
+			{
+				const double sx = coords[2 * i + 2] - coords[2 * i];
+				const double sy = coords[2 * i + 3] - coords[2 * i + 1];
+				pathLength += sqrt(sx * sx + sy * sy);
+			}
 
-			const double dx = ik1Last.x - ik2Last.x();
-			const double dy = ik1Last.y - ik2Last.y();
+			const double dx = ik1LastX - ik2LastX;
+			const double dy = ik1LastY - ik2LastY;
 			const double distanceSq = dx * dx + dy * dy;
 			const double distance = sqrt(distanceSq);
 
+			//通過点と折れ線の距離
 			double penalty = 0;
-			for (int i = 0; i < originalPoints.size(); ++i)
-			{
-				god::DistanceOp distanceOp(ls2.get(), originalPoints.refer(i));
-				penalty += distanceOp.distance();
-			}
-
-			double penalty2 = 0;
-			for (int i = 0; i < obstacles.size(); ++i)
+			for (const auto& point : points)
 			{
-				try
-				{
-					auto g = ToUnique<GeometryDeleter>(obstacles.refer(i)->intersection(ls2.get()));
-					if (g->getGeometryTypeId() == gg::GEOS_LINESTRING)
-					{
-						const gg::LineString* intersections = dynamic_cast<const gg::LineString*>(g.get());
-						penalty2 += intersections->getLength();
-					}
-					else if (g->getGeometryTypeId() == gg::GEOS_MULTILINESTRING)
-					{
-						const gg::MultiLineString* intersections = dynamic_cast<const gg::MultiLineString*>(g.get());
-						penalty2 += intersections->getLength();
-					}
-				}
-				catch (const std::exception& e)
+				double minDistanceSq = DBL_MAX;
+				for (size_t i = 0; i + 1 < numPoints; ++i)
 				{
-					penalty2 += pathLength;
+					minDistanceSq = std::min(minDistanceSq, PointSegmentDistanceSq(point.x(), point.y(), coords[2 * i], coords[2 * i + 1], coords[2 * i + 2], coords[2 * i + 3]));
 				}
+				penalty += sqrt(minDistanceSq);
 			}
 
+			double penalty2 = obstacleIndex.intersectionLength(coords, pathLength, scratch.obstacle);
+
 			penalty2 /= pathLength;
 			penalty2 *= 100.0;
 
@@ -2055,6 +2776,7 @@ namespace cgl
 
 		//*
 		libcmaes::CMAParameters<> cmaparams(x0, sigma, lambda, 1);
+		cmaparams.set_mt_feval(parallelEvaluation);
 		libcmaes::CMASolutions cmasols = libcmaes::cmaes<>(func, cmaparams);
 		auto resultxs = cmasols.best_candidate().get_x();
 		//*/
@@ -2378,7 +3100,7 @@ namespace cgl
 	{
 		Geometries geometries(GeosFromRecordPacked(shape, pContext));
 
-		std::vector<PackedList> pathList;
+		PackedPolyData pathList;
 		for (size_t g = 0; g < geometries.size(); ++g)
 		{
 			const gg::Geometry* geometry = geometries.refer(g);
@@ -2387,14 +3109,14 @@ namespace cgl
 				const gg::Polygon* polygon = dynamic_cast<const gg::Polygon*>(geometry);
 				const gg::LineString* exterior = polygon->getExteriorRing();
 
-				PackedList polygonList;
+				PackedVertices polygonList;
 
 				if (IsClockWise(exterior))
 				{
 					for (size_t p = 0; p < exterior->getNumPoints(); ++p)
 					{
 						const gg::Coordinate& point = exterior->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 				else
@@ -2402,7 +3124,7 @@ namespace cgl
 					for (int p = static_cast<int>(exterior->getNumPoints()) - 1; 0 <= p; --p)
 					{
 						const gg::Coordinate& point = exterior->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 
@@ -2417,7 +3139,7 @@ namespace cgl
 	{
 		Geometries geometries(GeosFromRecordPacked(shape, pContext));
 
-		std::vector<PackedList> pathList;
+		PackedPolyData pathList;
 		for (size_t g = 0; g < geometries.size(); ++g)
 		{
 			const gg::Geometry* geometry = geometries.refer(g);
@@ -2429,14 +3151,14 @@ namespace cgl
 				{
 					const gg::LineString* exterior = polygon->getInteriorRingN(i);
 
-					PackedList polygonList;
+					PackedVertices polygonList;
 
 					if (IsClockWise(exterior))
 					{
 						for (size_t p = 0; p < exterior->getNumPoints(); ++p)
 						{
 							const gg::Coordinate& point = exterior->getCoordinateN(p);
-							polygonList.add(MakeVec2(point.x, point.y));
+							polygonList.add(point.x, point.y);
 						}
 					}
 					else
@@ -2444,7 +3166,7 @@ namespace cgl
 						for (int p = static_cast<int>(exterior->getNumPoints()) - 1; 0 <= p; --p)
 						{
 							const gg::Coordinate& point = exterior->getCoordinateN(p);
-							polygonList.add(MakeVec2(point.x, point.y));
+							polygonList.add(point.x, point.y);
 						}
 					}
 
@@ -2460,21 +3182,21 @@ namespace cgl
 	{
 		Geometries geometries(GeosFromRecordPacked(shape, pContext));
 
-		std::vector<PackedList> pathList;
+		PackedPolyData pathList;
 
 		const auto appendPolygon = [&](const gg::Polygon* polygon)
 		{
 			{
 				const gg::LineString* exterior = polygon->getExteriorRing();
 
-				PackedList polygonList;
+				PackedVertices polygonList;
 
 				if (IsClockWise(exterior))
 				{
 					for (size_t p = 0; p < exterior->getNumPoints(); ++p)
 					{
 						const gg::Coordinate& point = exterior->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 				else
@@ -2482,7 +3204,7 @@ namespace cgl
 					for (int p = static_cast<int>(exterior->getNumPoints()) - 1; 0 <= p; --p)
 					{
 						const gg::Coordinate& point = exterior->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 
@@ -2493,14 +3215,14 @@ namespace cgl
 			{
 				const gg::LineString* hole = polygon->getInteriorRingN(i);
 
-				PackedList polygonList;
+				PackedVertices polygonList;
 				
 				if (IsClockWise(hole))
 				{
 					for (int p = static_cast<int>(hole->getNumPoints()) - 1; 0 <= p; --p)
 					{
 						const gg::Coordinate& point = hole->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 				else
@@ -2508,7 +3230,7 @@ namespace cgl
 					for (size_t p = 0; p < hole->getNumPoints(); ++p)
 					{
 						const gg::Coordinate& point = hole->getCoordinateN(p);
-						polygonList.add(MakeVec2(point.x, point.y));
+						polygonList.add(point.x, point.y);
 					}
 				}
 
@@ -1,17 +1,29 @@
 #pragma warning(disable:4996)
+#include <algorithm>
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <exception>
+#include <cstdint>
+#include <sstream>
+#include <limits>
 
 #include <boost/functional/hash.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <cppoptlib/meta.h>
 #include <cppoptlib/problem.h>
+#include <cppoptlib/boundedproblem.h>
 #include <cppoptlib/solver/bfgssolver.h>
+#include <cppoptlib/solver/lbfgsbsolver.h>
 
 #include <cmaes.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <Unicode.hpp>
 
 //#define USE_OPTIONAL_LIB
@@ -163,15 +175,21 @@ struct LimboFitFunc {
 #include <Pita/Node.hpp>
 #include <Pita/Context.hpp>
 #include <Pita/OptimizationEvaluator.hpp>
+#include <Pita/BinaryEvaluator.hpp>
 #include <Pita/Parser.hpp>
 #include <Pita/Evaluator.hpp>
 #include <Pita/Printer.hpp>
 #include <Pita/IntrinsicGeometricFunctions.hpp>
+#include <Pita/TreeLogger.hpp>
 
 extern bool printAddressInsertion;
-extern double cloneTime;
-extern unsigned cloneCount;
+extern thread_local double cloneTime;
+extern thread_local unsigned cloneCount;
 extern bool isDebugMode;
+extern bool isPortfolioMode;
+extern bool useParallelCmaesEvaluation;
+extern bool useIncrementalUnitConstraints;
+extern std::string solutionCacheDirectory;
 
 namespace cgl
 {
@@ -218,6 +236,17 @@ namespace cgl
 		return "UnknownBinaryOp";
 	}
 
+	std::string SolverTypeToStr(SolverType type)
+	{
+		switch (type)
+		{
+		case SolverType::BFGS:  return "BFGS";
+		case SolverType::CMAES: return "CMA-ES";
+		}
+
+		return "UnknownSolver";
+	}
+
 	bool IsVec2(const Val& value)
 	{
 		if (!IsType<Record>(value))
@@ -703,12 +732,20 @@ namespace cgl
 	}
 #endif
 
-	class ConstraintProblem : public cppoptlib::Problem<double>
+	class ConstraintProblem : public cppoptlib::BoundedProblem<double>
 	{
 	public:
-		using typename cppoptlib::Problem<double>::TVector;
+		using typename cppoptlib::BoundedProblem<double>::TVector;
+
+		ConstraintProblem(const TVector& lowerBound, const TVector& upperBound) :
+			cppoptlib::BoundedProblem<double>(lowerBound, upperBound)
+		{}
 
 		std::function<double(const TVector&)> evaluator;
+		//設定されていない場合は差分近似で勾配を求める
+		std::function<void(const TVector&, TVector&)> gradientEvaluator;
+		//trueを返したら最適化を打ち切る
+		std::function<bool()> isCancelled;
 		Record originalRecord;
 		std::vector<Identifier> keyList;
 		std::shared_ptr<Context> pEnv;
@@ -721,10 +758,27 @@ namespace cgl
 		{
 			return evaluator(x);
 		}
+
+		void gradient(const TVector &x, TVector &grad) override
+		{
+			if (gradientEvaluator)
+			{
+				gradientEvaluator(x, grad);
+			}
+			else
+			{
+				cppoptlib::Problem<double>::gradient(x, grad);
+			}
+		}
 	};
 
 	bool ConstraintProblem::callback(const cppoptlib::Criteria<cppoptlib::Problem<double>::Scalar> &state, const TVector &x)
 	{
+		if (isCancelled && isCancelled())
+		{
+			return false;
+		}
+
 		if (!pEnv->hasTimeLimit())
 		{
 			return true;
@@ -738,6 +792,241 @@ namespace cgl
 		return true;
 	}
 
+	//コスト関数の評価回数と評価時間の集計（CMA-ESの並列評価では複数のスレッドから呼ばれる）
+	class EvaluationStats
+	{
+	public:
+		void add(double sec)
+		{
+			++m_count;
+			m_nanoSec += static_cast<long long>(sec * 1.e9);
+		}
+
+		size_t count()const
+		{
+			return m_count.load();
+		}
+
+		double sec()const
+		{
+			return m_nanoSec.load() * 1.e-9;
+		}
+
+	private:
+		std::atomic<size_t> m_count{ 0 };
+		std::atomic<long long> m_nanoSec{ 0 };
+	};
+
+	//libcmaesは1世代分の候補の評価をOpenMPで並列化するので、評価スレッドはOpenMPのスレッド番号で区別する
+	int EvaluationThreadCount()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	int EvaluationThreadIndex()
+	{
+#ifdef _OPENMP
+		return omp_get_thread_num();
+#else
+		return 0;
+#endif
+	}
+
+	//制約式の位置情報
+	//addUnitConstraintで結合した式は位置情報を持たないので、最初の単位制約の位置を返す
+	class ConstraintLocation : public boost::static_visitor<LocationInfo>
+	{
+	public:
+		template<class T>
+		LocationInfo operator()(const T& node)const
+		{
+			return node;
+		}
+
+		LocationInfo operator()(const BinaryExpr& node)const
+		{
+			if (!node.isValid() && node.op == BinaryOp::And)
+			{
+				return boost::apply_visitor(*this, node.lhs);
+			}
+			return node;
+		}
+	};
+
+	//解いた制約の解をディレクトリに保存し、次回以降の実行で再利用する
+	//キーは制約式の正規形・free変数の並びと範囲・free変数の初期値から作るので、どれかが変われば別のエントリになる
+	class SolutionCache
+	{
+	public:
+		static std::string MakeKey(const std::string& material)
+		{
+			//FNV-1aを異なる初期値で2回かけて128bitのキーにする
+			const auto fnv1a = [&](std::uint64_t hash)
+			{
+				for (const unsigned char c : material)
+				{
+					hash ^= c;
+					hash *= 1099511628211ull;
+				}
+				return hash;
+			};
+
+			std::stringstream ss;
+			ss << std::hex << std::setfill('0') << std::setw(16) << fnv1a(14695981039346656037ull) << std::setw(16) << fnv1a(9650029242287828579ull);
+			return ss.str();
+		}
+
+		static boost::optional<std::vector<double>> Load(const std::string& directory, const std::string& key)
+		{
+			std::ifstream ifs(entryPath(directory, key));
+			if (!ifs)
+			{
+				return boost::none;
+			}
+
+			//壊れたファイルの先頭に大きな値があっても確保しないように、読めた値の数を先頭の個数と照合する
+			size_t size = 0;
+			if (!(ifs >> size))
+			{
+				return boost::none;
+			}
+
+			std::vector<double> xs;
+			double x;
+			while (xs.size() < size && ifs >> x)
+			{
+				xs.push_back(x);
+			}
+
+			if (xs.size() != size)
+			{
+				return boost::none;
+			}
+			return xs;
+		}
+
+		static void Store(const std::string& directory, const std::string& key, const std::vector<double>& xs)
+		{
+			//並列に解いている他の制約や他のプロセスと書き込みが重ならないように、一時ファイルに書いてから置き換える
+			const std::string path = entryPath(directory, key);
+			std::stringstream tempPath;
+			tempPath << path << "." << std::this_thread::get_id() << ".tmp";
+
+			try
+			{
+				filesystem::create_directories(filesystem::path(directory));
+				{
+					std::ofstream ofs(tempPath.str());
+					ofs << std::setprecision(17) << xs.size() << "\n";
+					for (const double x : xs)
+					{
+						ofs << x << "\n";
+					}
+				}
+				filesystem::rename(filesystem::path(tempPath.str()), filesystem::path(path));
+			}
+			catch (const std::exception& e)
+			{
+				CGL_WarnLog(std::string("制約解のキャッシュに書き込めませんでした: ") + e.what());
+			}
+		}
+
+		//ポートフォリオで勝ったソルバーは、初期値を含まない制約の形のキーで別に保存する
+		static boost::optional<SolverType> LoadSolver(const std::string& directory, const std::string& key)
+		{
+			std::ifstream ifs(solverPath(directory, key));
+			std::string name;
+			if (!(ifs >> name))
+			{
+				return boost::none;
+			}
+
+			for (const SolverType type : { SolverType::BFGS, SolverType::CMAES })
+			{
+				if (name == SolverTypeToStr(type))
+				{
+					return type;
+				}
+			}
+			return boost::none;
+		}
+
+		static void StoreSolver(const std::string& directory, const std::string& key, SolverType type)
+		{
+			const std::string path = solverPath(directory, key);
+			std::stringstream tempPath;
+			tempPath << path << "." << std::this_thread::get_id() << ".tmp";
+
+			try
+			{
+				filesystem::create_directories(filesystem::path(directory));
+				{
+					std::ofstream ofs(tempPath.str());
+					ofs << SolverTypeToStr(type) << "\n";
+				}
+				filesystem::rename(filesystem::path(tempPath.str()), filesystem::path(path));
+			}
+			catch (const std::exception& e)
+			{
+				CGL_WarnLog(std::string("制約解のキャッシュに書き込めませんでした: ") + e.what());
+			}
+		}
+
+	private:
+		static std::string entryPath(const std::string& directory, const std::string& key)
+		{
+			return (filesystem::path(directory) / filesystem::path(key + ".txt")).string();
+		}
+
+		static std::string solverPath(const std::string& directory, const std::string& key)
+		{
+			return (filesystem::path(directory) / filesystem::path(key + ".solver")).string();
+		}
+	};
+
+	//ポートフォリオモードで並行に走らせるソルバー間の共有状態
+	//制約が満たされたとみなせるコストに最初に達したソルバーを勝者とし、他のソルバーは打ち切る
+	class SolverRace
+	{
+	public:
+		void report(SolverType type, double cost)
+		{
+			if (cost < EqualityTolerance)
+			{
+				int expected = -1;
+				m_winner.compare_exchange_strong(expected, static_cast<int>(type));
+			}
+		}
+
+		bool isFinished()const
+		{
+			return m_winner.load() != -1;
+		}
+
+		bool isCancelled(SolverType type)const
+		{
+			const int winner = m_winner.load();
+			return winner != -1 && winner != static_cast<int>(type);
+		}
+
+		boost::optional<SolverType> winner()const
+		{
+			const int winner = m_winner.load();
+			if (winner == -1)
+			{
+				return boost::none;
+			}
+			return static_cast<SolverType>(winner);
+		}
+
+	private:
+		std::atomic<int> m_winner{ -1 };
+	};
+
 	void OptimizationProblemSat::addUnitConstraint(const Expr& logicExpr)
 	{
 		if (expr)
@@ -849,9 +1138,42 @@ namespace cgl
 		std::cerr << "OptimizationProblemSat::solve : " << std::endl;
 		printExpr2(expr.get(), pEnv, std::cerr);		
 
+		const double solveBegin = GetSec();
+
 		constructConstraint(pEnv);
 		CGL_DBG1(std::string("Current constraint freeVariablesSize: ") + ToS(freeVariableRefs.size()));
 
+		telemetry = SolverTelemetry();
+		telemetry.location = expr ? boost::apply_visitor(ConstraintLocation(), expr.get()) : LocationInfo();
+		if (!telemetry.location.isValid())
+		{
+			telemetry.location = info;
+		}
+		telemetry.numOfFreeVariables = freeVariableRefs.size();
+
+		//free変数に依存しない部分式は求解の前に一度だけ評価して定数にしておく
+		//部分評価した式はこのsolveの間だけ使い、後で制約を再確認する時のために元の式に戻す
+		struct ExprRestorer
+		{
+			boost::optional<Expr>& expr;
+			const boost::optional<Expr> original;
+			~ExprRestorer() { expr = original; }
+		} exprRestorer{ expr, expr };
+
+		if (expr && !freeVariableRefs.empty())
+		{
+			SatExprHoister hoister(pEnv, freeVariableRefs);
+			expr = boost::apply_visitor(hoister, expr.get());
+			CGL_DBG1(std::string("Hoisted ") + ToS(hoister.hoistedCount) + " constant subexpressions");
+
+			//リストの全ての要素の組に対するAvoidは、ブロードフェーズで評価するAvoid(list)にまとめる
+			if (const auto rewrittenOpt = PairwiseAvoidRewriter::Rewrite(pEnv, expr.get(), invRefs))
+			{
+				expr = rewrittenOpt.get();
+				CGL_DBG1("Pairwise Avoid constraints rewritten to Avoid(list)");
+			}
+		}
+
 		/*if (isDebugMode && expr)
 		{
 			std::ofstream graphFile;
@@ -890,7 +1212,33 @@ namespace cgl
 			CGL_DBG1(ss.str());
 		}*/
 
+		//範囲指定のないvarのデフォルトの探索範囲
+		const auto defaultRange = [](const RegionVariable& regionVariable)->Interval
+		{
+			if (regionVariable.has(RegionVariable::Position))
+			{
+				return Interval(-1000, +1000);
+			}
+			else if (regionVariable.has(RegionVariable::Scale))
+			{
+				return Interval(1.e-3, 1.e+3);
+			}
+			else if (regionVariable.has(RegionVariable::Angle))
+			{
+				return Interval(-180, +180);
+			}
+			else if (regionVariable.has(RegionVariable::Other))
+			{
+				return Interval(-1.e+6, +1.e+6);
+			}
+
+			CGL_Error("不明な属性");
+			return Interval();
+		};
+
 		std::vector<Interval> rangeList;
+		//Address->varで明示的に指定された範囲
+		std::unordered_map<Address, Interval> addressRanges;
 		{
 			for (const auto& r: optimizeRegions)
 			{
@@ -915,34 +1263,7 @@ namespace cgl
 								CGL_Error("恐らく Evaluator.cpp の maskedRegionVariables() のバグ");
 							}
 
-							double minVal;
-							double maxVal;
-							if (it->has(RegionVariable::Position))
-							{
-								minVal = -1000;
-								maxVal = +1000;
-							}
-							else if (it->has(RegionVariable::Scale))
-							{
-								minVal = 1.e-3;
-								maxVal = 1.e+3;
-							}
-							else if (it->has(RegionVariable::Angle))
-							{
-								minVal = -180;
-								maxVal = +180;
-							}
-							else if (it->has(RegionVariable::Other))
-							{
-								minVal = -1.e+6;
-								maxVal = +1.e+6;
-							}
-							else
-							{
-								CGL_Error("不明な属性");
-							}
-
-							rangeList.push_back(Interval(minVal, maxVal));
+							rangeList.push_back(defaultRange(*it));
 						}
 
 						/*for (int i = 0; i < r.numOfIndices; ++i)
@@ -1002,6 +1323,10 @@ namespace cgl
 						//現在はvarはVec2のみでx,yの順に並んでいると仮定している
 						rangeList.push_back(Interval(minX, maxX));
 						rangeList.push_back(Interval(minY, maxY));
+						for (size_t i = 0; i < r.addresses.size() && i < 2; ++i)
+						{
+							addressRanges[r.addresses[i]] = rangeList[rangeList.size() - 2 + i];
+						}
 					}
 					else if (IsType<PackedList>(val))
 					{
@@ -1023,6 +1348,7 @@ namespace cgl
 						for (const Address address : r.addresses)
 						{
 							rangeList.push_back(Interval(minV, maxV));
+							addressRanges[address] = rangeList.back();
 						}
 					}
 					else
@@ -1037,11 +1363,31 @@ namespace cgl
 			}
 		}
 
+		//freeVariableRefsと同じ順番に並べた各変数の範囲
+		std::vector<Interval> variableRanges;
+		std::vector<char> isExplicitRange;
+		for (const auto& regionVariable : freeVariableRefs)
+		{
+			auto it = addressRanges.find(regionVariable.address);
+			variableRanges.push_back(it != addressRanges.end() ? it->second : defaultRange(regionVariable));
+			isExplicitRange.push_back(it != addressRanges.end() ? 1 : 0);
+		}
+
 		if (!initializeData(pEnv))
 		{
 			CGL_Error("制約の初期化に失敗");
 		}
 
+		//コンパイルできた場合、評価中はContextを介さずdataから直接コストを計算する
+		if (expr && SatExprCompiler::Compile(pEnv, expr.get(), invRefs, tape))
+		{
+			CGL_DBG1(std::string("Constraint compiled to ") + ToS(tape.instructions.size()) + " instructions");
+		}
+		else if (useIncrementalUnitConstraints)
+		{
+			prepareUnitConstraints(pEnv);
+		}
+
 		std::vector<double> resultxs;
 		if (!freeVariableRefs.empty())
 		{
@@ -1079,39 +1425,107 @@ namespace cgl
 				}
 			}
 			CGL_DebugLog("End Record MakeMap");
-			if (hasPlateausFunction/*,false*/)
+			std::vector<int> dataIndices(freeVariableRefs.size());
+			for (int i = 0; i < dataIndices.size(); ++i)
+			{
+				dataIndices[i] = variable2Data[i];
+			}
+
+			//CMA-ESで解く
+			//pRaceが与えられた場合はポートフォリオの一員として解き、他のソルバーが先に収束したら打ち切る
+			const auto solveByCMAES = [&](OptimizationProblemSat& problem, std::shared_ptr<Context> pSolverEnv, SolverRace* pRace, SolverTelemetry& solverTelemetry)->std::vector<double>
 			{
 				std::cout << "Solve constraint by CMA-ES...\n";
 
+				EvaluationStats stats;
+
+				//1世代分の候補を並列に評価する
+				//評価時にdataや（コンパイルできなかった場合は）Contextへ値を書き込むため、評価スレッドごとに作業用のコピーを持たせる
+				//コピーは探索を始める前にこのスレッドで全て作り、評価中にContextを複製しない
+				const bool parallelEvaluation = useParallelCmaesEvaluation && !isDebugMode && !TreeLogger::instance().isEnable() && 1 < EvaluationThreadCount();
+
+				std::vector<std::pair<std::shared_ptr<Context>, OptimizationProblemSat>> snapshots;
+				if (parallelEvaluation)
+				{
+					const int numOfThreads = EvaluationThreadCount();
+					snapshots.reserve(numOfThreads);
+					for (int i = 0; i < numOfThreads; ++i)
+					{
+						snapshots.emplace_back(problem.tape.isCompiled() ? pSolverEnv : pSolverEnv->cloneContext(), problem);
+					}
+				}
+
 				libcmaes::FitFunc func = [&](const double *x, const int N)->double
 				{
-					for (int i = 0; i < N; ++i)
+					//他のソルバーが先に収束した場合は評価を省略する
+					//最悪のコストを返して候補として選ばれないようにし、探索は世代の終わりにprogressで止める
+					if (pRace && pRace->isCancelled(SolverType::CMAES))
 					{
-						update(variable2Data[i], x[i]);
+						return std::numeric_limits<double>::infinity();
 					}
 
+					std::shared_ptr<Context> pEvalEnv = pSolverEnv;
+					OptimizationProblemSat* pProblem = &problem;
+					if (parallelEvaluation)
 					{
-						for (const auto& keyval : invRefs)
-						{
-							pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(keyval.first, data[keyval.second]);
-						}
+						auto& snapshot = snapshots[EvaluationThreadIndex()];
+						pEvalEnv = snapshot.first;
+						pProblem = &snapshot.second;
 					}
 
-					pEnv->switchFrontScope();
-					pEnv->enterScope();
-					double result = eval(pEnv, info);
-					pEnv->exitScope();
-					pEnv->switchBackScope();
+					for (int i = 0; i < N; ++i)
+					{
+						pProblem->update(dataIndices[i], x[i]);
+					}
+
+					const double evalBegin = GetSec();
+					double result = pProblem->evalCandidate(pEvalEnv, info);
+					stats.add(GetSec() - evalBegin);
 
 					CGL_DebugLog(std::string("cost: ") + ToS(result, 17));
 
+					if (pRace)
+					{
+						pRace->report(SolverType::CMAES, result);
+					}
+
 					return result;
 				};
 
+				//varの範囲を境界として探索する
+				//明示的に範囲指定された変数は初期値を範囲内に収め、デフォルトの範囲は初期値を含むように広げる
+				//sigmaは正規化した空間で全変数共通とし、変数ごとの探索の広がりは正規化の倍率で決める
+				//明示的な範囲は[0,10]に正規化し、sigmaは範囲の幅の1%に相当する
+				//デフォルトの範囲は±1e6のように広く幅に意味がないため、初期値の大きさ（1未満なら1）を単位にしてその10%に相当させる
 				std::vector<double> x0(freeVariableRefs.size());
+				std::vector<double> lbounds(x0.size()), ubounds(x0.size());
+				Eigen::VectorXd scaling(x0.size()), shift(x0.size());
 				for (int i = 0; i < x0.size(); ++i)
 				{
-					x0[i] = data[variable2Data[i]];
+					x0[i] = problem.data[dataIndices[i]];
+					lbounds[i] = variableRanges[i].minimum;
+					ubounds[i] = variableRanges[i].maximum;
+					if (isExplicitRange[i])
+					{
+						x0[i] = std::max(lbounds[i], std::min(x0[i], ubounds[i]));
+					}
+					else
+					{
+						lbounds[i] = std::min(lbounds[i], x0[i]);
+						ubounds[i] = std::max(ubounds[i], x0[i]);
+					}
+
+					const double width = ubounds[i] - lbounds[i];
+					if (isExplicitRange[i] && 0.0 < width)
+					{
+						scaling[i] = 10.0 / width;
+						shift[i] = -lbounds[i] * scaling[i];
+					}
+					else
+					{
+						scaling[i] = 1.0 / std::max(1.0, std::abs(x0[i]));
+						shift[i] = 0.0;
+					}
 					CGL_DebugLog(ToS(i) + " : " + ToS(x0[i]));
 				}
 
@@ -1119,208 +1533,330 @@ namespace cgl
 
 				const int lambda = 100;
 
-				libcmaes::CMAParameters<> cmaparams(x0, sigma, lambda, 1);
+				using BoundedGenoPheno = libcmaes::GenoPheno<libcmaes::pwqBoundStrategy, libcmaes::linScalingStrategy>;
+				BoundedGenoPheno gp(scaling, shift, lbounds.data(), ubounds.data());
+				libcmaes::CMAParameters<BoundedGenoPheno> cmaparams(static_cast<int>(x0.size()), x0.data(), sigma, lambda, 1, gp);
+				cmaparams.set_mt_feval(parallelEvaluation);
+
+				if (pRace)
+				{
+					//ポートフォリオでは制約が満たされたとみなせるコストに達した時点で止める
+					cmaparams.set_ftarget(EqualityTolerance);
+				}
 
-				if (pEnv->hasTimeLimit())
+				if (pSolverEnv->hasTimeLimit())
 				{
-					cmaparams.set_max_calc_time(pEnv->timeLimit());
+					cmaparams.set_max_calc_time(pSolverEnv->timeLimit());
 					cmaparams.set_current_time(GetSec());
 				}
 
-				libcmaes::CMASolutions cmasols = libcmaes::cmaes<>(func, cmaparams);
-				resultxs = cmasols.best_candidate().get_x();
+				//0以外を返すとlibcmaesはその世代で探索を終える
+				libcmaes::ProgressFunc<libcmaes::CMAParameters<BoundedGenoPheno>, libcmaes::CMASolutions> progress =
+					[&](const libcmaes::CMAParameters<BoundedGenoPheno>&, const libcmaes::CMASolutions&)->int
+				{
+					return pRace && pRace->isCancelled(SolverType::CMAES) ? 1 : 0;
+				};
+
+				libcmaes::CMASolutions cmasols = libcmaes::cmaes<BoundedGenoPheno>(func, cmaparams, progress);
+				solverTelemetry.solver = SolverTypeToStr(SolverType::CMAES);
+				solverTelemetry.evaluationCount = stats.count();
+				solverTelemetry.evaluationSec = stats.sec();
+				solverTelemetry.iterationCount = cmasols.niter();
+				const Eigen::VectorXd bestParameters = gp.pheno(cmasols.best_candidate().get_x_dvec());
+				std::vector<double> xs(bestParameters.size());
+				for (int i = 0; i < xs.size(); ++i)
+				{
+					xs[i] = bestParameters[i];
+				}
 
 				std::cout << "solved\n";
-			}
-			else if(true)
+
+				return xs;
+			};
+
+			//BFGSで解く
+			//pRaceが与えられた場合はポートフォリオの一員として解き、他のソルバーが先に収束したら打ち切る
+			const auto solveByBFGS = [&](OptimizationProblemSat& problem, std::shared_ptr<Context> pSolverEnv, SolverRace* pRace, SolverTelemetry& solverTelemetry)->std::vector<double>
 			{
 				std::cout << "Solve constraint by BFGS...\n";
 
-				ConstraintProblem constraintProblem;
+				EvaluationStats stats;
+
+				//範囲が明示的に指定された変数のみ境界を設定する
+				//境界の無い変数はcppoptlibの規約に合わせて±infinityとする（±DBL_MAXではブレークポイントの計算が溢れる）
+				const double unbounded = std::numeric_limits<double>::infinity();
+				ConstraintProblem::TVector lowerBound(freeVariableRefs.size()), upperBound(freeVariableRefs.size());
+				for (int i = 0; i < lowerBound.size(); ++i)
+				{
+					lowerBound[i] = isExplicitRange[i] ? variableRanges[i].minimum : -unbounded;
+					upperBound[i] = isExplicitRange[i] ? variableRanges[i].maximum : +unbounded;
+				}
+
+				//ポートフォリオでは直線探索の途中で収束を検出することがあるので、評価した中で最もコストの小さい点を返す
+				double bestCost = DBL_MAX;
+				ConstraintProblem::TVector bestX;
+
+				ConstraintProblem constraintProblem(lowerBound, upperBound);
 				constraintProblem.evaluator = [&](const ConstraintProblem::TVector& v)->double
 				{
 					for (int i = 0; i < v.size(); ++i)
 					{
-						update(variable2Data[i], v[i]);
+						problem.update(dataIndices[i], v[i]);
 					}
 
-					for (const auto& keyval : invRefs)
+					const double evalBegin = GetSec();
+					double result = problem.evalCandidate(pSolverEnv, info);
+					stats.add(GetSec() - evalBegin);
+
+					if (pRace)
 					{
-						pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(keyval.first, data[keyval.second]);
+						if (result < bestCost)
+						{
+							bestCost = result;
+							bestX = v;
+						}
+						pRace->report(SolverType::BFGS, result);
 					}
 
-					pEnv->switchFrontScope();
-					pEnv->enterScope();
-					double result = eval(pEnv, info);
-					pEnv->exitScope();
-					pEnv->switchBackScope();
-
 					//CGL_DebugLog(std::string("cost: ") + ToS(result, 17));
 					//std::cout << std::string("cost: ") << ToS(result, 17) << "\n";
 					return result*result;
 				};
+				//制約式をコンパイルできた場合は自動微分で厳密な勾配を求める
+				if (problem.tape.isCompiled())
+				{
+					constraintProblem.gradientEvaluator = [&](const ConstraintProblem::TVector& v, ConstraintProblem::TVector& grad)
+					{
+						for (int i = 0; i < v.size(); ++i)
+						{
+							problem.update(dataIndices[i], v[i]);
+						}
+
+						std::vector<double> dataGrad;
+						const double evalBegin = GetSec();
+						const double result = problem.tape.gradient(problem.data, dataGrad);
+						stats.add(GetSec() - evalBegin);
+
+						//コストはresult^2なので d(result^2)/dx = 2*result*d(result)/dx
+						grad.resize(v.size());
+						for (int i = 0; i < v.size(); ++i)
+						{
+							grad[i] = 2.0 * result * dataGrad[dataIndices[i]];
+						}
+					};
+				}
+				if (pRace)
+				{
+					constraintProblem.isCancelled = [pRace]() { return pRace->isFinished(); };
+				}
 				constraintProblem.originalRecord = currentRecord;
 				constraintProblem.keyList = currentKeyList;
-				constraintProblem.pEnv = pEnv;
+				constraintProblem.pEnv = pSolverEnv;
 
 				Eigen::VectorXd x0s(freeVariableRefs.size());
 				for (int i = 0; i < x0s.size(); ++i)
 				{
-					x0s[i] = data[variable2Data[i]];
+					x0s[i] = std::max(lowerBound[i], std::min(problem.data[dataIndices[i]], upperBound[i]));
 					//x0s[i] = (problem.data[variable2Data[i]] / 2000.0) + 0.5;
 					CGL_DebugLog(ToS(i) + " : " + ToS(x0s[i]));
 				}
 
 				constraintProblem.beginTime = GetSec();
 
-				cppoptlib::BfgsSolver<ConstraintProblem> solver;
-				solver.minimize(constraintProblem, x0s);
-
-				resultxs.resize(x0s.size());
-				for (int i = 0; i < x0s.size(); ++i)
+				if (std::any_of(isExplicitRange.begin(), isExplicitRange.end(), [](char isExplicit) { return isExplicit != 0; }))
 				{
-					resultxs[i] = x0s[i];
+					std::cout << "  with box constraints (L-BFGS-B)\n";
+					cppoptlib::LbfgsbSolver<ConstraintProblem> solver;
+					solver.minimize(constraintProblem, x0s);
+					solverTelemetry.iterationCount = solver.criteria().iterations;
 				}
-			}
-			else if(true)
-			{
-				std::cout << "Solve constraint by Random Search...\n";
-
-				const auto targetFunc = [&](const std::vector<double>& v)->double
+				else
 				{
-					for (int i = 0; i < v.size(); ++i)
-					{
-						update(variable2Data[i], v[i]);
-					}
+					cppoptlib::BfgsSolver<ConstraintProblem> solver;
+					solver.minimize(constraintProblem, x0s);
+					solverTelemetry.iterationCount = solver.criteria().iterations;
+				}
+				solverTelemetry.solver = SolverTypeToStr(SolverType::BFGS);
+				solverTelemetry.evaluationCount = stats.count();
+				solverTelemetry.evaluationSec = stats.sec();
 
-					for (const auto& keyval : invRefs)
-					{
-						pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(keyval.first, data[keyval.second]);
-					}
+				if (pRace && bestX.size() == x0s.size())
+				{
+					x0s = bestX;
+				}
 
-					double result;
+				std::vector<double> xs(x0s.size());
+				for (int i = 0; i < x0s.size(); ++i)
+				{
+					xs[i] = x0s[i];
+				}
 
-					pEnv->switchFrontScope();
-					pEnv->enterScope();
-					try
-					{
-						result = eval(pEnv, info);
-					}
-					catch (std::exception& e)
-					{
-						std::cout << "Eval: " << e.what() << std::endl;
-						throw;
-					}
-					pEnv->exitScope();
-					pEnv->switchBackScope();
+				return xs;
+			};
 
-					if (isDebugMode)
+			//キャッシュのキーは制約の形（正規形・free変数の並びと範囲）と初期値から作る
+			//ポートフォリオの勝者は初期値によらず制約の形ごとに保存する
+			std::string cacheKey;
+			std::string solverKey;
+			if (!solutionCacheDirectory.empty() && expr)
+			{
+				std::stringstream material;
+				material << std::setprecision(17);
+				material << SatExprCanonicalizer::Canonicalize(pEnv, expr.get(), invRefs) << "\n";
+				for (size_t i = 0; i < freeVariableRefs.size(); ++i)
+				{
+					for (const auto attribute : freeVariableRefs[i].attributes)
 					{
-						logger << "[";
-						for (int i = 0; i < v.size(); ++i)
-						{
-							logger << v[i] << ", ";
-						}
-						logger << result << "], ";
+						material << static_cast<int>(attribute) << ",";
 					}
+					material << "$" << dataIndices[i] << "[" << variableRanges[i].minimum << "," << variableRanges[i].maximum << "]\n";
+				}
+				solverKey = SolutionCache::MakeKey(material.str());
 
-					//CGL_DebugLog(std::string("cost: ") + ToS(result, 17));
-					return result;
-				};
-
-				std::vector<double> answer(freeVariableRefs.size());
-				for (int i = 0; i < answer.size(); ++i)
+				for (size_t i = 0; i < freeVariableRefs.size(); ++i)
 				{
-					answer[i] = data[variable2Data[i]];
+					material << "$" << dataIndices[i] << ":" << data[dataIndices[i]] << "\n";
 				}
+				cacheKey = SolutionCache::MakeKey(material.str());
 
-				double beginTime = GetSec();
-
+				if (!preferredSolver)
 				{
-					double minimumCost = targetFunc(answer);
-					std::vector<double> current(answer.size());
-					if (current.size() != rangeList.size())
-					{
-						CGL_Error("範囲と変数の数が対応していない");
-					}
+					preferredSolver = SolutionCache::LoadSolver(solutionCacheDirectory, solverKey);
+				}
+			}
 
-					std::vector<std::uniform_real_distribution<double>> dists;
-					for (size_t i = 0; i < rangeList.size(); ++i)
-					{
-						std::cout << "Range(" << i << "): [" << rangeList[i].minimum << ", " << rangeList[i].maximum << "]" << std::endl;
-						dists.emplace_back(rangeList[i].minimum, rangeList[i].maximum);
-					}
+			//ポートフォリオモードでは候補のソルバーを独立したContext上で並行に走らせ、最初に収束したものを採用する
+			//勝ったソルバーはpreferredSolverに記録し（キャッシュがあればそこにも保存し）、以降の求解ではそれを直接使う
+			const bool usePortfolio = isPortfolioMode && !preferredSolver && !isDebugMode && !TreeLogger::instance().isEnable();
+			const SolverType solverType = preferredSolver ? preferredSolver.get() : (hasPlateausFunction ? SolverType::CMAES : SolverType::BFGS);
 
-					int count = 0;
-					std::mt19937 rng;
-					//while (GetSec() - beginTime < 300.0)
-					//while (count < 20000)
-					//while (count < 6900)
-					while(count < 20000)
+			//キャッシュに解があり、それが現在の制約を満たしていれば求解を省略する
+			bool isCacheHit = false;
+			if (!cacheKey.empty())
+			{
+				if (const auto cachedOpt = SolutionCache::Load(solutionCacheDirectory, cacheKey))
+				{
+					const std::vector<double>& cached = cachedOpt.get();
+					if (cached.size() == freeVariableRefs.size())
 					{
-						cloneTime = 0.0;
-						cloneCount = 0;
-						/*if (6660 < count)
-						{
-							printAddressInsertion = true;
-							std::cout << "----------------------------------\n";
-							std::cout << count << ": ";
-						}*/
-						for (size_t i = 0; i < current.size(); ++i)
-						{
-							current[i] = dists[i](rng);
-							if (printAddressInsertion)
-							{
-								std::cout << current[i] << ", ";
-							}
-						}
-
-						if (printAddressInsertion)
+						const std::vector<double> initialData = data;
+						for (int i = 0; i < cached.size(); ++i)
 						{
-							std::cout << "\n";
+							update(dataIndices[i], cached[i]);
 						}
 
-						const double currentCost = targetFunc(current);
-						if (currentCost < minimumCost)
+						isCacheHit = evalCandidate(pEnv, info) < EqualityTolerance;
+						if (isCacheHit)
 						{
-							minimumCost = currentCost;
-							answer = current;
+							resultxs = cached;
 						}
-						if (printAddressInsertion)
+						else
 						{
-							std::cout << "cloneTime: " << cloneTime << " | " << cloneCount << "\n";
+							data = initialData;
 						}
+					}
+				}
+			}
+
+			if (isCacheHit)
+			{
+				std::cout << "Constraint solution found in cache\n";
+				telemetry.solver = "Cache";
+				telemetry.evaluationCount = 1;
+			}
+			else if (usePortfolio)
+			{
+				std::cout << "Solve constraint by portfolio (BFGS, CMA-ES)...\n";
+
+				const std::vector<SolverType> solverTypes({ SolverType::BFGS, SolverType::CMAES });
 
-						++count;
+				SolverRace race;
+				std::vector<OptimizationProblemSat> racerProblems(solverTypes.size(), *this);
+				std::vector<std::vector<double>> racerResults(solverTypes.size());
+				std::vector<SolverTelemetry> racerTelemetries(solverTypes.size());
+				std::vector<std::exception_ptr> errors(solverTypes.size());
 
-						if (count % 1000 == 0)
-							//if (count % 10 == 0)
+				std::vector<std::thread> racers;
+				for (size_t i = 0; i < solverTypes.size(); ++i)
+				{
+					racers.emplace_back([&, i]()
+					{
+						try
+						{
+							auto pRacerEnv = tape.isCompiled() ? pEnv : pEnv->cloneContext();
+							racerResults[i] = solverTypes[i] == SolverType::CMAES
+								? solveByCMAES(racerProblems[i], pRacerEnv, &race, racerTelemetries[i])
+								: solveByBFGS(racerProblems[i], pRacerEnv, &race, racerTelemetries[i]);
+						}
+						catch (...)
 						{
-							std::cout <<"it("<< count <<") | "<< "cloneTime: " << cloneTime << ", cloneCount: " << cloneCount << "\n";
-							pEnv->garbageCollect(true);
+							errors[i] = std::current_exception();
 						}
+					});
+				}
+				for (auto& racer : racers)
+				{
+					racer.join();
+				}
+
+				for (const auto& error : errors)
+				{
+					if (error)
+					{
+						std::rethrow_exception(error);
 					}
+				}
 
-					if (isDebugMode)
+				size_t adoptedIndex = 0;
+				if (const auto winner = race.winner())
+				{
+					adoptedIndex = std::distance(solverTypes.begin(), std::find(solverTypes.begin(), solverTypes.end(), winner.get()));
+					preferredSolver = winner;
+					if (!solverKey.empty())
+					{
+						SolutionCache::StoreSolver(solutionCacheDirectory, solverKey, winner.get());
+					}
+					std::cout << "  " << SolverTypeToStr(winner.get()) << " converged first\n";
+				}
+				//どのソルバーも収束しなかった場合は最終的なコストが最も小さいものを採用する
+				else
+				{
+					double minimumCost = DBL_MAX;
+					for (size_t i = 0; i < solverTypes.size(); ++i)
 					{
-						logger << "[";
-						for (int i = 0; i < answer.size(); ++i)
+						for (int j = 0; j < racerResults[i].size(); ++j)
 						{
-							logger << answer[i] << ", ";
+							update(dataIndices[j], racerResults[i][j]);
 						}
-						logger << minimumCost << "]\n";
 
-						logger << "\t]\n";
-						logger << "}\n";
+						const double cost = evalCandidate(pEnv, info);
+						if (cost < minimumCost)
+						{
+							minimumCost = cost;
+							adoptedIndex = i;
+						}
 					}
 				}
 
-				resultxs.resize(answer.size());
-				for (int i = 0; i < answer.size(); ++i)
+				resultxs = racerResults[adoptedIndex];
+
+				//評価回数は全てのソルバーの合計を記録する
+				telemetry.solver = "Portfolio(" + racerTelemetries[adoptedIndex].solver + ")";
+				telemetry.iterationCount = racerTelemetries[adoptedIndex].iterationCount;
+				for (const auto& racerTelemetry : racerTelemetries)
 				{
-					resultxs[i] = answer[i];
+					telemetry.evaluationCount += racerTelemetry.evaluationCount;
+					telemetry.evaluationSec += racerTelemetry.evaluationSec;
 				}
 			}
+			else if (solverType == SolverType::CMAES)
+			{
+				resultxs = solveByCMAES(*this, pEnv, nullptr, telemetry);
+			}
+			else if (solverType == SolverType::BFGS)
+			{
+				resultxs = solveByBFGS(*this, pEnv, nullptr, telemetry);
+			}
 			/*else if (true)
 			{
 				std::cout << "Solve constraint by nlopt...\n";
@@ -1450,11 +1986,146 @@ namespace cgl
 				}
 			}
 #endif
+
+			if (resultxs.size() == freeVariableRefs.size())
+			{
+				for (int i = 0; i < resultxs.size(); ++i)
+				{
+					update(variable2Data[i], resultxs[i]);
+				}
+				telemetry.finalCost = evalCandidate(pEnv, info);
+
+				//制約を満たす解だけを保存する
+				if (!cacheKey.empty() && !isCacheHit && telemetry.finalCost < EqualityTolerance)
+				{
+					SolutionCache::Store(solutionCacheDirectory, cacheKey, resultxs);
+				}
+			}
 		}
 
+		telemetry.wallSec = GetSec() - solveBegin;
+
 		return resultxs;
 	}
 
+	double OptimizationProblemSat::evalCandidate(std::shared_ptr<Context> pEnv, const LocationInfo& info)
+	{
+		if (tape.isCompiled() && !data.empty())
+		{
+			return tape.evaluate(data);
+		}
+
+		if (!unitCache.units.empty() && !data.empty())
+		{
+			return evalUnitConstraints(pEnv, info);
+		}
+
+		for (const auto& keyval : invRefs)
+		{
+			pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(keyval.first, data[keyval.second]);
+		}
+
+		pEnv->switchFrontScope();
+		pEnv->enterScope();
+		const double result = eval(pEnv, info);
+		pEnv->exitScope();
+		pEnv->switchBackScope();
+
+		return result;
+	}
+
+	void OptimizationProblemSat::prepareUnitConstraints(std::shared_ptr<Context> pEnv)
+	{
+		unitCache = UnitConstraintCache();
+		if (!expr)
+		{
+			return;
+		}
+
+		ConjunctionSeparater separater;
+		boost::apply_visitor(separater, expr.get());
+		if (separater.conjunctions.size() < 2)
+		{
+			return;
+		}
+
+		for (const auto& unit : separater.conjunctions)
+		{
+			//制約全体の参照IDを書き換えないように、作業用の集合で単位制約に現れるfree変数を調べる
+			std::vector<char> usedInSat(freeVariableRefs.size(), 0);
+			std::vector<Address> unitRefs;
+			std::unordered_set<Address> unitRefsSet;
+			std::unordered_map<Address, int> unitInvRefs;
+			bool unitHasPlateausFunction = false;
+			SatVariableBinder binder(pEnv, freeVariableRefs, usedInSat, unitRefs, unitRefsSet, unitInvRefs, unitHasPlateausFunction);
+			boost::apply_visitor(binder, unit);
+
+			std::vector<int> dependency;
+			for (const Address address : unitRefs)
+			{
+				auto it = invRefs.find(address);
+				if (it != invRefs.end())
+				{
+					dependency.push_back(it->second);
+				}
+			}
+
+			unitCache.units.push_back(unit);
+			unitCache.dependencies.push_back(dependency);
+		}
+
+		unitCache.costs.resize(unitCache.units.size(), 0.0);
+	}
+
+	double OptimizationProblemSat::evalUnitConstraints(std::shared_ptr<Context> pEnv, const LocationInfo& info)
+	{
+		//初回とContextが変わった場合は全ての単位制約を評価する
+		const bool evaluateAll = !unitCache.isEvaluatedIn(pEnv) || unitCache.lastData.size() != data.size();
+
+		//評価中に例外が出た場合に途中の状態を使わないよう、評価が終わるまでは無効にしておく
+		unitCache.context.reset();
+
+		std::vector<char> changed(data.size(), 0);
+		for (int i = 0; i < data.size(); ++i)
+		{
+			if (evaluateAll || data[i] != unitCache.lastData[i])
+			{
+				changed[i] = 1;
+				pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(refs[i], data[i]);
+			}
+		}
+
+		pEnv->switchFrontScope();
+		pEnv->enterScope();
+
+		double result = 0.0;
+		for (size_t unitID = 0; unitID < unitCache.units.size(); ++unitID)
+		{
+			const auto& dependency = unitCache.dependencies[unitID];
+			const bool isDirty = evaluateAll || std::any_of(dependency.begin(), dependency.end(), [&](int refID) { return changed[refID] != 0; });
+			if (isDirty)
+			{
+				EvalSatExpr evaluator(pEnv, data, refs, invRefs);
+				const Val evaluated = pEnv->expand(boost::apply_visitor(evaluator, unitCache.units[unitID]), info);
+				if (!IsNum(evaluated))
+				{
+					CGL_Error("sat式の評価結果が不正");
+				}
+				unitCache.costs[unitID] = AsDouble(evaluated);
+			}
+
+			result += unitCache.costs[unitID];
+		}
+
+		pEnv->exitScope();
+		pEnv->switchBackScope();
+
+		unitCache.lastData = data;
+		unitCache.context = pEnv;
+
+		return result;
+	}
+
 	double OptimizationProblemSat::eval(std::shared_ptr<Context> pEnv, const LocationInfo& info)
 	{
 		if (!expr)
@@ -1550,6 +2221,10 @@ namespace cgl
 		{
 			return 0;
 		}
+		size_t operator()(const PackedVertices& node)const
+		{
+			return boost::hash_range(node.coords.begin(), node.coords.end());
+		}
 	};
 
 	size_t GetHash(const PackedVal& val)
@@ -1604,6 +2279,7 @@ namespace cgl
 		Val operator()(const PackedRecord& node)const { return node.unpacked(context); }
 		Val operator()(const FuncVal& node)const { return node; }
 		Val operator()(const Jump& node)const { return node; }
+		Val operator()(const PackedVertices& node)const { return node.unpacked(context); }
 	};
 
 	PackedVal Packed(const Val& value, const Context& context)
@@ -1618,6 +2294,149 @@ namespace cgl
 		return boost::apply_visitor(unpacker, packedValue);
 	}
 
+	//全ての頂点が{x: double, y: double}のみからなる頂点リストであれば、PackedVerticesに詰める
+	boost::optional<PackedVertices> PackedVerticesOpt(const List& list, const Context& context)
+	{
+		if (list.data.empty())
+		{
+			return boost::none;
+		}
+
+		PackedVertices result;
+		result.reserve(list.data.size());
+		result.addresses.reserve(list.data.size() * 3);
+
+		for (const Address address : list.data)
+		{
+			const auto& vertexOpt = context.expandOpt(LRValue(address));
+			if (!vertexOpt || !IsType<Record>(vertexOpt.get()))
+			{
+				return boost::none;
+			}
+
+			const Record& vertex = As<Record>(vertexOpt.get());
+			if (vertex.values.size() != 2
+				|| !vertex.problems.empty()
+				|| vertex.constraint
+				|| !vertex.boundedFreeVariables.empty()
+				|| vertex.type != RecordType::RecordTypeNormal
+				|| !vertex.isSatisfied
+				|| !vertex.pathPoints.empty())
+			{
+				return boost::none;
+			}
+
+			const auto itX = vertex.values.find("x");
+			const auto itY = vertex.values.find("y");
+			if (itX == vertex.values.end() || itY == vertex.values.end())
+			{
+				return boost::none;
+			}
+
+			//intの座標を含む場合はValに戻したときに型が変わってしまうので詰めない
+			const auto& xOpt = context.expandOpt(LRValue(itX->second));
+			const auto& yOpt = context.expandOpt(LRValue(itY->second));
+			if (!xOpt || !yOpt || !IsType<double>(xOpt.get()) || !IsType<double>(yOpt.get()))
+			{
+				return boost::none;
+			}
+
+			result.add(As<double>(xOpt.get()), As<double>(yOpt.get()));
+			result.addresses.push_back(address);
+			result.addresses.push_back(itX->second);
+			result.addresses.push_back(itY->second);
+		}
+
+		return result;
+	}
+
+	//シェイプのpolygon, lineに指定されたリストを詰める
+	//polygon: [p0, p1, ...] の場合はPackedVertices、polygon: [[p00, ...], [p10, ...]] の場合はPackedVerticesのリストになる
+	PackedVal PackedShapeVertices(const List& list, const Context& context)
+	{
+		if (auto verticesOpt = PackedVerticesOpt(list, context))
+		{
+			return verticesOpt.get();
+		}
+
+		ValuePacker packer(context);
+
+		PackedList result;
+
+		for (const Address address : list.data)
+		{
+			const auto& opt = context.expandOpt(LRValue(address));
+			if (!opt)
+			{
+				std::stringstream ss;
+				ss << "リスト中の " << LRValue(address).toString() << " の参照に失敗しました。";
+				CGL_Error("参照エラー: " + ss.str());
+			}
+
+			if (IsType<List>(opt.get()))
+			{
+				if (auto verticesOpt = PackedVerticesOpt(As<List>(opt.get()), context))
+				{
+					result.add(address, verticesOpt.get());
+					continue;
+				}
+			}
+
+			result.add(address, boost::apply_visitor(packer, opt.get()));
+		}
+
+		return result;
+	}
+
+	Val PackedVertices::unpacked(Context& context)const
+	{
+		List result;
+
+		for (size_t i = 0; i < size(); ++i)
+		{
+			if (addresses.empty())
+			{
+				Record vertex;
+				vertex.add("x", context.makeTemporaryValue(x(i)));
+				vertex.add("y", context.makeTemporaryValue(y(i)));
+				result.add(context.makeTemporaryValue(vertex));
+			}
+			else
+			{
+				const Address vertexAddress = addresses[i * 3 + 0];
+				Address xAddress = addresses[i * 3 + 1];
+				Address yAddress = addresses[i * 3 + 2];
+
+				//Cloneで他のレコードと共有している値には書き込まず、新しく作る
+				if (context.isSharedValue(xAddress))
+				{
+					xAddress = context.makeTemporaryValue(x(i));
+				}
+				else
+				{
+					context.TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(xAddress, x(i));
+				}
+
+				if (context.isSharedValue(yAddress))
+				{
+					yAddress = context.makeTemporaryValue(y(i));
+				}
+				else
+				{
+					context.TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(yAddress, y(i));
+				}
+
+				Record vertex;
+				vertex.add("x", xAddress);
+				vertex.add("y", yAddress);
+				context.TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(vertexAddress, vertex);
+				result.add(vertexAddress);
+			}
+		}
+
+		return result;
+	}
+
 	Val PackedList::unpacked(Context& context)const
 	{
 		ValueUnpacker unpacker(context);
@@ -1631,7 +2450,8 @@ namespace cgl
 			const PackedVal& packedValue = val.value;
 			const Val value = boost::apply_visitor(unpacker, packedValue);
 
-			if (address.isValid())
+			//Cloneで他のレコードと共有している値には書き込まず、新しく作る
+			if (address.isValid() && !context.isSharedValue(address))
 			{
 				context.TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(address, value);
 				result.add(address);
@@ -1681,7 +2501,8 @@ namespace cgl
 			const PackedVal& packedValue = keyval.second.value;
 			const Val value = boost::apply_visitor(unpacker, packedValue);
 
-			if (address.isValid())
+			//Cloneで他のレコードと共有している値には書き込まず、新しく作る
+			if (address.isValid() && !context.isSharedValue(address))
 			{
 				context.TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(address, value);
 				result.add(keyval.first, address);
@@ -1724,7 +2545,10 @@ namespace cgl
 				ss << "レコード中のキー \"" << keyval.first << "\": " << LRValue(keyval.second).toString() << " の参照に失敗しました。";
 				CGL_Error("参照エラー: " + ss.str());
 			}
-			const PackedVal packedValue = boost::apply_visitor(packer, opt.get());
+			const bool isVertexList = (keyval.first == "polygon" || keyval.first == "line") && IsType<List>(opt.get());
+			const PackedVal packedValue = isVertexList
+				? PackedShapeVertices(As<List>(opt.get()), context)
+				: boost::apply_visitor(packer, opt.get());
 
 			result.add(keyval.first, keyval.second, packedValue);
 		}
@@ -1,6 +1,9 @@
 #pragma warning(disable:4996)
 #include <functional>
+#include <cmath>
+#include <algorithm>
 
+#include <Pita/Util.hpp>
 #include <Pita/Evaluator.hpp>
 #include <Pita/OptimizationEvaluator.hpp>
 #include <Pita/BinaryEvaluator.hpp>
@@ -550,6 +553,1199 @@ namespace cgl
 		return true;
 	}
 
+	namespace
+	{
+		double BuiltInRad(double x) { return deg2rad * x; }
+		double BuiltInDeg(double x) { return rad2deg * x; }
+		double BuiltInAbs(double x) { return std::abs(x); }
+		double BuiltInSin(double x) { return std::sin(deg2rad*x); }
+		double BuiltInCos(double x) { return std::cos(deg2rad*x); }
+		double BuiltInLog(double x) { return std::log(x); }
+		double BuiltInSinRad(double x) { return std::sin(x); }
+		double BuiltInCosRad(double x) { return std::cos(x); }
+
+		double DerivativeRad(double x) { return deg2rad; }
+		double DerivativeDeg(double x) { return rad2deg; }
+		double DerivativeAbs(double x) { return x < 0.0 ? -1.0 : (0.0 < x ? 1.0 : 0.0); }
+		double DerivativeSin(double x) { return deg2rad*std::cos(deg2rad*x); }
+		double DerivativeCos(double x) { return -deg2rad*std::sin(deg2rad*x); }
+		double DerivativeLog(double x) { return 1.0 / x; }
+		double DerivativeSinRad(double x) { return std::cos(x); }
+		double DerivativeCosRad(double x) { return -std::sin(x); }
+
+		struct TapeBuiltInFunction
+		{
+			std::string name;
+			double(*func)(double);
+			double(*derivative)(double);
+		};
+
+		//SatExprTapeから直接呼べる1引数の組み込み関数（Context::MakeBuiltInFunctionTable()で登録されるものと同じ計算をする）
+		//テープのレジスタは実数しか持てないので、FloorやCeilのような整数を返す関数は含めない（Floor(x)/2が整数除算にならなくなるため）
+		const std::vector<TapeBuiltInFunction>& TapeBuiltInFunctions()
+		{
+			static const std::vector<TapeBuiltInFunction> functions = {
+				{ "Rad", BuiltInRad, DerivativeRad },
+				{ "Deg", BuiltInDeg, DerivativeDeg },
+				{ "Abs", BuiltInAbs, DerivativeAbs },
+				{ "Sin", BuiltInSin, DerivativeSin },
+				{ "Cos", BuiltInCos, DerivativeCos },
+				{ "Log", BuiltInLog, DerivativeLog },
+				{ "SinRad", BuiltInSinRad, DerivativeSinRad },
+				{ "CosRad", BuiltInCosRad, DerivativeCosRad },
+			};
+			return functions;
+		}
+
+		//組み込み関数のインデックス（Context::BuiltInFunctionIndex()）からテープで呼べる関数を引く表
+		//名前の照合は最初に一度だけ行い、コンパイル時にはアドレスから直接引く
+		const std::vector<const TapeBuiltInFunction*>& TapeBuiltInFunctionsByIndex()
+		{
+			static const std::vector<const TapeBuiltInFunction*> functionsByIndex = []()
+			{
+				const Context::BuiltInFunctionTable& builtInFunctions = Context::BuiltInFunctions();
+				std::vector<const TapeBuiltInFunction*> result(builtInFunctions.size(), nullptr);
+				for (size_t i = 0; i < builtInFunctions.size(); ++i)
+				{
+					for (const auto& function : TapeBuiltInFunctions())
+					{
+						if (function.name == builtInFunctions[i].name)
+						{
+							result[i] = &function;
+							break;
+						}
+					}
+				}
+				return result;
+			}();
+			return functionsByIndex;
+		}
+
+		boost::optional<Identifier> AsIdentifierOpt(const Expr& expr)
+		{
+			if (auto identifierOpt = AsOpt<Identifier>(expr))
+			{
+				return identifierOpt.get();
+			}
+			return boost::none;
+		}
+
+		//(a, b -> if a < b then a else b) の形をした2引数の関数をMin/Maxとして認識する
+		//PitaにはMin/Maxの組み込み関数がなく、ライブラリや各サンプルでこの形で定義されているため
+		boost::optional<SatExprTape::OpCode> MatchMinMaxFunction(const FuncVal& function)
+		{
+			if (function.builtinFuncAddress || function.arguments.size() != 2 || function.arguments[0] == function.arguments[1])
+			{
+				return boost::none;
+			}
+
+			const Expr* pBody = &function.expr;
+			if (auto linesOpt = AsOpt<Lines>(*pBody))
+			{
+				if (linesOpt.get().exprs.size() != 1)
+				{
+					return boost::none;
+				}
+				pBody = &linesOpt.get().exprs.front();
+			}
+
+			const auto ifOpt = AsOpt<If>(*pBody);
+			if (!ifOpt || !ifOpt.get().else_expr)
+			{
+				return boost::none;
+			}
+			const If& ifExpr = ifOpt.get();
+
+			const auto condOpt = AsOpt<BinaryExpr>(ifExpr.cond_expr);
+			if (!condOpt)
+			{
+				return boost::none;
+			}
+			const BinaryExpr& cond = condOpt.get();
+
+			bool lessThan;
+			switch (cond.op)
+			{
+			case BinaryOp::LessThan: case BinaryOp::LessEqual:
+				lessThan = true; break;
+			case BinaryOp::GreaterThan: case BinaryOp::GreaterEqual:
+				lessThan = false; break;
+			default:
+				return boost::none;
+			}
+
+			const auto condLhs = AsIdentifierOpt(cond.lhs);
+			const auto condRhs = AsIdentifierOpt(cond.rhs);
+			const auto thenValue = AsIdentifierOpt(ifExpr.then_expr);
+			const auto elseValue = AsIdentifierOpt(ifExpr.else_expr.get());
+			if (!condLhs || !condRhs || !thenValue || !elseValue)
+			{
+				return boost::none;
+			}
+
+			const Identifier& a = function.arguments[0];
+			const Identifier& b = function.arguments[1];
+			const bool condIsAB = condLhs.get() == a && condRhs.get() == b;
+			const bool condIsBA = condLhs.get() == b && condRhs.get() == a;
+			if (!condIsAB && !condIsBA)
+			{
+				return boost::none;
+			}
+
+			//条件が成り立つときに条件式の左辺を返すならMin（<の場合）
+			bool thenIsCondLhs;
+			if (thenValue.get() == condLhs.get() && elseValue.get() == condRhs.get())
+			{
+				thenIsCondLhs = true;
+			}
+			else if (thenValue.get() == condRhs.get() && elseValue.get() == condLhs.get())
+			{
+				thenIsCondLhs = false;
+			}
+			else
+			{
+				return boost::none;
+			}
+
+			return lessThan == thenIsCondLhs ? SatExprTape::OpCode::Min : SatExprTape::OpCode::Max;
+		}
+
+		//EvalSatExprと同様に、二項演算の被演算子に現れる真偽値はコストに置き換える
+		Val ToCost(const Val& value)
+		{
+			if (IsType<bool>(value))
+			{
+				return As<bool>(value) ? 0.0 : 10000.0;
+			}
+			return value;
+		}
+	}
+
+	double SatExprTape::evaluate(const std::vector<double>& data)
+	{
+		registers.resize(instructions.size());
+
+		for (size_t i = 0; i < instructions.size(); ++i)
+		{
+			const Instruction& inst = instructions[i];
+			double& out = registers[i];
+			switch (inst.op)
+			{
+			case OpCode::Constant: out = inst.value; break;
+			case OpCode::Load:     out = data[inst.lhs]; break;
+			case OpCode::Minus:    out = -registers[inst.lhs]; break;
+			case OpCode::Add:      out = registers[inst.lhs] + registers[inst.rhs]; break;
+			case OpCode::Sub:      out = registers[inst.lhs] - registers[inst.rhs]; break;
+			case OpCode::Mul:      out = registers[inst.lhs] * registers[inst.rhs]; break;
+			case OpCode::Div:      out = registers[inst.lhs] / registers[inst.rhs]; break;
+			case OpCode::Pow:      out = std::pow(registers[inst.lhs], registers[inst.rhs]); break;
+			case OpCode::Min:      out = std::min(registers[inst.lhs], registers[inst.rhs]); break;
+			case OpCode::Max:      out = std::max(registers[inst.lhs], registers[inst.rhs]); break;
+			case OpCode::Abs:      out = std::abs(registers[inst.lhs]); break;
+			case OpCode::Call:     out = inst.func(registers[inst.lhs]); break;
+			}
+		}
+
+		return registers.back();
+	}
+
+	double SatExprTape::gradient(const std::vector<double>& data, std::vector<double>& grad)
+	{
+		const double result = evaluate(data);
+
+		grad.assign(data.size(), 0.0);
+		adjoints.assign(instructions.size(), 0.0);
+		adjoints.back() = 1.0;
+
+		for (int i = static_cast<int>(instructions.size()) - 1; 0 <= i; --i)
+		{
+			const Instruction& inst = instructions[i];
+			const double adjoint = adjoints[i];
+			if (adjoint == 0.0)
+			{
+				continue;
+			}
+
+			switch (inst.op)
+			{
+			case OpCode::Constant: break;
+			case OpCode::Load:     grad[inst.lhs] += adjoint; break;
+			case OpCode::Minus:    adjoints[inst.lhs] -= adjoint; break;
+			case OpCode::Add:
+				adjoints[inst.lhs] += adjoint;
+				adjoints[inst.rhs] += adjoint;
+				break;
+			case OpCode::Sub:
+				adjoints[inst.lhs] += adjoint;
+				adjoints[inst.rhs] -= adjoint;
+				break;
+			case OpCode::Mul:
+				adjoints[inst.lhs] += adjoint * registers[inst.rhs];
+				adjoints[inst.rhs] += adjoint * registers[inst.lhs];
+				break;
+			case OpCode::Div:
+			{
+				const double b = registers[inst.rhs];
+				adjoints[inst.lhs] += adjoint / b;
+				adjoints[inst.rhs] -= adjoint * registers[inst.lhs] / (b*b);
+				break;
+			}
+			case OpCode::Pow:
+			{
+				const double a = registers[inst.lhs];
+				const double b = registers[inst.rhs];
+				adjoints[inst.lhs] += adjoint * b * std::pow(a, b - 1.0);
+				//底が正でない場合、指数についての微分は定義されないので0とする
+				if (0.0 < a)
+				{
+					adjoints[inst.rhs] += adjoint * registers[i] * std::log(a);
+				}
+				break;
+			}
+			//MinとMaxは選ばれた側にだけ勾配を流す
+			case OpCode::Min:
+				adjoints[registers[inst.lhs] <= registers[inst.rhs] ? inst.lhs : inst.rhs] += adjoint;
+				break;
+			case OpCode::Max:
+				adjoints[registers[inst.lhs] >= registers[inst.rhs] ? inst.lhs : inst.rhs] += adjoint;
+				break;
+			case OpCode::Abs:
+				adjoints[inst.lhs] += adjoint * DerivativeAbs(registers[inst.lhs]);
+				break;
+			case OpCode::Call:
+				adjoints[inst.lhs] += adjoint * inst.derivative(registers[inst.lhs]);
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	bool SatExprCompiler::Compile(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs, SatExprTape& tape)
+	{
+		tape.clear();
+
+		SatExprCompiler compiler(pEnv, invRefs, tape);
+		//free変数に依存しない式はコンパイルしても意味がないので木の評価に任せる
+		if (!boost::apply_visitor(compiler, expr) || compiler.result.constant)
+		{
+			tape.clear();
+			return false;
+		}
+
+		//最後の命令の結果を式全体の評価値とする
+		if (compiler.result.reg + 1 != static_cast<int>(tape.instructions.size()))
+		{
+			SatExprTape::Instruction inst;
+			inst.op = SatExprTape::OpCode::Add;
+			inst.lhs = compiler.result.reg;
+			inst.rhs = compiler.toRegister(Operand{ -1, Val(0.0) });
+			tape.push(inst);
+		}
+
+		return true;
+	}
+
+	int SatExprCompiler::toRegister(const Operand& operand)
+	{
+		if (!operand.constant)
+		{
+			return operand.reg;
+		}
+
+		SatExprTape::Instruction inst;
+		inst.op = SatExprTape::OpCode::Constant;
+		inst.value = AsDouble(ToCost(operand.constant.get()));
+		return tape.push(inst);
+	}
+
+	int SatExprCompiler::pushBinary(SatExprTape::OpCode op, int lhs, int rhs)
+	{
+		SatExprTape::Instruction inst;
+		inst.op = op;
+		inst.lhs = lhs;
+		inst.rhs = rhs;
+		return tape.push(inst);
+	}
+
+	bool SatExprCompiler::compileAddress(Address address)
+	{
+		if (!address.isValid())
+		{
+			return false;
+		}
+
+		auto it = invRefs.find(address);
+		if (it != invRefs.end())
+		{
+			SatExprTape::Instruction inst;
+			inst.op = SatExprTape::OpCode::Load;
+			inst.lhs = it->second;
+			result = Operand{ tape.push(inst), boost::none };
+			return true;
+		}
+
+		const auto opt = pEnv->expandOpt(LRValue(address));
+		if (!opt || !(IsNum(opt.get()) || IsType<bool>(opt.get())))
+		{
+			return false;
+		}
+
+		result = Operand{ -1, opt.get() };
+		return true;
+	}
+
+	bool SatExprCompiler::compileBuiltInCall(Address functionAddress, const std::vector<Expr>& actualArguments)
+	{
+		if (actualArguments.size() != 1)
+		{
+			return false;
+		}
+
+		const TapeBuiltInFunction* pFunction = TapeBuiltInFunctionsByIndex()[Context::BuiltInFunctionIndex(functionAddress)];
+		if (!pFunction || !boost::apply_visitor(*this, actualArguments.front()))
+		{
+			return false;
+		}
+
+		const Operand argument = result;
+		if (argument.constant)
+		{
+			if (!IsNum(argument.constant.get()))
+			{
+				return false;
+			}
+
+			result = Operand{ -1, Val(pFunction->func(AsDouble(argument.constant.get()))) };
+			return true;
+		}
+
+		SatExprTape::Instruction inst;
+		inst.op = SatExprTape::OpCode::Call;
+		inst.lhs = argument.reg;
+		inst.func = pFunction->func;
+		inst.derivative = pFunction->derivative;
+		result = Operand{ tape.push(inst), boost::none };
+		return true;
+	}
+
+	bool SatExprCompiler::compileMinMaxCall(const FuncVal& function, const std::vector<Expr>& actualArguments)
+	{
+		const auto opOpt = MatchMinMaxFunction(function);
+		if (!opOpt || actualArguments.size() != 2)
+		{
+			return false;
+		}
+
+		//関数呼び出しでは引数を左から評価する
+		if (!boost::apply_visitor(*this, actualArguments[0]))
+		{
+			return false;
+		}
+		const Operand lhs = result;
+
+		if (!boost::apply_visitor(*this, actualArguments[1]))
+		{
+			return false;
+		}
+		const Operand rhs = result;
+
+		if ((lhs.constant && !IsNum(lhs.constant.get())) || (rhs.constant && !IsNum(rhs.constant.get())))
+		{
+			return false;
+		}
+
+		if (lhs.constant && rhs.constant)
+		{
+			const bool isMin = opOpt.get() == SatExprTape::OpCode::Min;
+			result = Operand{ -1, isMin ? MinFunc(lhs.constant.get(), rhs.constant.get(), *pEnv) : MaxFunc(lhs.constant.get(), rhs.constant.get(), *pEnv) };
+			return true;
+		}
+
+		result = Operand{ pushBinary(opOpt.get(), toRegister(lhs), toRegister(rhs)), boost::none };
+		return true;
+	}
+
+	bool SatExprCompiler::operator()(const LRValue& node)
+	{
+		if (node.isRValue())
+		{
+			const Val& value = node.evaluated();
+			if (!(IsNum(value) || IsType<bool>(value)))
+			{
+				return false;
+			}
+
+			result = Operand{ -1, value };
+			return true;
+		}
+
+		const auto addressOpt = node.deref(*pEnv);
+		return addressOpt && compileAddress(addressOpt.get());
+	}
+
+	bool SatExprCompiler::operator()(const Identifier& node)
+	{
+		if (node.isMakeClosure())
+		{
+			return false;
+		}
+
+		return compileAddress(pEnv->findAddress(node));
+	}
+
+	bool SatExprCompiler::operator()(const UnaryExpr& node)
+	{
+		if (node.op != UnaryOp::Plus && node.op != UnaryOp::Minus)
+		{
+			return false;
+		}
+
+		if (!boost::apply_visitor(*this, node.lhs))
+		{
+			return false;
+		}
+
+		if (node.op == UnaryOp::Plus)
+		{
+			return true;
+		}
+
+		if (result.constant)
+		{
+			if (!IsNum(result.constant.get()))
+			{
+				return false;
+			}
+
+			result.constant = MinusFunc(result.constant.get(), *pEnv);
+			return true;
+		}
+
+		SatExprTape::Instruction inst;
+		inst.op = SatExprTape::OpCode::Minus;
+		inst.lhs = result.reg;
+		result = Operand{ tape.push(inst), boost::none };
+		return true;
+	}
+
+	bool SatExprCompiler::operator()(const BinaryExpr& node)
+	{
+		using OpCode = SatExprTape::OpCode;
+
+		switch (node.op)
+		{
+		case BinaryOp::And: case BinaryOp::Or:
+		case BinaryOp::Equal:
+		case BinaryOp::LessThan: case BinaryOp::LessEqual:
+		case BinaryOp::GreaterThan: case BinaryOp::GreaterEqual:
+		case BinaryOp::Add: case BinaryOp::Sub: case BinaryOp::Mul: case BinaryOp::Div:
+		case BinaryOp::Pow:
+			break;
+		default:
+			return false;
+		}
+
+		//EvalSatExprと同じく右辺から評価する
+		if (!boost::apply_visitor(*this, node.rhs))
+		{
+			return false;
+		}
+		const Operand rhs = result;
+
+		if (!boost::apply_visitor(*this, node.lhs))
+		{
+			return false;
+		}
+		const Operand lhs = result;
+
+		//両辺が定数の場合はコンパイル時に畳み込む
+		if (lhs.constant && rhs.constant)
+		{
+			const Val a = ToCost(lhs.constant.get());
+			const Val b = ToCost(rhs.constant.get());
+			if (!IsNum(a) || !IsNum(b))
+			{
+				return false;
+			}
+
+			Val folded;
+			switch (node.op)
+			{
+			case BinaryOp::And: folded = AddFunc(a, b, *pEnv); break;
+			case BinaryOp::Or:  folded = MinFunc(a, b, *pEnv); break;
+
+			case BinaryOp::Equal:        folded = AbsFunc(SubFunc(a, b, *pEnv), *pEnv); break;
+			case BinaryOp::LessThan:     folded = MaxFunc(SubFunc(a, b, *pEnv), 0.0, *pEnv); break;
+			case BinaryOp::LessEqual:    folded = MaxFunc(SubFunc(a, b, *pEnv), 0.0, *pEnv); break;
+			case BinaryOp::GreaterThan:  folded = MaxFunc(SubFunc(b, a, *pEnv), 0.0, *pEnv); break;
+			case BinaryOp::GreaterEqual: folded = MaxFunc(SubFunc(b, a, *pEnv), 0.0, *pEnv); break;
+
+			case BinaryOp::Add: folded = AddFunc(a, b, *pEnv); break;
+			case BinaryOp::Sub: folded = SubFunc(a, b, *pEnv); break;
+			case BinaryOp::Mul: folded = MulFunc(a, b, *pEnv); break;
+			case BinaryOp::Div: folded = DivFunc(a, b, *pEnv); break;
+			case BinaryOp::Pow: folded = PowFunc(a, b, *pEnv); break;
+			default: return false;
+			}
+
+			result = Operand{ -1, folded };
+			return true;
+		}
+
+		//片方がfree変数に依存する場合、もう一方が数値でない式は扱わない
+		if ((lhs.constant && !IsNum(ToCost(lhs.constant.get()))) || (rhs.constant && !IsNum(ToCost(rhs.constant.get()))))
+		{
+			return false;
+		}
+
+		const int a = toRegister(lhs);
+		const int b = toRegister(rhs);
+
+		switch (node.op)
+		{
+		case BinaryOp::And: result = Operand{ pushBinary(OpCode::Add, a, b), boost::none }; break;
+		case BinaryOp::Or:  result = Operand{ pushBinary(OpCode::Min, a, b), boost::none }; break;
+
+		case BinaryOp::Equal:
+			result = Operand{ pushBinary(OpCode::Abs, pushBinary(OpCode::Sub, a, b), -1), boost::none }; break;
+		case BinaryOp::LessThan: case BinaryOp::LessEqual:
+			result = Operand{ pushBinary(OpCode::Max, pushBinary(OpCode::Sub, a, b), toRegister(Operand{ -1, Val(0.0) })), boost::none }; break;
+		case BinaryOp::GreaterThan: case BinaryOp::GreaterEqual:
+			result = Operand{ pushBinary(OpCode::Max, pushBinary(OpCode::Sub, b, a), toRegister(Operand{ -1, Val(0.0) })), boost::none }; break;
+
+		case BinaryOp::Add: result = Operand{ pushBinary(OpCode::Add, a, b), boost::none }; break;
+		case BinaryOp::Sub: result = Operand{ pushBinary(OpCode::Sub, a, b), boost::none }; break;
+		case BinaryOp::Mul: result = Operand{ pushBinary(OpCode::Mul, a, b), boost::none }; break;
+		case BinaryOp::Div: result = Operand{ pushBinary(OpCode::Div, a, b), boost::none }; break;
+		case BinaryOp::Pow: result = Operand{ pushBinary(OpCode::Pow, a, b), boost::none }; break;
+		default: return false;
+		}
+
+		return true;
+	}
+
+	bool SatExprCompiler::operator()(const Accessor& node)
+	{
+		//先頭が識別子かアドレスで、アクセスがコンパイル時に一意に辿れるものだけを扱う
+		Address address;
+		if (auto headOpt = AsOpt<Identifier>(node.head))
+		{
+			if (headOpt.get().isMakeClosure())
+			{
+				return false;
+			}
+			address = pEnv->findAddress(headOpt.get());
+		}
+		else if (auto headOpt = AsOpt<LRValue>(node.head))
+		{
+			if (!headOpt.get().isLValue())
+			{
+				return false;
+			}
+			const auto addressOpt = headOpt.get().deref(*pEnv);
+			if (!addressOpt)
+			{
+				return false;
+			}
+			address = addressOpt.get();
+		}
+		else
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < node.accesses.size(); ++i)
+		{
+			if (!address.isValid() || invRefs.find(address) != invRefs.end())
+			{
+				return false;
+			}
+
+			const auto objOpt = pEnv->expandOpt(LRValue(address));
+			if (!objOpt)
+			{
+				return false;
+			}
+			const Val& obj = objOpt.get();
+			const auto& access = node.accesses[i];
+
+			if (auto listAccessOpt = AsOpt<ListAccess>(access))
+			{
+				const ListAccess& listAccess = listAccessOpt.get();
+				if (listAccess.isArbitrary || !IsType<List>(obj))
+				{
+					return false;
+				}
+
+				if (!boost::apply_visitor(*this, listAccess.index) || !result.constant || !IsType<int>(result.constant.get()))
+				{
+					return false;
+				}
+
+				const List& list = As<List>(obj);
+				const int index = As<int>(result.constant.get());
+				if (index < 0 || static_cast<int>(list.data.size()) <= index)
+				{
+					return false;
+				}
+				address = list.get(index);
+			}
+			else if (auto recordAccessOpt = AsOpt<RecordAccess>(access))
+			{
+				if (!IsType<Record>(obj))
+				{
+					return false;
+				}
+
+				const Record& record = As<Record>(obj);
+				auto it = record.values.find(recordAccessOpt.get().name);
+				if (it == record.values.end())
+				{
+					return false;
+				}
+				address = it->second;
+			}
+			else if (auto funcAccessOpt = AsOpt<FunctionAccess>(access))
+			{
+				//関数呼び出しは末尾にある場合のみ扱う
+				if (!IsType<FuncVal>(obj) || i + 1 != node.accesses.size())
+				{
+					return false;
+				}
+
+				const FuncVal& function = As<FuncVal>(obj);
+				if (function.builtinFuncAddress)
+				{
+					return compileBuiltInCall(function.builtinFuncAddress.get(), funcAccessOpt.get().actualArguments);
+				}
+
+				return compileMinMaxCall(function, funcAccessOpt.get().actualArguments);
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return compileAddress(address);
+	}
+
+	bool SatExprHoister::dependsOnFreeVariable(const Expr& node)const
+	{
+		//制約全体の参照IDを書き換えないように、作業用の集合で調べる
+		std::vector<char> usedInSat(freeVariables.size(), 0);
+		std::vector<Address> refs;
+		std::unordered_set<Address> refsSet;
+		std::unordered_map<Address, int> invRefs;
+		bool hasPlateausFunction = false;
+
+		SatVariableBinder binder(pEnv, freeVariables, usedInSat, refs, refsSet, invRefs, hasPlateausFunction);
+		return boost::apply_visitor(binder, node);
+	}
+
+	boost::optional<Expr> SatExprHoister::tryFold(const Expr& node, const LocationInfo& info, size_t foldedChildren)
+	{
+		boost::optional<Val> value;
+		pEnv->switchFrontScope();
+		pEnv->enterScope();
+		try
+		{
+			Eval evaluator(pEnv);
+			value = pEnv->expand(boost::apply_visitor(evaluator, node), info);
+		}
+		catch (const std::exception&)
+		{
+			//評価できない場合は元の式のまま求解中に評価する
+			value = boost::none;
+		}
+		pEnv->exitScope();
+		pEnv->switchBackScope();
+
+		if (!value || !(IsNum(value.get()) || IsType<bool>(value.get())))
+		{
+			return boost::none;
+		}
+
+		//子を置き換えた分はこの部分式にまとめられる
+		hoistedCount = hoistedCount - foldedChildren + 1;
+		isFolded = true;
+		return Expr(LRValue(value.get()).setLocation(info));
+	}
+
+	Expr SatExprHoister::leaf(const Expr& node)
+	{
+		isDependent = dependsOnFreeVariable(node);
+		isFolded = false;
+		return node;
+	}
+
+	Expr SatExprHoister::operator()(const UnaryExpr& node)
+	{
+		if (node.op != UnaryOp::Plus && node.op != UnaryOp::Minus)
+		{
+			return leaf(node);
+		}
+
+		const Expr lhs = boost::apply_visitor(*this, node.lhs);
+		const size_t foldedChildren = isFolded ? 1 : 0;
+
+		const Expr result = UnaryExpr(lhs, node.op).setLocation(node);
+		isFolded = false;
+		if (!isDependent)
+		{
+			if (auto folded = tryFold(result, node, foldedChildren))
+			{
+				return folded.get();
+			}
+		}
+
+		return result;
+	}
+
+	Expr SatExprHoister::operator()(const BinaryExpr& node)
+	{
+		bool isArithmetic = false;
+		switch (node.op)
+		{
+		//比較と論理演算はEvalSatExprではコストとして評価されるので、値にはせず子だけを調べる
+		case BinaryOp::And: case BinaryOp::Or:
+		case BinaryOp::Equal: case BinaryOp::NotEqual:
+		case BinaryOp::LessThan: case BinaryOp::LessEqual:
+		case BinaryOp::GreaterThan: case BinaryOp::GreaterEqual:
+			break;
+		case BinaryOp::Add: case BinaryOp::Sub: case BinaryOp::Mul: case BinaryOp::Div:
+		case BinaryOp::Pow:
+			isArithmetic = true;
+			break;
+		default:
+			return leaf(node);
+		}
+
+		const Expr lhs = boost::apply_visitor(*this, node.lhs);
+		const bool lhsDependent = isDependent;
+		size_t foldedChildren = isFolded ? 1 : 0;
+
+		const Expr rhs = boost::apply_visitor(*this, node.rhs);
+		foldedChildren += isFolded ? 1 : 0;
+
+		const Expr result = BinaryExpr(lhs, rhs, node.op).setLocation(node);
+		isDependent = lhsDependent || isDependent;
+		isFolded = false;
+		if (isArithmetic && !isDependent)
+		{
+			if (auto folded = tryFold(result, node, foldedChildren))
+			{
+				return folded.get();
+			}
+		}
+
+		return result;
+	}
+
+	Expr SatExprHoister::operator()(const Accessor& node)
+	{
+		//アクセッサ全体がfree変数に依存する場合も、添字や引数の中に独立な部分式があれば置き換える
+		bool hasDependentAccess = false;
+		size_t foldedChildren = 0;
+
+		Accessor result(node.head);
+		result.setLocation(node);
+		for (const auto& access : node.accesses)
+		{
+			if (auto listAccessOpt = AsOpt<ListAccess>(access))
+			{
+				ListAccess listAccess = listAccessOpt.get();
+				if (!listAccess.isArbitrary)
+				{
+					listAccess.index = boost::apply_visitor(*this, listAccess.index);
+					hasDependentAccess = hasDependentAccess || isDependent;
+					foldedChildren += isFolded ? 1 : 0;
+				}
+				result.accesses.push_back(listAccess);
+			}
+			else if (auto funcAccessOpt = AsOpt<FunctionAccess>(access))
+			{
+				FunctionAccess funcAccess;
+				for (const auto& argument : funcAccessOpt.get().actualArguments)
+				{
+					funcAccess.add(boost::apply_visitor(*this, argument));
+					hasDependentAccess = hasDependentAccess || isDependent;
+					foldedChildren += isFolded ? 1 : 0;
+				}
+				result.accesses.push_back(funcAccess);
+			}
+			else
+			{
+				result.accesses.push_back(access);
+			}
+		}
+
+		//添字や引数が依存していればアクセッサも依存するとみなす（置き換えない側に倒すだけなので安全）
+		//そうでなければ添字や引数は既に定数になっているので、残りの先頭と呼び出す関数の中身だけを調べることになる
+		isDependent = hasDependentAccess || dependsOnFreeVariable(result);
+		isFolded = false;
+		if (!isDependent)
+		{
+			if (auto folded = tryFold(result, node, foldedChildren))
+			{
+				return folded.get();
+			}
+		}
+
+		return result;
+	}
+
+	boost::optional<Address> PairwiseAvoidRewriter::ResolveAddress(std::shared_ptr<Context> pEnv, const Expr& expr)
+	{
+		if (auto identifierOpt = AsOpt<Identifier>(expr))
+		{
+			if (identifierOpt.get().isMakeClosure())
+			{
+				return boost::none;
+			}
+			const Address address = pEnv->findAddress(identifierOpt.get());
+			return address.isValid() ? boost::optional<Address>(address) : boost::none;
+		}
+		else if (auto lrvalueOpt = AsOpt<LRValue>(expr))
+		{
+			if (!lrvalueOpt.get().isLValue())
+			{
+				return boost::none;
+			}
+			return lrvalueOpt.get().deref(*pEnv);
+		}
+
+		return boost::none;
+	}
+
+	bool PairwiseAvoidRewriter::IsAvoidFunction(std::shared_ptr<Context> pEnv, const Expr& head)
+	{
+		static const boost::optional<Address> avoidAddress = []()->boost::optional<Address>
+		{
+			const Context::BuiltInFunctionTable& builtInFunctions = Context::BuiltInFunctions();
+			for (size_t i = 0; i < builtInFunctions.size(); ++i)
+			{
+				if (builtInFunctions[i].name == "Avoid")
+				{
+					return Context::BuiltInFunctionAddress(i);
+				}
+			}
+			return boost::none;
+		}();
+
+		const auto addressOpt = ResolveAddress(pEnv, head);
+		if (!avoidAddress || !addressOpt)
+		{
+			return false;
+		}
+
+		const auto funcOpt = pEnv->expandOpt(LRValue(addressOpt.get()));
+		if (!funcOpt || !IsType<FuncVal>(funcOpt.get()))
+		{
+			return false;
+		}
+
+		const FuncVal& function = As<FuncVal>(funcOpt.get());
+		return function.builtinFuncAddress && function.builtinFuncAddress.get() == avoidAddress.get();
+	}
+
+	boost::optional<std::pair<Address, int>> PairwiseAvoidRewriter::MatchListElement(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs)
+	{
+		const auto accessorOpt = AsOpt<Accessor>(expr);
+		if (!accessorOpt || accessorOpt.get().accesses.size() != 1)
+		{
+			return boost::none;
+		}
+		const Accessor& accessor = accessorOpt.get();
+
+		const auto listAccessOpt = AsOpt<ListAccess>(accessor.accesses.front());
+		if (!listAccessOpt || listAccessOpt.get().isArbitrary)
+		{
+			return boost::none;
+		}
+
+		const auto listAddressOpt = ResolveAddress(pEnv, accessor.head);
+		if (!listAddressOpt || invRefs.find(listAddressOpt.get()) != invRefs.end())
+		{
+			return boost::none;
+		}
+
+		const auto listOpt = pEnv->expandOpt(LRValue(listAddressOpt.get()));
+		if (!listOpt || !IsType<List>(listOpt.get()))
+		{
+			return boost::none;
+		}
+
+		//添字はsat式の評価中に変わらない整数の定数に限る
+		boost::optional<Val> indexOpt;
+		const Expr& index = listAccessOpt.get().index;
+		const auto lrvalueOpt = AsOpt<LRValue>(index);
+		if (lrvalueOpt && lrvalueOpt.get().isRValue())
+		{
+			indexOpt = lrvalueOpt.get().evaluated();
+		}
+		else if (const auto indexAddressOpt = ResolveAddress(pEnv, index))
+		{
+			if (invRefs.find(indexAddressOpt.get()) == invRefs.end())
+			{
+				if (auto opt = pEnv->expandOpt(LRValue(indexAddressOpt.get())))
+				{
+					indexOpt = opt.get();
+				}
+			}
+		}
+
+		if (!indexOpt || !IsType<int>(indexOpt.get()))
+		{
+			return boost::none;
+		}
+
+		const int i = As<int>(indexOpt.get());
+		if (i < 0 || static_cast<int>(As<List>(listOpt.get()).data.size()) <= i)
+		{
+			return boost::none;
+		}
+
+		return std::make_pair(listAddressOpt.get(), i);
+	}
+
+	boost::optional<PairwiseAvoidRewriter::Pair> PairwiseAvoidRewriter::MatchPairwiseAvoid(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs)
+	{
+		const auto accessorOpt = AsOpt<Accessor>(expr);
+		if (!accessorOpt || accessorOpt.get().accesses.size() != 1)
+		{
+			return boost::none;
+		}
+		const Accessor& accessor = accessorOpt.get();
+
+		const auto funcAccessOpt = AsOpt<FunctionAccess>(accessor.accesses.front());
+		if (!funcAccessOpt || funcAccessOpt.get().actualArguments.size() != 2 || !IsAvoidFunction(pEnv, accessor.head))
+		{
+			return boost::none;
+		}
+
+		const auto& arguments = funcAccessOpt.get().actualArguments;
+		const auto lhs = MatchListElement(pEnv, arguments[0], invRefs);
+		const auto rhs = MatchListElement(pEnv, arguments[1], invRefs);
+		if (!lhs || !rhs || lhs.get().first != rhs.get().first || lhs.get().second == rhs.get().second)
+		{
+			return boost::none;
+		}
+
+		//Avoidは対称なので添字の小さい方を先にする
+		Pair pair;
+		pair.list = lhs.get().first;
+		pair.i = std::min(lhs.get().second, rhs.get().second);
+		pair.j = std::max(lhs.get().second, rhs.get().second);
+		return pair;
+	}
+
+	boost::optional<Expr> PairwiseAvoidRewriter::Rewrite(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs)
+	{
+		ConjunctionSeparater separater;
+		boost::apply_visitor(separater, expr);
+		const std::vector<Expr>& units = separater.conjunctions;
+
+		//リストごとに、Avoidの単位制約とそれが指す要素の組を集める
+		std::unordered_map<Address, std::vector<std::pair<size_t, Pair>>> pairsOfList;
+		for (size_t unitID = 0; unitID < units.size(); ++unitID)
+		{
+			if (const auto pairOpt = MatchPairwiseAvoid(pEnv, units[unitID], invRefs))
+			{
+				pairsOfList[pairOpt.get().list].emplace_back(unitID, pairOpt.get());
+			}
+		}
+
+		//置き換える単位制約 -> 置き換え後の式（noneの場合は取り除く）
+		std::unordered_map<size_t, boost::optional<Expr>> replacements;
+		for (const auto& keyval : pairsOfList)
+		{
+			const auto& pairs = keyval.second;
+			const size_t n = As<List>(pEnv->expand(LRValue(keyval.first), LocationInfo())).data.size();
+			if (n < 2 || pairs.size() != n*(n - 1) / 2)
+			{
+				continue;
+			}
+
+			std::vector<char> appeared(n*n, 0);
+			bool coversAllPairs = true;
+			for (const auto& unitPair : pairs)
+			{
+				char& flag = appeared[unitPair.second.i*n + unitPair.second.j];
+				if (flag)
+				{
+					coversAllPairs = false;
+					break;
+				}
+				flag = 1;
+			}
+			if (!coversAllPairs)
+			{
+				continue;
+			}
+
+			//最初に現れた単位制約の位置にAvoid(list)を置き、残りは取り除く
+			const Accessor& first = As<Accessor>(units[pairs.front().first]);
+			Accessor avoidList(first.head);
+			avoidList.setLocation(first);
+			avoidList.add(FunctionAccess().add(LRValue(keyval.first)));
+
+			replacements[pairs.front().first] = Expr(avoidList);
+			for (size_t k = 1; k < pairs.size(); ++k)
+			{
+				replacements[pairs[k].first] = boost::none;
+			}
+		}
+
+		if (replacements.empty())
+		{
+			return boost::none;
+		}
+
+		boost::optional<Expr> result;
+		for (size_t unitID = 0; unitID < units.size(); ++unitID)
+		{
+			auto it = replacements.find(unitID);
+			if (it != replacements.end() && !it->second)
+			{
+				continue;
+			}
+
+			const Expr& unit = it != replacements.end() ? it->second.get() : units[unitID];
+			result = result ? Expr(BinaryExpr(result.get(), unit, BinaryOp::And)) : unit;
+		}
+
+		return result;
+	}
+
+	std::string SatExprCanonicalizer::Canonicalize(std::shared_ptr<Context> pEnv, const Expr& expr, const std::unordered_map<Address, int>& invRefs)
+	{
+		std::stringstream ss;
+		ss << std::setprecision(17);
+		SatExprCanonicalizer canonicalizer(pEnv, invRefs, ss);
+		boost::apply_visitor(canonicalizer, expr);
+		return ss.str();
+	}
+
+	void SatExprCanonicalizer::writeAddress(Address address)
+	{
+		auto it = invRefs.find(address);
+		if (it != invRefs.end())
+		{
+			os << "$" << it->second;
+			return;
+		}
+
+		if (address.isValid())
+		{
+			if (const auto opt = pEnv->expandOpt(LRValue(address)))
+			{
+				printVal2(opt.get(), pEnv, os);
+				return;
+			}
+		}
+
+		os << "?";
+	}
+
+	void SatExprCanonicalizer::writeOther(const Expr& node)
+	{
+		os << exprStr2(node, pEnv);
+	}
+
+	void SatExprCanonicalizer::operator()(const LRValue& node)
+	{
+		if (node.isRValue())
+		{
+			printVal2(node.evaluated(), pEnv, os);
+			return;
+		}
+
+		const auto addressOpt = node.deref(*pEnv);
+		writeAddress(addressOpt ? addressOpt.get() : Address());
+	}
+
+	void SatExprCanonicalizer::operator()(const Identifier& node)
+	{
+		os << static_cast<std::string>(node);
+		if (!node.isMakeClosure())
+		{
+			//組み込み関数は値からは区別できないので名前と値の両方を書く
+			os << "=";
+			writeAddress(pEnv->findAddress(node));
+		}
+	}
+
+	void SatExprCanonicalizer::operator()(const UnaryExpr& node)
+	{
+		os << UnaryOpToStr(node.op) << "(";
+		boost::apply_visitor(*this, node.lhs);
+		os << ")";
+	}
+
+	void SatExprCanonicalizer::operator()(const BinaryExpr& node)
+	{
+		os << BinaryOpToStr(node.op) << "(";
+		boost::apply_visitor(*this, node.lhs);
+		os << ",";
+		boost::apply_visitor(*this, node.rhs);
+		os << ")";
+	}
+
+	void SatExprCanonicalizer::operator()(const ListConstractor& node)
+	{
+		os << "[";
+		for (const auto& expr : node.data)
+		{
+			boost::apply_visitor(*this, expr);
+			os << ",";
+		}
+		os << "]";
+	}
+
+	void SatExprCanonicalizer::operator()(const Accessor& node)
+	{
+		boost::apply_visitor(*this, node.head);
+
+		for (const auto& access : node.accesses)
+		{
+			if (auto listAccessOpt = AsOpt<ListAccess>(access))
+			{
+				os << "[";
+				if (listAccessOpt.get().isArbitrary)
+				{
+					os << "*";
+				}
+				else
+				{
+					boost::apply_visitor(*this, listAccessOpt.get().index);
+				}
+				os << "]";
+			}
+			else if (auto recordAccessOpt = AsOpt<RecordAccess>(access))
+			{
+				os << "." << static_cast<std::string>(recordAccessOpt.get().name);
+			}
+			else if (auto funcAccessOpt = AsOpt<FunctionAccess>(access))
+			{
+				os << "(";
+				for (const auto& argument : funcAccessOpt.get().actualArguments)
+				{
+					boost::apply_visitor(*this, argument);
+					os << ",";
+				}
+				os << ")";
+			}
+			else
+			{
+				os << "{";
+				writeOther(As<InheritAccess>(access).adder);
+				os << "}";
+			}
+		}
+	}
+
 	boost::optional<double> EvalSatExpr::expandFreeOpt(Address address)const
 	{
 		auto it = invRefs.find(address);
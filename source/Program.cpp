@@ -20,23 +20,24 @@
 #include <Pita/Vectorizer.hpp>
 #include <Pita/Printer.hpp>
 
-#ifdef __has_include
-#  if __has_include(<Pita/PitaStd>)
-#    define CGL_HAS_STANDARD_FILE
-#  endif
-#endif
-
 bool calculating;
 int constraintViolationCount;
 bool isDebugMode;
 bool isBlockingMode;
 bool isContextFreeMode;
-bool isInConstraint = false;
+thread_local bool isInConstraint = false;
 bool isDumpParseTree = false;
+bool isPortfolioMode = false;
+bool isBinaryPreEvaluation = false;
+bool useConvexFastPath = true;
+bool useParallelConstraintGroups = true;
+bool useParallelCmaesEvaluation = true;
+bool useIncrementalUnitConstraints = true;
+std::string solutionCacheDirectory;
 
 bool printAddressInsertion = false;
-double cloneTime = 0.0;
-unsigned cloneCount = 0;
+thread_local double cloneTime = 0.0;
+thread_local unsigned cloneCount = 0;
 
 namespace cgl
 {
@@ -303,35 +304,59 @@ namespace cgl
 	}
 #endif
 
-#ifdef CGL_HAS_STANDARD_FILE
-	Program::Program() :
-		pEnv(Context::Make()),
-		isInitialized(true)
+	namespace
 	{
-		std::cout << "load PitaStd ..." << std::endl;
-		std::vector<std::string> pitaStdSplitted({
-#include <Pita/PitaStd>
-			});
+		//埋め込んだバイト列をコピーせずにistreamとして読むためのバッファ
+		class MemoryStreamBuffer : public std::streambuf
+		{
+		public:
+			MemoryStreamBuffer(const unsigned char* data, size_t size)
+			{
+				char* begin = reinterpret_cast<char*>(const_cast<unsigned char*>(data));
+				setg(begin, begin, begin + size);
+			}
+		};
 
-		std::stringstream ss;
-		for (const auto& str : pitaStdSplitted)
+		//ContextをPortableBinary形式で書き出し、配列の初期化子として#includeできるカンマ区切りのバイト列で出力する
+		bool WriteBinarySnapshot(Context& context, const std::string& output_filename)
 		{
-			ss << str;
+			std::stringstream ss;
+			{
+				cereal::PortableBinaryOutputArchive ar(ss);
+				ar(context);
+			}
+
+			const std::string bytes = ss.str();
+			std::ofstream ofs(output_filename);
+			for (size_t i = 0; i < bytes.size(); ++i)
+			{
+				ofs << static_cast<int>(static_cast<unsigned char>(bytes[i])) << ',';
+				if ((i + 1) % 32 == 0)
+				{
+					ofs << '\n';
+				}
+			}
+
+			return static_cast<bool>(ofs);
 		}
+	}
+
+	void Program::loadBinarySnapshot(const unsigned char* data, size_t size)
+	{
+		MemoryStreamBuffer buffer(data, size);
+		std::istream is(&buffer);
 
-		cereal::JSONInputArchive ar(ss);
+		cereal::PortableBinaryInputArchive ar(is);
 		Context& context = *pEnv;
 		ar(context);
 
-		/*google::InitGoogleLogging("pita");
-		google::InstallFailureSignalHandler();*/
+		isInitialized = true;
+	}
+
+	bool Program::writeBinarySnapshot(const std::string& output_filename)const
+	{
+		return WriteBinarySnapshot(*pEnv, output_filename);
 	}
-#else
-	Program::Program() :
-		pEnv(Context::Make()),
-		isInitialized(false)
-	{}
-#endif
 
 	inline std::vector<std::string> SplitStringVSCompatible(const std::string& str)
 	{
@@ -417,6 +442,11 @@ namespace cgl
 						std::cerr << "parse     : " << profileTime.parseSec << "[sec]" << std::endl;
 						std::cerr << "execute   : " << profileTime.executeSec << "[sec]" << std::endl;
 						std::cerr << "output    : " << profileTime.outputSec << "[sec]" << std::endl;
+						{
+							const GCTelemetry& gc = pEnv->gcTelemetry();
+							std::cerr << "gc        : " << gc.youngPauseSec + gc.fullPauseSec << "[sec] (young " << gc.youngCount << ", full " << gc.fullCount
+								<< ", max pause " << gc.maxPauseSec << "[sec], collected " << gc.collectedValues << ")" << std::endl;
+						}
 
 						succeeded = true;
 					}
@@ -649,6 +679,95 @@ namespace cgl
 		return boost::none;
 	}
 
+	namespace
+	{
+		//JSONの文字列リテラルとして書き出す（パスや式に含まれる引用符や制御文字をエスケープする）
+		std::string JsonString(const std::string& str)
+		{
+			std::stringstream ss;
+			ss << '"';
+			for (const char c : str)
+			{
+				switch (c)
+				{
+				case '"':  ss << "\\\""; break;
+				case '\\': ss << "\\\\"; break;
+				case '\b': ss << "\\b"; break;
+				case '\f': ss << "\\f"; break;
+				case '\n': ss << "\\n"; break;
+				case '\r': ss << "\\r"; break;
+				case '\t': ss << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+					}
+					else
+					{
+						ss << c;
+					}
+				}
+			}
+			ss << '"';
+			return ss.str();
+		}
+
+		//JSONはNaNやinfを表せないのでnullとして書き出す
+		std::string JsonNumber(double value)
+		{
+			if (!std::isfinite(value))
+			{
+				return "null";
+			}
+
+			std::stringstream ss;
+			ss << std::setprecision(17) << value;
+			return ss.str();
+		}
+	}
+
+	void Program::outputSolverTelemetry(std::ostream& os)const
+	{
+		const auto locationStr = [](const LocationInfo& info)
+		{
+			std::stringstream ss;
+			ss << "{\"lineBegin\": " << info.locInfo_lineBegin << ", \"lineEnd\": " << info.locInfo_lineEnd
+				<< ", \"posBegin\": " << info.locInfo_posBegin << ", \"posEnd\": " << info.locInfo_posEnd << "}";
+			return ss.str();
+		};
+
+		const auto& telemetries = solverTelemetry();
+
+		os << std::setprecision(17);
+		os << "{\n";
+		os << "\t\"profile\": {\"parseSec\": " << JsonNumber(profileTime.parseSec) << ", \"executeSec\": " << JsonNumber(profileTime.executeSec) << ", \"outputSec\": " << JsonNumber(profileTime.outputSec) << "},\n";
+		{
+			const GCTelemetry& gc = pEnv->gcTelemetry();
+			os << "\t\"gc\": {\"youngCount\": " << gc.youngCount << ", \"fullCount\": " << gc.fullCount
+				<< ", \"youngPauseSec\": " << JsonNumber(gc.youngPauseSec) << ", \"fullPauseSec\": " << JsonNumber(gc.fullPauseSec)
+				<< ", \"maxPauseSec\": " << JsonNumber(gc.maxPauseSec) << ", \"collectedValues\": " << gc.collectedValues << "},\n";
+		}
+		os << "\t\"constraints\": [";
+		for (size_t i = 0; i < telemetries.size(); ++i)
+		{
+			const auto& telemetry = telemetries[i];
+			os << (i == 0 ? "\n" : ",\n");
+			os << "\t\t{";
+			os << "\"location\": " << locationStr(telemetry.location);
+			os << ", \"freeVariables\": " << telemetry.numOfFreeVariables;
+			os << ", \"solver\": " << JsonString(telemetry.solver);
+			os << ", \"evaluations\": " << telemetry.evaluationCount;
+			os << ", \"meanEvaluationSec\": " << JsonNumber(telemetry.meanEvaluationSec());
+			os << ", \"iterations\": " << telemetry.iterationCount;
+			os << ", \"finalCost\": " << JsonNumber(telemetry.finalCost);
+			os << ", \"satisfied\": " << (telemetry.isSatisfied ? "true" : "false");
+			os << ", \"wallSec\": " << JsonNumber(telemetry.wallSec);
+			os << "}";
+		}
+		os << (telemetries.empty() ? "]\n" : "\n\t]\n");
+		os << "}\n";
+	}
+
 	bool Program::preEvaluate(const std::string& input_filename, const std::string& output_filename, bool logOutput)
 	{
 		clearState();
@@ -696,25 +815,32 @@ namespace cgl
 						std::cerr << "execute succeeded" << std::endl;
 					}
 
-					std::stringstream ss;
+					Context& context = *pEnv;
 					{
-						cereal::JSONOutputArchive ar(ss, cereal::JSONOutputArchive::Options::NoIndent());
-						Context& context = *pEnv;
-						{
-							context.m_globalFunctions.clear();
+						context.m_globalFunctions.clear();
 
-							for (const auto& env : context.m_localEnvStack)
+						for (const auto& env : context.m_localEnvStack)
+						{
+							for (auto scopeIt = env.begin(); scopeIt != env.end(); ++scopeIt)
 							{
-								for (auto scopeIt = env.begin(); scopeIt != env.end(); ++scopeIt)
+								for (const auto& var : scopeIt->variables)
 								{
-									for (const auto& var : scopeIt->variables)
-									{
-										context.m_globalFunctions.insert(var);
-									}
+									context.m_globalFunctions.insert(var);
 								}
 							}
 						}
+					}
+
+					//--binarySnapshot指定時はPortableBinary形式で書き出す
+					//pita_libに埋め込むPitaStdBinaryはビルド時にpita_snapshotが生成するので、この出力を手で配置する必要はない
+					if (isBinaryPreEvaluation)
+					{
+						return WriteBinarySnapshot(context, output_filename);
+					}
 
+					std::stringstream ss;
+					{
+						cereal::JSONOutputArchive ar(ss, cereal::JSONOutputArchive::Options::NoIndent());
 						ar(context);
 					}
 
@@ -773,47 +899,3 @@ namespace cgl
 		return false;
 	}
 }
-
-#ifdef __EMSCRIPTEN__
-#include <emscripten/emscripten.h>
-
-std::string pitaInputString;
-std::string pitaResultString;
-
-EMSCRIPTEN_KEEPALIVE
-void executePitaWithDebug(char* ptr, unsigned int length)
-{
-	std::cout << "run(debug mode): " << std::string(ptr, ptr + length) << std::endl;
-	isDebugMode = true;
-	cgl::Program program;
-	pitaResultString = program.executeAsString(std::string(ptr, ptr + length));
-}
-
-EMSCRIPTEN_KEEPALIVE
-void executePita(char* ptr, unsigned int length)
-{
-	std::cout << "run: " << std::string(ptr, ptr + length) << std::endl;
-	isDebugMode = false;
-	cgl::Program program;
-	pitaResultString = program.executeAsString(std::string(ptr, ptr + length));
-}
-
-EMSCRIPTEN_KEEPALIVE
-unsigned int getPitaResultPtr()
-{
-	return reinterpret_cast<unsigned>(pitaResultString.c_str());
-}
-
-EMSCRIPTEN_KEEPALIVE
-unsigned int getPitaResultLength()
-{
-	return pitaResultString.length();
-}
-
-EMSCRIPTEN_KEEPALIVE
-unsigned int getPitaInputPtr(unsigned int length)
-{
-	pitaInputString.resize(length);
-	return reinterpret_cast<unsigned>(pitaInputString.c_str());
-}
-#endif
\ No newline at end of file
@@ -16,10 +16,11 @@ namespace cgl
 		PackedRecord result;
 		auto& cs = path.cs;
 
-		PackedList polygonList;
+		PackedVertices polygonList;
+		polygonList.reserve(cs->size());
 		for (size_t i = 0; i < cs->size(); ++i)
 		{
-			polygonList.add(MakeRecord("x", cs->getX(i), "y", cs->getY(i)));
+			polygonList.add(cs->getX(i), cs->getY(i));
 		}
 
 		result.add("line", polygonList);
@@ -28,10 +29,10 @@ namespace cgl
 
 	PackedPolyData GetPolygonVertices(const gg::Polygon* poly)
 	{
-		std::vector<PackedList> result;
+		PackedPolyData result;
 
 		{
-			PackedList polygonList;
+			PackedVertices polygonList;
 			const gg::LineString* outer = poly->getExteriorRing();
 
 			//TODO: Geosの頂点の向きは決まっている？
@@ -41,7 +42,7 @@ namespace cgl
 				for (int i = 1; i < static_cast<int>(outer->getNumPoints()); ++i)
 				{
 					const gg::Coordinate& p = outer->getCoordinateN(i);
-					polygonList.add(MakeVec2(p.x, p.y));
+					polygonList.add(p.x, p.y);
 				}
 			}
 			else
@@ -49,7 +50,7 @@ namespace cgl
 				for (int i = static_cast<int>(outer->getNumPoints()) - 1; 0 < i; --i)
 				{
 					const gg::Coordinate& p = outer->getCoordinateN(i);
-					polygonList.add(MakeVec2(p.x, p.y));
+					polygonList.add(p.x, p.y);
 				}
 			}
 
@@ -58,7 +59,7 @@ namespace cgl
 
 		for (size_t i = 0; i < poly->getNumInteriorRing(); ++i)
 		{
-			PackedList holeVertexList;
+			PackedVertices holeVertexList;
 			const gg::LineString* hole = poly->getInteriorRingN(i);
 
 			if (IsClockWise(hole))
@@ -66,7 +67,7 @@ namespace cgl
 				for (int n = static_cast<int>(hole->getNumPoints()) - 1; 0 < n; --n)
 				{
 					gg::Point* pp = hole->getPointN(n);
-					holeVertexList.add(MakeVec2(pp->getX(), pp->getY()));
+					holeVertexList.add(pp->getX(), pp->getY());
 				}
 			}
 			else
@@ -74,7 +75,7 @@ namespace cgl
 				for (int n = 1; n < static_cast<int>(hole->getNumPoints()); ++n)
 				{
 					gg::Point* pp = hole->getPointN(n);
-					holeVertexList.add(MakeVec2(pp->getX(), pp->getY()));
+					holeVertexList.add(pp->getX(), pp->getY());
 				}
 			}
 
@@ -84,7 +85,7 @@ namespace cgl
 		return result;
 	}
 
-	PackedList AsPackedListPolygons(const std::vector<PackedList>& polygons)
+	PackedList AsPackedListPolygons(const PackedPolyData& polygons)
 	{
 		PackedList result;
 		for (const auto& polygon : polygons)
@@ -113,20 +114,16 @@ namespace cgl
 
 	PackedRecord GetLineStringPacked(const gg::LineString* line)
 	{
-		const auto appendCoord = [&](PackedList& list, double x, double y)
-		{
-			list.add(MakeRecord("x", x, "y", y));
-		};
-
 		PackedRecord result;
 		{
-			PackedList polygonList;
+			PackedVertices polygonList;
+			polygonList.reserve(line->getNumPoints());
 
 			//LineStringはPolygonと異なりループしない（頂点が重ならない）ので飛ばさずに読む
 			for (int i = 0; i < static_cast<int>(line->getNumPoints()); ++i)
 			{
 				const gg::Coordinate& p = line->getCoordinateN(i);
-				appendCoord(polygonList, p.x, p.y);
+				polygonList.add(p.x, p.y);
 			}
 
 			result.add("line", polygonList);
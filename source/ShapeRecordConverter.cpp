@@ -70,8 +70,24 @@ namespace cgl
 		if (itLine == pathRecord.values.end())
 			CGL_Error("不正な式です");
 
-		const PackedVal lineVal = itLine->second.value;
-		if (auto pointListOpt = AsOpt<PackedList>(lineVal))
+		const PackedVal& lineVal = itLine->second.value;
+		if (IsType<PackedVertices>(lineVal))
+		{
+			const auto& vertices = As<PackedVertices>(lineVal);
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				const auto xy_ = transform.product(Eigen::Vector2d(vertices.x(i), vertices.y(i)));
+				cs->add(gg::Coordinate(xy_.x(), xy_.y()));
+			}
+
+			distances.push_back(0);
+			for (int i = 1; i < cs->size(); ++i)
+			{
+				const double newDistance = cs->getAt(i - 1).distance(cs->getAt(i));
+				distances.push_back(distances.back() + newDistance);
+			}
+		}
+		else if (auto pointListOpt = AsOpt<PackedList>(lineVal))
 		{
 			for (const auto pointVal : pointListOpt.get().data)
 			{
@@ -2,6 +2,8 @@
 #define NOMINMAX
 #endif
 
+#include <mutex>
+
 #include <Eigen/Core>
 
 #include <geos/geom.h>
@@ -69,9 +71,33 @@ namespace cgl
 		Geometries hole;
 	};
 
-	bool ReadPackedPolyData(const PackedList& polygons, std::vector<OutputPolygon>& outputPolygonDatas, const TransformPacked& transform)
+	bool ReadPackedPolyData(const PackedVal& polygons, std::vector<OutputPolygon>& outputPolygonDatas, const TransformPacked& transform)
 	{
-		const auto type = GetPackedListType(polygons);
+		const auto addRing = [&](gg::CoordinateSequence::Ptr pPoints)
+		{
+			if (!pPoints->isEmpty())
+			{
+				pPoints->add(pPoints->front());
+
+				auto pFactory = gg::GeometryFactory::create();
+				std::unique_ptr<gg::Geometry> pLinearRing = pFactory->createLinearRing(std::move(pPoints));
+
+				bool isClockWise;
+				std::tie(isClockWise, pLinearRing) = IsClockWise(std::move(pLinearRing));
+				if (isClockWise)
+				{
+					outputPolygonDatas.emplace_back();
+					auto& outputPolygons = outputPolygonDatas.back().polygon;
+					outputPolygons.push_back_raw(pFactory->createPolygon(dynamic_cast<LinearRing*>(pLinearRing.release()), {}));
+				}
+				//穴がデータに追加されるのは、既存のポリゴンが存在するときのみ
+				else if(!outputPolygonDatas.empty())
+				{
+					auto& outputHoles = outputPolygonDatas.back().hole;
+					outputHoles.push_back_raw(pFactory->createPolygon(dynamic_cast<LinearRing*>(pLinearRing.release()), {}));
+				}
+			}
+		};
 
 		const auto readPolygon = [&](const std::vector<PackedList::Data>& vertices)->bool
 		{
@@ -96,43 +122,51 @@ namespace cgl
 				pPoints->add(gg::Coordinate(pos.x(), pos.y()));
 			}
 
-			if (!pPoints->isEmpty())
-			{
-				pPoints->add(pPoints->front());
-
-				auto pFactory = gg::GeometryFactory::create();
-				std::unique_ptr<gg::Geometry> pLinearRing = pFactory->createLinearRing(std::move(pPoints));
+			addRing(std::move(pPoints));
+			return true;
+		};
 
-				bool isClockWise;
-				std::tie(isClockWise, pLinearRing) = IsClockWise(std::move(pLinearRing));
-				if (isClockWise)
-				{
-					outputPolygonDatas.emplace_back();
-					auto& outputPolygons = outputPolygonDatas.back().polygon;
-					outputPolygons.push_back_raw(pFactory->createPolygon(dynamic_cast<LinearRing*>(pLinearRing.release()), {}));
-				}
-				//穴がデータに追加されるのは、既存のポリゴンが存在するときのみ
-				else if(!outputPolygonDatas.empty())
-				{
-					auto& outputHoles = outputPolygonDatas.back().hole;
-					outputHoles.push_back_raw(pFactory->createPolygon(dynamic_cast<LinearRing*>(pLinearRing.release()), {}));
-				}
+		const auto readVertices = [&](const PackedVertices& vertices)->bool
+		{
+			std::vector<gg::Coordinate> points(vertices.size());
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				const auto pos = transform.product(EigenVec2(vertices.x(i), vertices.y(i)));
+				points[i] = gg::Coordinate(pos.x(), pos.y());
 			}
 
+			addRing(std::make_unique<gg::CoordinateArraySequence>(std::move(points)));
 			return true;
 		};
 
+		if (IsType<PackedVertices>(polygons))
+		{
+			return readVertices(As<PackedVertices>(polygons));
+		}
+
+		if (!IsType<PackedList>(polygons))
+		{
+			return false;
+		}
+
+		const auto& polygonList = As<PackedList>(polygons);
+		const auto type = GetPackedListType(polygonList);
+
 		if (type == PackedPolyDataType::POLYGON)
 		{
-			return readPolygon(polygons.data);
+			return readPolygon(polygonList.data);
 		}
 		else if (type == PackedPolyDataType::MULTIPOLYGON)
 		{
-			for (const auto& polygonData : polygons.data)
+			for (const auto& polygonData : polygonList.data)
 			{
 				const auto& currentPolygonData = polygonData.value;
 
-				if (!IsType<PackedList>(currentPolygonData) || !readPolygon(As<PackedList>(currentPolygonData).data))
+				if (IsType<PackedVertices>(currentPolygonData))
+				{
+					readVertices(As<PackedVertices>(currentPolygonData));
+				}
+				else if (!IsType<PackedList>(currentPolygonData) || !readPolygon(As<PackedList>(currentPolygonData).data))
 				{
 					return false;
 				}
@@ -145,10 +179,8 @@ namespace cgl
 		return false;
 	}
 
-	bool ReadPackedLineData(const PackedList& lines, Geometries& outputLineDatas, const TransformPacked& transform)
+	bool ReadPackedLineData(const PackedVal& lines, Geometries& outputLineDatas, const TransformPacked& transform)
 	{
-		const auto type = GetPackedListType(lines);
-
 		const auto readLine = [&](const std::vector<PackedList::Data>& vertices)->bool
 		{
 			gg::CoordinateSequence::Ptr pPoints = std::make_unique<gg::CoordinateArraySequence>();
@@ -181,17 +213,54 @@ namespace cgl
 			return true;
 		};
 
+		const auto readVertices = [&](const PackedVertices& vertices)->bool
+		{
+			if (!vertices.empty())
+			{
+				std::vector<gg::Coordinate> points(vertices.size());
+				for (size_t i = 0; i < vertices.size(); ++i)
+				{
+					const auto pos = transform.product(EigenVec2(vertices.x(i), vertices.y(i)));
+					points[i] = gg::Coordinate(pos.x(), pos.y());
+				}
+
+				gg::CoordinateSequence::Ptr pPoints = std::make_unique<gg::CoordinateArraySequence>(std::move(points));
+
+				auto pFactory = gg::GeometryFactory::create();
+				outputLineDatas.push_back_raw(pFactory->createLineString(std::move(pPoints)).release());
+			}
+
+			return true;
+		};
+
+		if (IsType<PackedVertices>(lines))
+		{
+			return readVertices(As<PackedVertices>(lines));
+		}
+
+		if (!IsType<PackedList>(lines))
+		{
+			return false;
+		}
+
+		const auto& lineList = As<PackedList>(lines);
+		const auto type = GetPackedListType(lineList);
+
 		if (type == PackedPolyDataType::POLYGON)
 		{
-			return readLine(lines.data);
+			return readLine(lineList.data);
 		}
 		else if (type == PackedPolyDataType::MULTIPOLYGON)
 		{
-			for (const auto& lineData : lines.data)
+			for (const auto& lineData : lineList.data)
 			{
 				const auto& currentLineData = lineData.value;
 
-				if (!IsType<PackedList>(currentLineData) || !readLine(As<PackedList>(currentLineData).data))
+				if (IsType<PackedVertices>(currentLineData))
+				{
+					readVertices(As<PackedVertices>(currentLineData));
+				}
+				else if (!IsType<PackedList>(currentLineData) || !readLine(As<PackedList>(currentLineData).data))
 				{
 					return false;
 				}
@@ -206,11 +275,11 @@ namespace cgl
 
 	Geometries GeosFromListPacked(const cgl::PackedList& list, std::shared_ptr<Context> pContext, const cgl::TransformPacked& transform);
 
-	Geometries GeosFromRecordPackedImpl(const cgl::PackedRecord& record, std::shared_ptr<Context> pContext, const cgl::TransformPacked& parent)
-	{
-		const cgl::TransformPacked current(record);
-		const cgl::TransformPacked transform = parent * current;
+	Geometries GeosFromRecordPackedImpl(const cgl::PackedRecord& record, std::shared_ptr<Context> pContext, const cgl::TransformPacked& parent);
 
+	//recordの座標変換を含めたtransformを受け取ってジオメトリを構築する
+	Geometries GeosFromRecordPackedBody(const cgl::PackedRecord& record, std::shared_ptr<Context> pContext, const cgl::TransformPacked& transform)
+	{
 		Geometries resultPolygons;
 		Geometries currentLines;
 
@@ -222,11 +291,11 @@ namespace cgl
 			{
 				std::vector<OutputPolygon> outputPolygons;
 
-				if (cgl::IsType<cgl::PackedList>(value))
+				if (cgl::IsType<cgl::PackedList>(value) || cgl::IsType<cgl::PackedVertices>(value))
 				{
 					try
 					{
-						if (!ReadPackedPolyData(cgl::As<cgl::PackedList>(value), outputPolygons, transform))
+						if (!ReadPackedPolyData(value, outputPolygons, transform))
 						{
 							CGL_Error("polygonに指定されたデータの形式が不正です。");
 						}
@@ -257,7 +326,7 @@ namespace cgl
 						CGL_Error("polygon()の評価結果の型が不正です。");
 					}
 
-					if (!ReadPackedPolyData(cgl::As<cgl::PackedList>(evaluated), outputPolygons, transform))
+					if (!ReadPackedPolyData(evaluated, outputPolygons, transform))
 					{
 						CGL_Error("polygonに指定されたデータの形式が不正です。");
 					}
@@ -338,9 +407,9 @@ namespace cgl
 			}
 			else if (member.first == "line")
 			{
-				if (cgl::IsType<cgl::PackedList>(value))
+				if (cgl::IsType<cgl::PackedList>(value) || cgl::IsType<cgl::PackedVertices>(value))
 				{
-					if (!ReadPackedLineData(cgl::As<cgl::PackedList>(value), currentLines, transform))
+					if (!ReadPackedLineData(value, currentLines, transform))
 					{
 						CGL_Error("lineに指定されたデータの形式が不正です。");
 					}
@@ -355,7 +424,7 @@ namespace cgl
 						CGL_Error("line()の評価結果の型が不正です。");
 					}
 
-					if (!ReadPackedLineData(cgl::As<cgl::PackedList>(evaluated), currentLines, transform))
+					if (!ReadPackedLineData(evaluated, currentLines, transform))
 					{
 						CGL_Error("lineに指定されたデータの形式が不正です。");
 					}
@@ -392,6 +461,12 @@ namespace cgl
 		}
 	}
 
+	Geometries GeosFromRecordPackedImpl(const cgl::PackedRecord& record, std::shared_ptr<Context> pContext, const cgl::TransformPacked& parent)
+	{
+		const cgl::TransformPacked current(record);
+		return GeosFromRecordPackedBody(record, pContext, parent * current);
+	}
+
 	Geometries GeosFromListPacked(const cgl::PackedList& list, std::shared_ptr<Context> pContext, const cgl::TransformPacked& transform)
 	{
 		Geometries currentPolygons;
@@ -411,6 +486,301 @@ namespace cgl
 		return currentPolygons;
 	}
 
+	//レコード直下のpos, scale, angleはシェイプの座標変換として読まれ、ジオメトリの構造には影響しない
+	bool IsTransformMember(const std::string& name, const PackedVal& value)
+	{
+		if (name == "pos" || name == "scale")
+		{
+			return IsType<PackedRecord>(value);
+		}
+		return name == "angle" && IsNum(value);
+	}
+
+	class LocalShapeHasher : public boost::static_visitor<size_t>
+	{
+	public:
+		//関数値を含むシェイプは評価のたびに結果が変わりうるのでキャッシュできない
+		bool isCacheable = true;
+
+		size_t operator()(bool node) { return std::hash<bool>()(node); }
+		size_t operator()(int node) { return std::hash<int>()(node); }
+		size_t operator()(double node) { return std::hash<double>()(node); }
+		size_t operator()(const CharString& node) { return std::hash<std::u32string>()(node.toString()); }
+		size_t operator()(const PackedList& node)
+		{
+			size_t result = node.data.size();
+			for (const auto& val : node.data)
+			{
+				boost::hash_combine(result, boost::apply_visitor(*this, val.value));
+			}
+			return result;
+		}
+		size_t operator()(const PackedRecord& node)
+		{
+			return hashRecord(node, false);
+		}
+		size_t operator()(const KeyValue& node) { isCacheable = false; return 0; }
+		size_t operator()(const FuncVal& node) { isCacheable = false; return 0; }
+		size_t operator()(const Jump& node) { isCacheable = false; return 0; }
+		size_t operator()(const PackedVertices& node) { return boost::hash_range(node.coords.begin(), node.coords.end()); }
+
+		size_t hashRecord(const PackedRecord& node, bool isRoot)
+		{
+			//unordered_mapの列挙順に依存しないようにメンバ毎のハッシュの和を取る
+			size_t result = 0;
+			for (const auto& member : node.values)
+			{
+				if (isRoot && IsTransformMember(member.first, member.second.value))
+				{
+					continue;
+				}
+
+				size_t memberHash = std::hash<std::string>()(member.first);
+				boost::hash_combine(memberHash, boost::apply_visitor(*this, member.second.value));
+				result += memberHash;
+			}
+			return result;
+		}
+	};
+
+	bool IsSameLocalShape(const PackedVal& lhs, const PackedVal& rhs);
+
+	bool IsSameLocalShapeRecord(const PackedRecord& lhs, const PackedRecord& rhs, bool isRoot)
+	{
+		size_t lhsCount = 0;
+		for (const auto& member : lhs.values)
+		{
+			if (isRoot && IsTransformMember(member.first, member.second.value))
+			{
+				continue;
+			}
+
+			auto it = rhs.values.find(member.first);
+			if (it == rhs.values.end() || !IsSameLocalShape(member.second.value, it->second.value))
+			{
+				return false;
+			}
+			++lhsCount;
+		}
+
+		size_t rhsCount = 0;
+		for (const auto& member : rhs.values)
+		{
+			if (!(isRoot && IsTransformMember(member.first, member.second.value)))
+			{
+				++rhsCount;
+			}
+		}
+
+		return lhsCount == rhsCount;
+	}
+
+	bool IsSameLocalShape(const PackedVal& lhs, const PackedVal& rhs)
+	{
+		if (lhs.which() != rhs.which())
+		{
+			return false;
+		}
+
+		if (IsType<bool>(lhs))
+		{
+			return As<bool>(lhs) == As<bool>(rhs);
+		}
+		if (IsType<int>(lhs))
+		{
+			return As<int>(lhs) == As<int>(rhs);
+		}
+		if (IsType<double>(lhs))
+		{
+			return As<double>(lhs) == As<double>(rhs);
+		}
+		if (IsType<CharString>(lhs))
+		{
+			return As<CharString>(lhs) == As<CharString>(rhs);
+		}
+		if (IsType<PackedList>(lhs))
+		{
+			const auto& lhsData = As<PackedList>(lhs).data;
+			const auto& rhsData = As<PackedList>(rhs).data;
+			if (lhsData.size() != rhsData.size())
+			{
+				return false;
+			}
+			for (size_t i = 0; i < lhsData.size(); ++i)
+			{
+				if (!IsSameLocalShape(lhsData[i].value, rhsData[i].value))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+		if (IsType<PackedRecord>(lhs))
+		{
+			return IsSameLocalShapeRecord(As<PackedRecord>(lhs), As<PackedRecord>(rhs), false);
+		}
+		if (IsType<PackedVertices>(lhs))
+		{
+			return As<PackedVertices>(lhs).coords == As<PackedVertices>(rhs).coords;
+		}
+
+		return false;
+	}
+
+	class CoordinateTransformer : public gg::CoordinateFilter
+	{
+	public:
+		CoordinateTransformer(const TransformPacked& transform) :
+			transform(transform)
+		{}
+
+		void filter_rw(Coordinate* coord)const override
+		{
+			const auto pos = transform.product(EigenVec2(coord->x, coord->y));
+			coord->x = pos.x();
+			coord->y = pos.y();
+		}
+
+	private:
+		const TransformPacked& transform;
+	};
+
+	void ApplyTransform(Geometries& geometries, const TransformPacked& transform)
+	{
+		CoordinateTransformer transformer(transform);
+
+		for (size_t i = 0; i < geometries.size(); ++i)
+		{
+			gg::Geometry* pGeometry = geometries.refer(i);
+			pGeometry->apply_rw(&transformer);
+			pGeometry->geometryChanged();
+		}
+	}
+
+	//最適化中は同じシェイプがpos, scale, angleだけを変えて何度もジオメトリに変換されるので、
+	//座標変換を除いた構造をキーとしてローカル座標系の座標列を保持し、ヒットした場合は座標変換を適用しながらジオメトリを組み立てる
+	class LocalGeometryCache
+	{
+	public:
+		static LocalGeometryCache& Instance()
+		{
+			static LocalGeometryCache cache;
+			return cache;
+		}
+
+		static boost::optional<size_t> MakeKey(const PackedRecord& record)
+		{
+			LocalShapeHasher hasher;
+			const size_t key = hasher.hashRecord(record, true);
+			if (!hasher.isCacheable)
+			{
+				return boost::none;
+			}
+			return key;
+		}
+
+		std::shared_ptr<const GeometryCoordinates> find(size_t key, const PackedRecord& record)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			const auto range = m_entries.equal_range(key);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (IsSameLocalShapeRecord(it->second.shape, record, true))
+				{
+					return it->second.coordinates;
+				}
+			}
+
+			return nullptr;
+		}
+
+		void store(size_t key, const PackedRecord& record, std::shared_ptr<const GeometryCoordinates> coordinates)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (MaxEntries <= m_entries.size())
+			{
+				m_entries.clear();
+			}
+
+			Entry entry;
+			entry.shape.values = record.values;
+			entry.coordinates = coordinates;
+			m_entries.emplace(key, std::move(entry));
+		}
+
+	private:
+		static constexpr size_t MaxEntries = 4096;
+
+		//GEOSのジオメトリはスレッド間で共有できないので座標列だけを持ち、取り出した側で組み立てる
+		//取り出し中のエントリがclearされても困らないようにshared_ptrで持つ
+		struct Entry
+		{
+			PackedRecord shape;
+			std::shared_ptr<const GeometryCoordinates> coordinates;
+		};
+
+		std::mutex m_mutex;
+		std::unordered_multimap<size_t, Entry> m_entries;
+	};
+
+	Geometries GeosFromRecordPackedCached(const cgl::PackedRecord& record, std::shared_ptr<Context> pContext, const cgl::TransformPacked& parent)
+	{
+		const cgl::TransformPacked transform = parent * cgl::TransformPacked(record);
+
+		//鏡映を含む（または潰れた）変換ではポリゴンと穴の向きの判定が変わるので、キャッシュを使わない
+		if (transform.linearDeterminant() <= 0.0)
+		{
+			return GeosFromRecordPackedBody(record, pContext, transform);
+		}
+
+		const auto keyOpt = LocalGeometryCache::MakeKey(record);
+		if (!keyOpt)
+		{
+			return GeosFromRecordPackedBody(record, pContext, transform);
+		}
+
+		auto& cache = LocalGeometryCache::Instance();
+
+		if (const auto pCoordinates = cache.find(keyOpt.get(), record))
+		{
+			return pCoordinates->build(transform);
+		}
+
+		Geometries localGeometries = GeosFromRecordPackedBody(record, pContext, cgl::TransformPacked());
+
+		auto pCoordinates = std::make_shared<GeometryCoordinates>();
+		if (!pCoordinates->assign(localGeometries))
+		{
+			//座標列で表せないジオメトリを含む場合はキャッシュせず、作ったジオメトリをそのまま変換して返す
+			ApplyTransform(localGeometries, transform);
+			return localGeometries;
+		}
+
+		cache.store(keyOpt.get(), record, pCoordinates);
+		return pCoordinates->build(transform);
+	}
+
+	Geometries GeosFromListPackedCached(const cgl::PackedList& list, std::shared_ptr<Context> pContext, const cgl::TransformPacked& transform)
+	{
+		Geometries currentPolygons;
+		for (const auto& val : list.data)
+		{
+			const PackedVal& value = val.value;
+			if (cgl::IsType<cgl::PackedRecord>(value))
+			{
+				currentPolygons.append(GeosFromRecordPackedCached(cgl::As<cgl::PackedRecord>(value), pContext, transform));
+			}
+			else if (cgl::IsType<cgl::PackedList>(value))
+			{
+				currentPolygons.append(GeosFromListPackedCached(cgl::As<cgl::PackedList>(value), pContext, transform));
+			}
+		}
+
+		return currentPolygons;
+	}
+
 	Geometries GeosFromRecordPacked(const PackedVal& value, std::shared_ptr<Context> pContext, const cgl::TransformPacked& parent)
 	{
 		if (printAddressInsertion)
@@ -442,7 +812,7 @@ namespace cgl
 				return currentPolygons;
 			}
 
-			auto result = GeosFromRecordPackedImpl(cgl::As<cgl::PackedRecord>(value), pContext, parent);
+			auto result = GeosFromRecordPackedCached(cgl::As<cgl::PackedRecord>(value), pContext, parent);
 			if (printAddressInsertion)
 			{
 				//std::cout << "GeosFromRecordPacked end" << std::endl;
@@ -451,7 +821,7 @@ namespace cgl
 		}
 		if (cgl::IsType<cgl::PackedList>(value))
 		{
-			auto result = GeosFromListPacked(cgl::As<cgl::PackedList>(value), pContext, parent);
+			auto result = GeosFromListPackedCached(cgl::As<cgl::PackedList>(value), pContext, parent);
 			if (printAddressInsertion)
 			{
 				//std::cout << "GeosFromRecordPacked end" << std::endl;
@@ -496,9 +866,9 @@ namespace cgl
 			{
 				std::vector<OutputPolygon> outputPolygons;
 
-				if (IsType<PackedList>(value))
+				if (IsType<PackedList>(value) || IsType<PackedVertices>(value))
 				{
-					if (!ReadPackedPolyData(cgl::As<cgl::PackedList>(value), outputPolygons, transform))
+					if (!ReadPackedPolyData(value, outputPolygons, transform))
 					{
 						CGL_Error("polygonに指定されたデータの形式が不正です。");
 					}
@@ -513,7 +883,7 @@ namespace cgl
 						CGL_Error("polygon()の評価結果の型が不正です。");
 					}
 
-					if (!ReadPackedPolyData(cgl::As<cgl::PackedList>(evaluated), outputPolygons, transform))
+					if (!ReadPackedPolyData(evaluated, outputPolygons, transform))
 					{
 						CGL_Error("polygonに指定されたデータの形式が不正です。");
 					}
@@ -586,9 +956,9 @@ namespace cgl
 			}
 			else if (member.first == "line")
 			{
-				if (IsType<PackedList>(value))
+				if (IsType<PackedList>(value) || IsType<PackedVertices>(value))
 				{
-					if (!ReadPackedLineData(As<PackedList>(value), currentLines, transform))
+					if (!ReadPackedLineData(value, currentLines, transform))
 					{
 						CGL_Error("lineに指定されたデータの形式が不正です。");
 					}
@@ -603,7 +973,7 @@ namespace cgl
 						CGL_Error("line()の評価結果の型が不正です。");
 					}
 
-					if (!ReadPackedLineData(As<PackedList>(evaluated), currentLines, transform))
+					if (!ReadPackedLineData(evaluated, currentLines, transform))
 					{
 						CGL_Error("lineに指定されたデータの形式が不正です。");
 					}
@@ -0,0 +1,24 @@
+#pragma warning(disable:4996)
+
+#include <iostream>
+
+#include <Pita/Program.hpp>
+
+//JSON版のPitaStdを読み込んだContextを、pita_libに埋め込むPitaStdBinaryとして書き出す
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		std::cerr << "usage: pita_snapshot output_file" << std::endl;
+		return 1;
+	}
+
+	cgl::Program program;
+	if (!program.writeBinarySnapshot(argv[1]))
+	{
+		std::cerr << "Error: failed to write \"" << argv[1] << "\"" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -42,6 +42,9 @@ extern bool isDebugMode;
 extern bool isBlockingMode;
 extern bool isContextFreeMode;
 extern bool isDumpParseTree;
+extern bool isPortfolioMode;
+extern bool isBinaryPreEvaluation;
+extern std::string solutionCacheDirectory;
 
 #ifdef USE_CURSES
 /* Trap interrupt */
@@ -78,7 +81,11 @@ int main(int argc, char* argv[])
 			("logHTML", "Output log.html")
 			("contextFree", "Enable Context Free Mode(experimental)")
 			("preEvaluation", "Output eval result as JSON format (for PitaStd generation)")
+			("binarySnapshot", "Output the preEvaluation result as a portable binary snapshot (for PitaStdBinary generation)")
 			("dumpParseTree", "Dump parse tree")
+			("portfolio", "Solve each constraint by racing BFGS and CMA-ES concurrently")
+			("telemetry", "Output solver telemetry of each constraint as JSON", cxxopts::value<std::string>(), "path")
+			("solutionCache", "Reuse constraint solutions stored in the directory across runs", cxxopts::value<std::string>(), "directory")
 			//("seed", "Random seed (if unspecified, seed is generated non-deterministically)", cxxopts::value<int>(), "N")
 			//("constraint-timeout", "Set timeout seconds of each constraint solving", cxxopts::value<int>(), "N")
 			;
@@ -199,6 +206,18 @@ int main(int argc, char* argv[])
 		{
 			isDumpParseTree = true;
 		}
+		if (result.count("portfolio"))
+		{
+			isPortfolioMode = true;
+		}
+		if (result.count("binarySnapshot"))
+		{
+			isBinaryPreEvaluation = true;
+		}
+		if (result.count("solutionCache"))
+		{
+			solutionCacheDirectory = result["solutionCache"].as<std::string>();
+		}
 
 		if (result.count("logHTML"))
 		{
@@ -290,6 +309,12 @@ int main(int argc, char* argv[])
 			program.execute1(input_file, output_file, !isDebugMode);
 		}
 
+		if (result.count("telemetry"))
+		{
+			std::ofstream telemetryFile(result["telemetry"].as<std::string>());
+			program.outputSolverTelemetry(telemetryFile);
+		}
+
 		/*if (isDebugMode)
 		{
 			endwin();
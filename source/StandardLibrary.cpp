@@ -0,0 +1,62 @@
+#pragma warning(disable:4996)
+
+#include <Pita/Program.hpp>
+
+//PitaStdBinaryはビルド時にpita_snapshotがJSON版のPitaStdから生成し、pita_libだけがそのディレクトリを参照する
+#ifdef __has_include
+#  if __has_include(<Pita/PitaStd>)
+#    define CGL_HAS_STANDARD_FILE
+#  endif
+#  if __has_include(<Pita/PitaStdBinary>)
+#    define CGL_HAS_STANDARD_BINARY
+#  endif
+#endif
+
+namespace cgl
+{
+#if defined(CGL_HAS_STANDARD_BINARY)
+	namespace
+	{
+		//pita_snapshotがビルド時に出力したPortableBinary形式のPitaStd
+		const unsigned char PitaStdBinary[] = {
+#include <Pita/PitaStdBinary>
+		};
+	}
+
+	Program::Program() :
+		pEnv(Context::Make()),
+		isInitialized(true)
+	{
+		std::cout << "load PitaStd ..." << std::endl;
+		loadBinarySnapshot(PitaStdBinary, sizeof(PitaStdBinary));
+	}
+#elif defined(CGL_HAS_STANDARD_FILE)
+	Program::Program() :
+		pEnv(Context::Make()),
+		isInitialized(true)
+	{
+		std::cout << "load PitaStd ..." << std::endl;
+		std::vector<std::string> pitaStdSplitted({
+#include <Pita/PitaStd>
+			});
+
+		std::stringstream ss;
+		for (const auto& str : pitaStdSplitted)
+		{
+			ss << str;
+		}
+
+		cereal::JSONInputArchive ar(ss);
+		Context& context = *pEnv;
+		ar(context);
+
+		/*google::InitGoogleLogging("pita");
+		google::InstallFailureSignalHandler();*/
+	}
+#else
+	Program::Program() :
+		pEnv(Context::Make()),
+		isInitialized(false)
+	{}
+#endif
+}
@@ -11,8 +11,8 @@
 #include <Pita/ExprTransformer.hpp>
 #include <Pita/ValueCloner.hpp>
 
-extern double cloneTime;
-extern unsigned cloneCount;
+extern thread_local double cloneTime;
+extern thread_local unsigned cloneCount;
 extern bool printAddressInsertion;
 namespace cgl
 {
@@ -84,18 +84,38 @@ namespace cgl
 		return node;
 	}
 
+	namespace
+	{
+		//その場で書き換えられることがなく、クローンと元で同じアドレスのまま持てる値
+		bool IsSharableValue(const Val& value)
+		{
+			return IsType<bool>(value) || IsType<int>(value) || IsType<double>(value) || IsType<CharString>(value)
+				|| (IsType<FuncVal>(value) && As<FuncVal>(value).builtinFuncAddress);
+		}
+
+		//制約の解はレコードのメンバのアドレスにその場で書き込まれるので、制約を持つレコードの中の値は共有できない
+		bool HasConstraints(const Record& record)
+		{
+			return record.constraint || !record.problems.empty() || !record.boundedFreeVariables.empty()
+				|| !record.original.regionVars.empty() || !record.original.unitConstraints.empty() || !record.original.groupConstraints.empty();
+		}
+	}
+
 	//Valのアドレス値を再帰的に展開したクローンを作成する
+	//sharesValuesなら、制約を持たないリスト・レコードの中の数値・文字列・組み込み関数は複製せずに元と同じアドレスを共有する
 	class ValueCloner : public boost::static_visitor<Val>
 	{
 	public:
-		ValueCloner(std::shared_ptr<Context> pEnv, const LocationInfo& info) :
+		ValueCloner(std::shared_ptr<Context> pEnv, const LocationInfo& info, bool sharesValues) :
 			pEnv(pEnv),
-			info(info)
+			info(info),
+			sharesValues(sharesValues)
 		{}
 
 		const LocationInfo info;
 		std::shared_ptr<Context> pEnv;
 		std::unordered_map<Address, Address> replaceMap;
+		bool sharesValues;
 
 		double time1 = 0, time2 = 0, time3 = 0;
 
@@ -127,6 +147,9 @@ namespace cgl
 
 		boost::optional<Address> getOpt(Address address)const;
 
+		//クローン済みの値のうち、書き換えが必要な関数値だけを新しいアドレスに付け替える
+		void rewrite(Address address);
+
 		Val operator()(bool node) { return node; }
 		Val operator()(int node) { return node; }
 		Val operator()(double node) { return node; }
@@ -196,6 +219,13 @@ namespace cgl
 				const Val& substance = pEnv->expand(LRValue(data[i]), info);
 				double end1T = GetSec();
 
+				if (sharesValues && IsSharableValue(substance))
+				{
+					pEnv->shareValue(data[i]);
+					result.push_back(data[i]);
+					continue;
+				}
+
 				const Val clone = boost::apply_visitor(*this, substance);
 
 				double begin2T = GetSec();
@@ -217,13 +247,18 @@ namespace cgl
 
 	Val ValueCloner::operator()(const Record& node)
 	{
-		Record result;
+		const bool sharesOuterValues = sharesValues;
+		sharesValues = sharesValues && !HasConstraints(node);
+
+		//メンバ表は元のレコードと共有し、複製したメンバだけを書き換える
+		Record result(node.values);
+		std::vector<std::pair<std::string, Address>> clonedMembers;
 
 		for (const auto& value : node.values)
 		{
 			if (auto opt = getOpt(value.second))
 			{
-				result.append(value.first, opt.get());
+				clonedMembers.emplace_back(value.first, opt.get());
 			}
 			else
 			{
@@ -231,13 +266,19 @@ namespace cgl
 				const Val& substance = pEnv->expand(LRValue(value.second), info);
 				double end1T = GetSec();
 
+				if (sharesValues && IsSharableValue(substance))
+				{
+					pEnv->shareValue(value.second);
+					continue;
+				}
+
 				const Val clone = boost::apply_visitor(*this, substance);
 
 				double begin2T = GetSec();
 				const Address newAddress = pEnv->makeTemporaryValue(clone);
 				double begin3T = GetSec();
 
-				result.append(value.first, newAddress);
+				clonedMembers.emplace_back(value.first, newAddress);
 				replaceMap[value.second] = newAddress;
 				double begin4T = GetSec();
 
@@ -252,6 +293,9 @@ namespace cgl
 			std::cout << "(" << time1 << ", " << time2 << ", " << time3 << ")\n";
 		}*/
 
+		result.values.insertOrAssign(std::move(clonedMembers));
+		sharesValues = sharesOuterValues;
+
 		result.problems = node.problems;
 		result.type = node.type;
 		result.constraint = node.constraint;
@@ -277,15 +321,36 @@ namespace cgl
 		return boost::none;
 	}
 
-	Val ValueCloner2::operator()(const List& node)
+	void ValueCloner2::rewrite(Address address)
 	{
-		const auto& data = node.data;
+		//ValueCloner1でクローンは既に作ったので、そのクローンを直接書き換える
+		//書き換わるのは内部にアドレスを持つ関数値だけなので、それ以外の値を代入し直す必要はない
+		const Val& substance = pEnv->expand(LRValue(address), info);
+		if (IsType<List>(substance))
+		{
+			for (const Address child : As<List>(substance).data)
+			{
+				rewrite(child);
+			}
+		}
+		else if (IsType<Record>(substance))
+		{
+			for (const auto& value : As<Record>(substance).values)
+			{
+				rewrite(value.second);
+			}
+		}
+		else if (IsType<FuncVal>(substance) && !As<FuncVal>(substance).builtinFuncAddress)
+		{
+			pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(address, (*this)(As<FuncVal>(substance)));
+		}
+	}
 
-		for (size_t i = 0; i < data.size(); ++i)
+	Val ValueCloner2::operator()(const List& node)
+	{
+		for (const Address address : node.data)
 		{
-			//ValueCloner1でクローンは既に作ったので、そのクローンを直接書き換える
-			const Val& substance = pEnv->expand(LRValue(data[i]), info);
-			pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(data[i], boost::apply_visitor(*this, substance));
+			rewrite(address);
 		}
 
 		return node;
@@ -295,9 +360,7 @@ namespace cgl
 	{
 		for (const auto& value : node.values)
 		{
-			//ValueCloner1でクローンは既に作ったので、そのクローンを直接書き換える
-			const Val& substance = pEnv->expand(LRValue(value.second), info);
-			pEnv->TODO_Remove__ThisFunctionIsDangerousFunction__AssignToObject(value.second, boost::apply_visitor(*this, substance));
+			rewrite(value.second);
 		}
 
 		return node;
@@ -529,6 +592,11 @@ namespace cgl
 	}
 
 	Val Clone(std::shared_ptr<Context> pEnv, const Val& value, const LocationInfo& info)
+	{
+		return Clone(pEnv, value, info, true);
+	}
+
+	Val Clone(std::shared_ptr<Context> pEnv, const Val& value, const LocationInfo& info, bool sharesValues)
 	{
 		/*
 		関数値がアドレスを内部に持っている時、クローン作成の前後でその依存関係を保存する必要があるので、クローン作成は2ステップに分けて行う。
@@ -554,7 +622,7 @@ namespace cgl
 
 		//++cloneCount;
 		double beginT = GetSec();
-		ValueCloner cloner(pEnv, info);
+		ValueCloner cloner(pEnv, info, sharesValues);
 		const Val& evaluated = boost::apply_visitor(cloner, value);
 		
 		ValueCloner2 cloner2(pEnv, cloner.replaceMap, info);
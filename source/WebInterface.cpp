@@ -0,0 +1,51 @@
+#pragma warning(disable:4996)
+
+//Web版（Emscripten）からPitaを呼び出すための関数
+//Program::Program()はpita_libで定義されるため、pita_coreには含めずpita_libをリンクする実行ファイルに含める
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+
+#include <Pita/Program.hpp>
+
+extern bool isDebugMode;
+
+std::string pitaInputString;
+std::string pitaResultString;
+
+EMSCRIPTEN_KEEPALIVE
+void executePitaWithDebug(char* ptr, unsigned int length)
+{
+	std::cout << "run(debug mode): " << std::string(ptr, ptr + length) << std::endl;
+	isDebugMode = true;
+	cgl::Program program;
+	pitaResultString = program.executeAsString(std::string(ptr, ptr + length));
+}
+
+EMSCRIPTEN_KEEPALIVE
+void executePita(char* ptr, unsigned int length)
+{
+	std::cout << "run: " << std::string(ptr, ptr + length) << std::endl;
+	isDebugMode = false;
+	cgl::Program program;
+	pitaResultString = program.executeAsString(std::string(ptr, ptr + length));
+}
+
+EMSCRIPTEN_KEEPALIVE
+unsigned int getPitaResultPtr()
+{
+	return reinterpret_cast<unsigned>(pitaResultString.c_str());
+}
+
+EMSCRIPTEN_KEEPALIVE
+unsigned int getPitaResultLength()
+{
+	return pitaResultString.length();
+}
+
+EMSCRIPTEN_KEEPALIVE
+unsigned int getPitaInputPtr(unsigned int length)
+{
+	pitaInputString.resize(length);
+	return reinterpret_cast<unsigned>(pitaInputString.c_str());
+}
+#endif
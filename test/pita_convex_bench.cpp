@@ -0,0 +1,75 @@
+#define NOMINMAX
+
+#include <iostream>
+#include <chrono>
+
+#include <Pita/Program.hpp>
+
+extern bool isDebugMode;
+extern bool isBlockingMode;
+extern bool useConvexFastPath;
+
+//grid.cglと同じ配置の矩形に対して Distance/Avoid/Near を繰り返し評価し、凸多角形の高速パスの有無で時間を比較する
+//結果の一致はpita_testのtest_convex_fast_pathで確かめるので、ここでは時間だけを出力する
+int main()
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	const std::string source(u8R"*(
+(
+	square = {
+		polygon: [{x: 0.0, y: 0.0}, {x: 20.0, y: 0.0}, {x: 20.0, y: 20.0}, {x: 0.0, y: 20.0}]
+	}
+	interval = 25
+	ss = []
+	ts = []
+	i = 0
+	for yi in 0:9 do(
+		for xi in 0:9 do(
+			ss[i] = {polygon: square.polygon, pos: {x: interval*xi, y: interval*yi}}
+			ts[i] = {polygon: square.polygon, pos: {x: interval*xi + 10, y: interval*yi + 10}}
+			i = i + 1
+		)
+	)
+
+	distanceSum = 0
+	avoidSum = 0
+	nearSum = 0
+	for r in 1:10 do(
+		for k in 0:89 do(
+			distanceSum = distanceSum + Distance(ss[k], ss[k + 10])
+			avoidSum = avoidSum + Avoid(ss[k], ts[k])
+			nearSum = nearSum + Near(ss[k], ts[k + 10])
+		)
+	)
+	[distanceSum, avoidSum, nearSum]
+)
+)*");
+
+	double times[2] = {};
+	for (int i = 0; i < 2; ++i)
+	{
+		useConvexFastPath = (i == 0);
+
+		auto start = std::chrono::system_clock::now();
+
+		cgl::Program program;
+		program.executeInline(source, false);
+		if (!program.isSucceeded())
+		{
+			std::cerr << "Error: failed to evaluate the benchmark" << std::endl;
+			return 1;
+		}
+
+		auto end = std::chrono::system_clock::now();
+
+		times[i] = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()*0.001;
+	}
+	useConvexFastPath = true;
+
+	std::cout << "convex fast path: " << times[0] << "[sec]\n";
+	std::cout << "GEOS only       : " << times[1] << "[sec]\n";
+
+	return 0;
+}
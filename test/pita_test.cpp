@@ -3,13 +3,98 @@
 #define BOOST_TEST_MAIN
 #include <boost/test/included/unit_test.hpp>
 
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
 #include <Pita/Program.hpp>
+#include <Pita/Parser.hpp>
+#include <Pita/OptimizationEvaluator.hpp>
+#include <Pita/ExprTransformer.hpp>
 
 extern bool isDebugMode;
 extern bool isBlockingMode;
+extern bool isBinaryPreEvaluation;
+extern bool useParallelConstraintGroups;
+extern bool useParallelCmaesEvaluation;
+extern bool isPortfolioMode;
+extern bool useIncrementalUnitConstraints;
+extern bool useConvexFastPath;
+extern std::string solutionCacheDirectory;
 
 BOOST_AUTO_TEST_SUITE(cgl)
 
+namespace
+{
+	//最後の式が数値のリストになるプログラムの評価結果から、リストの各値を取り出す
+	std::vector<double> ResultNumbers(const Program& program)
+	{
+		std::vector<double> result;
+		for (const Address address : As<List>(program.getVal().get()).data)
+		{
+			result.push_back(AsDouble(program.getContext()->expand(LRValue(address), LocationInfo())));
+		}
+		return result;
+	}
+
+	//最後の式が数値のリストになるプログラムを実行し、リストの各値を返す
+	std::vector<double> EvaluateNumbers(const std::string& source)
+	{
+		Program program;
+		program.executeInline(source, false);
+		BOOST_REQUIRE(program.isSucceeded());
+		return ResultNumbers(program);
+	}
+
+	//制約解のキャッシュのディレクトリにある解のエントリ
+	std::vector<std::string> SolutionCacheEntries(const std::string& directory)
+	{
+		std::vector<std::string> entries;
+		for (filesystem::directory_iterator it(directory), end; it != end; ++it)
+		{
+			if (it->path().extension() == ".txt")
+			{
+				entries.push_back(it->path().string());
+			}
+		}
+		return entries;
+	}
+
+	void CheckSameNumbers(const std::vector<double>& lhs, const std::vector<double>& rhs, double tolerance)
+	{
+		BOOST_REQUIRE_EQUAL(lhs.size(), rhs.size());
+		for (size_t i = 0; i < lhs.size(); ++i)
+		{
+			BOOST_CHECK_SMALL(lhs[i] - rhs[i], tolerance);
+		}
+	}
+
+	//関数本体に現れる識別子ごとに、割り当てられた引数の位置を集める（-1は名前で探す識別子）
+	class ArgumentSlotCollector : public ExprTransformer
+	{
+	public:
+		using ExprTransformer::operator();
+
+		std::map<std::string, std::set<int>> slots;
+
+		Expr operator()(const Identifier& node)override
+		{
+			slots[node.name].insert(node.argumentSlot);
+			return node;
+		}
+	};
+
+	std::map<std::string, std::set<int>> ArgumentSlots(const Context& context, Address funcAddress)
+	{
+		ArgumentSlotCollector collector;
+		boost::apply_visitor(collector, As<FuncVal>(context.expand(LRValue(funcAddress), LocationInfo())).expr);
+		return collector.slots;
+	}
+}
+
 BOOST_AUTO_TEST_CASE(test_case1)
 {
 	std::vector<std::string> testCases({
@@ -84,6 +169,183 @@ Print("--- ClosureMaker tests ---")
 
 	Print("Passed")
 )
+)*",
+u8R"*(
+Print("--- Constraint tests ---")
+(
+	r = {
+		a: 1.0
+		b: 2.0
+		sat(a*2 + SinRad(0) == 10 & b >= a + 3)
+		var(a, b)
+	}
+
+	Assert(Abs(r.a - 5) < 0.001, "arithmetic constraint(0)")
+	Assert(r.a + 3 - 0.001 <= r.b, "arithmetic constraint(1)")
+
+	Print("Passed")
+)
+(
+	base = {
+		w: 3.0
+	}
+	r = {
+		a: 0.0
+		sat(a == base.w * 2 + Abs(-1))
+		var(a)
+	}
+
+	Assert(Abs(r.a - 7) < 0.001, "constant subexpression(0)")
+
+	Print("Passed")
+)
+(
+	r = {
+		a: 5.5
+		b: 0.0
+		sat(b == Floor(a)/2)
+		var(b)
+	}
+
+	Assert(Abs(r.b - 2) < 0.001, "integer builtin in sat(0)")
+
+	s = {
+		a: 0.0
+		b: 0.0
+		sat(a >= 5.2 & a <= 5.8 & b == Floor(a)/2)
+		var(a, b)
+	}
+
+	Assert(Abs(s.b - 2) < 0.01, "integer builtin in sat(1)")
+
+	Print("Passed")
+)
+(
+	r = {
+		a: 0.0
+		sat(Cmaes() & a == 7)
+		var(a)
+	}
+
+	Assert(Abs(r.a - 7) < 0.01, "unranged variable(0)")
+
+	s = {
+		shape: {pos: {x: 0.0, y: 0.0}, scale: {x: 1.0, y: 1.0}, angle: 0.0}
+		sat(Cmaes() & shape.scale.x == 2 & shape.scale.y == 0.5)
+		var(shape)
+	}
+
+	Assert(Abs(s.shape.scale.x - 2) < 0.01, "scale variable(0)")
+	Assert(Abs(s.shape.scale.y - 0.5) < 0.01, "scale variable(1)")
+
+	t = {
+		a: 0.0
+		b: 0.0
+		sat(a == 3 & b == a + 2)
+		var(a in [0, 10], b)
+	}
+
+	Assert(Abs(t.a - 3) < 0.001, "partially bounded variables(0)")
+	Assert(Abs(t.b - 5) < 0.001, "partially bounded variables(1)")
+
+	Print("Passed")
+)
+)*",
+u8R"*(
+Print("--- Shape tests ---")
+(
+	square = {
+		polygon: [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.0}, {x: 10.0, y: 10.0}, {x: 0.0, y: 10.0}]
+	}
+	hull = ConvexHull(square)
+	p = hull.polygon
+
+	Assert(Size(p) == 4, "vertex buffer(0)")
+	Assert(Abs(p[0].x + p[1].x + p[2].x + p[3].x - 20) < 0.001, "vertex buffer(1)")
+	Assert(Abs(Area(hull) - 100) < 0.001, "vertex buffer(2)")
+
+	Print("Passed")
+)
+(
+	square = {
+		polygon: [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.0}, {x: 10.0, y: 10.0}, {x: 0.0, y: 10.0}]
+	}
+	shapes = [{polygon: square.polygon, pos: {x: 0.0, y: 0.0}}, {polygon: square.polygon, pos: {x: 5.0, y: 0.0}}, {polygon: square.polygon, pos: {x: 30.0, y: 0.0}}]
+
+	Assert(Abs(Avoid(shapes[0], shapes[1]) - 50) < 0.001, "avoid list(0)")
+	Assert(Abs(Avoid(shapes) - Avoid(shapes[0], shapes[1])) < 0.001, "avoid list(1)")
+
+	Print("Passed")
+)
+(
+	Min = (a, b -> if a < b then a else b)
+	square = [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.0}, {x: 10.0, y: 10.0}, {x: 0.0, y: 10.0}]
+	shapes = [
+		{polygon: square, pos: {x: 0.0, y: 0.0}},
+		{polygon: square, pos: {x: 5.0, y: 0.0}},
+		{polygon: square, pos: {x: 100.0, y: 0.0}},
+		{polygon: square, pos: {x: 130.0, y: 0.0}},
+		{line: [{x: -5.0, y: 5.0}, {x: 20.0, y: 5.0}], pos: {x: 0.0, y: 0.0}}
+	]
+
+	avoidSum = 0
+	nearSum = 0
+	for i in 0:4 do(
+		nearest = 1000000.0
+		for j in 0:4 do(
+			if i < j then(avoidSum = avoidSum + Avoid(shapes[i], shapes[j]))
+			if i != j then(nearest = Min(nearest, Near(shapes[i], shapes[j])))
+		)
+		nearSum = nearSum + nearest
+	)
+
+	Assert(Abs(Avoid(shapes) - avoidSum) < 0.001, "avoid list with lines(0)")
+	Assert(Abs(Near(shapes) - nearSum) < 0.001, "near list with lines(0)")
+	Assert(Abs(Near([shapes[2], shapes[3]]) - Near(shapes[2], shapes[3])) < 0.001, "near list broad phase(0)")
+
+	Print("Passed")
+)
+)*",
+u8R"*(
+Print("--- Record inheritance tests ---")
+(
+	proto = {a: 1, b: 2, c: 3, d: 4, e: 5, f: 6, g: 7, h: 8, k: [1, 2], l: {x: 1, y: 2}}
+	derived = proto{b: 20, e: 50}
+
+	Assert(derived.a == 1, "record inheritance(0)")
+	Assert(derived.b == 20, "record inheritance(1)")
+	Assert(derived.e == 50, "record inheritance(2)")
+	Assert(derived.h == 8, "record inheritance(3)")
+	Assert(proto.b == 2, "record inheritance(4)")
+	Assert(proto.e == 5, "record inheritance(5)")
+
+	derived.l.x = 100
+	derived.k[0] = 100
+	Assert(derived.l.x == 100, "record inheritance(6)")
+	Assert(derived.k[0] == 100, "record inheritance(7)")
+	Assert(proto.l.x == 1, "record inheritance(8)")
+	Assert(proto.k[0] == 1, "record inheritance(9)")
+
+	proto.c = 30
+	Assert(derived.c == 3, "record inheritance(10)")
+
+	Print("Passed")
+)
+(
+	//継承で共有した値にsolverが書き込んでも、元のレコードは変わらない
+	base = {a: 1.0, b: 2.0}
+	d = base{b: 3.0}
+	m = {dd: d, var(dd.a), sat(dd.a == 5.0)}
+	Assert(Abs(m.dd.a - 5.0) < 0.01, "record inheritance sharing(0)")
+	Assert(base.a == 1.0, "record inheritance sharing(1)")
+
+	//継承式の中で変数にしたメンバは共有せずに複製する
+	d2 = base{var(a), sat(a == 7.0)}
+	Assert(Abs(d2.a - 7.0) < 0.01, "record inheritance sharing(2)")
+	Assert(base.a == 1.0, "record inheritance sharing(3)")
+
+	Print("Passed")
+)
 )*"
 	});
 
@@ -98,4 +360,946 @@ Print("--- ClosureMaker tests ---")
 	}
 }
 
+BOOST_AUTO_TEST_CASE(test_binary_snapshot)
+{
+	const std::string sourcePath = "binary_snapshot_test.cgl";
+	const std::string snapshotPath = "binary_snapshot_test.txt";
+
+	{
+		std::ofstream ofs(sourcePath);
+		ofs << "SnapshotValue = 21\n";
+		ofs << "SnapshotDouble = (x -> x * 2)\n";
+	}
+
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	//--preEvaluation --binarySnapshot と同じ経路で書き出す
+	isBinaryPreEvaluation = true;
+	{
+		Program program;
+		BOOST_REQUIRE(program.preEvaluate(sourcePath, snapshotPath, false));
+	}
+	isBinaryPreEvaluation = false;
+
+	//PitaStdBinaryとして#includeされるカンマ区切りのバイト列をバイト列に戻す
+	std::vector<unsigned char> bytes;
+	{
+		std::ifstream ifs(snapshotPath);
+		std::string token;
+		while (std::getline(ifs, token, ','))
+		{
+			const size_t first = token.find_first_not_of(" \t\r\n");
+			if (first != std::string::npos)
+			{
+				bytes.push_back(static_cast<unsigned char>(std::stoi(token.substr(first))));
+			}
+		}
+	}
+	BOOST_REQUIRE(!bytes.empty());
+
+	Program program;
+	program.loadBinarySnapshot(bytes.data(), bytes.size());
+	program.executeInline(u8R"*(
+(
+	Assert(SnapshotDouble(SnapshotValue) == 42, "binary snapshot(0)")
+	Assert(Abs(-1.5) == 1.5, "binary snapshot(1)")
+	Print("Passed")
+)
+)*", false);
+	BOOST_CHECK(program.isSucceeded());
+
+	std::remove(sourcePath.c_str());
+	std::remove(snapshotPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_argument_slots)
+{
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	Program program;
+	program.executeInline(u8R"*(
+(
+	f = (a, b -> a * 10 + b)
+
+	//ループカウンタが引数を遮蔽するので、bは名前で探す
+	g = (a, b -> (
+		s = 0
+		for b in 1:3 do(s = s + b)
+		s + a
+	))
+
+	//レコードの中は名前で探すが、レコードの外のaは引数の位置で引く
+	h = (a -> (
+		r = {a: a + 1}
+		r.a + a
+	))
+
+	//引数への代入は引数スコープの同じ位置を書き換える
+	m = (a -> (
+		a = a + 1
+		a * 2
+	))
+
+	//外側に同名の変数があると、引数はクロージャの作成時に名前と外側のアドレスの両方を持つ形になる
+	a = 1000
+	p = (a -> a + 1)
+
+	Assert(f(1, 2) == 12, "argument slots(0)")
+	Assert(g(100, 7) == 106, "argument slots shadowing(0)")
+	Assert(h(1) == 3, "argument slots shadowing(1)")
+	Assert(m(1) == 4, "argument slots assign(0)")
+	Assert(p(1) == 2 & a == 1000, "argument slots shadowing(2)")
+
+	[f, g, h, m, p]
+)
+)*", false);
+	BOOST_REQUIRE(program.isSucceeded());
+
+	const Context& context = *program.getContext();
+	const auto& functions = As<List>(program.getVal().get()).data;
+	BOOST_REQUIRE_EQUAL(functions.size(), 5u);
+
+	const auto f = ArgumentSlots(context, functions[0]);
+	BOOST_CHECK(f.at("a") == std::set<int>({ 0 }));
+	BOOST_CHECK(f.at("b") == std::set<int>({ 1 }));
+
+	const auto g = ArgumentSlots(context, functions[1]);
+	BOOST_CHECK(g.at("a") == std::set<int>({ 0 }));
+	BOOST_CHECK(g.at("b") == std::set<int>({ -1 }));
+
+	const auto h = ArgumentSlots(context, functions[2]);
+	BOOST_CHECK(h.at("a") == std::set<int>({ -1, 0 }));
+
+	const auto m = ArgumentSlots(context, functions[3]);
+	BOOST_CHECK(m.at("a") == std::set<int>({ -1, 0 }));
+
+	const auto p = ArgumentSlots(context, functions[4]);
+	BOOST_CHECK(p.find("a") == p.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_argument_slots_snapshot)
+{
+	const std::string sourcePath = "argument_slots_test.cgl";
+	const std::string snapshotPath = "argument_slots_test.txt";
+
+	{
+		std::ofstream ofs(sourcePath);
+		ofs << "SlotAdd = (a, b -> a * 10 + b)\n";
+		ofs << "SlotShadow = (a, b -> (s = 0, for b in 1:3 do(s = s + b), s + a))\n";
+	}
+
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	isBinaryPreEvaluation = true;
+	{
+		Program program;
+		BOOST_REQUIRE(program.preEvaluate(sourcePath, snapshotPath, false));
+	}
+	isBinaryPreEvaluation = false;
+
+	std::vector<unsigned char> bytes;
+	{
+		std::ifstream ifs(snapshotPath);
+		std::string token;
+		while (std::getline(ifs, token, ','))
+		{
+			const size_t first = token.find_first_not_of(" \t\r\n");
+			if (first != std::string::npos)
+			{
+				bytes.push_back(static_cast<unsigned char>(std::stoi(token.substr(first))));
+			}
+		}
+	}
+	BOOST_REQUIRE(!bytes.empty());
+
+	//引数の位置はアーカイブに含まれないので、読み込んだ時に割り当て直される
+	Program program;
+	program.loadBinarySnapshot(bytes.data(), bytes.size());
+
+	const Context& context = *program.getContext();
+	const auto slotAdd = ArgumentSlots(context, context.findAddress("SlotAdd"));
+	BOOST_CHECK(slotAdd.at("a") == std::set<int>({ 0 }));
+	BOOST_CHECK(slotAdd.at("b") == std::set<int>({ 1 }));
+
+	const auto slotShadow = ArgumentSlots(context, context.findAddress("SlotShadow"));
+	BOOST_CHECK(slotShadow.at("a") == std::set<int>({ 0 }));
+	BOOST_CHECK(slotShadow.at("b") == std::set<int>({ -1 }));
+
+	program.executeInline(u8R"*(
+(
+	Assert(SlotAdd(1, 2) == 12, "argument slots snapshot(0)")
+	Assert(SlotShadow(100, 7) == 106, "argument slots snapshot(1)")
+	Print("Passed")
+)
+)*", false);
+	BOOST_CHECK(program.isSucceeded());
+
+	std::remove(sourcePath.c_str());
+	std::remove(snapshotPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(test_record_members_sharing)
+{
+	RecordMembers<Address> original;
+	for (unsigned i = 0; i < 100; ++i)
+	{
+		original["m" + std::to_string(i)] = Address(i + 1);
+	}
+
+	//コピーと読むだけのアクセスはメンバ表を共有したまま
+	const RecordMembers<Address> copy = original;
+	const RecordMembers<Address>& constOriginal = original;
+	BOOST_CHECK(constOriginal.find("m42") != constOriginal.end());
+	BOOST_CHECK(&*copy.begin() == &*constOriginal.begin());
+
+	//共有中に書き換えた側は差分だけを持ち、元の配列は複製しない
+	original["m42"] = Address(1000);
+	original["zz"] = Address(2000);
+	BOOST_CHECK(&*copy.begin() == &*constOriginal.begin());
+	BOOST_CHECK(copy.find("m42")->second == Address(43));
+	BOOST_CHECK(constOriginal.find("m42")->second == Address(1000));
+	BOOST_CHECK_EQUAL(copy.size(), 100u);
+	BOOST_CHECK_EQUAL(constOriginal.size(), 101u);
+
+	//名前順に辿ると、上書きしたメンバは新しい値で一度だけ現れる
+	const std::vector<std::pair<std::string, Address>> members(constOriginal.begin(), constOriginal.end());
+	BOOST_CHECK_EQUAL(members.size(), 101u);
+	BOOST_CHECK(std::is_sorted(members.begin(), members.end(),
+		[](const std::pair<std::string, Address>& a, const std::pair<std::string, Address>& b) { return a.first < b.first; }));
+	BOOST_CHECK_EQUAL(std::count_if(members.begin(), members.end(),
+		[](const std::pair<std::string, Address>& member) { return member.first == "m42"; }), 1);
+	BOOST_CHECK(members.back().first == "zz");
+
+	//差分が大きくなると一つの配列にまとめ直すが、コピーは変わらない
+	for (unsigned i = 0; i < 100; ++i)
+	{
+		original["m" + std::to_string(i)] = Address(i + 5000);
+	}
+	BOOST_CHECK(constOriginal.at("m0") == Address(5000));
+	BOOST_CHECK(constOriginal.at("zz") == Address(2000));
+	BOOST_CHECK_EQUAL(constOriginal.size(), 101u);
+	BOOST_CHECK(copy.at("m0") == Address(1));
+	BOOST_CHECK_EQUAL(copy.size(), 100u);
+}
+
+BOOST_AUTO_TEST_CASE(test_record_inheritance_sharing)
+{
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	//200個のメンバを持つレコードから、二つだけ上書きして継承する
+	std::stringstream source;
+	source << "(\n\tproto = {list: [1, 2], ";
+	for (int i = 0; i < 200; ++i)
+	{
+		source << "k" << i << ": " << i << (i + 1 == 200 ? "}\n" : ", ");
+	}
+	source << "\tderived = proto{k7: 700, k150: 15000}\n";
+	source << "\t[proto, derived]\n)\n";
+
+	Program program;
+	program.executeInline(source.str(), false);
+	BOOST_REQUIRE(program.isSucceeded());
+
+	const Context& context = *program.getContext();
+	const List& records = As<List>(program.getVal().get());
+	BOOST_REQUIRE_EQUAL(records.data.size(), 2u);
+	const Record& proto = As<Record>(context.expand(LRValue(records.data[0]), LocationInfo()));
+	const Record& derived = As<Record>(context.expand(LRValue(records.data[1]), LocationInfo()));
+	BOOST_REQUIRE_EQUAL(derived.values.size(), proto.values.size());
+
+	//上書きしていない数値のメンバは元のレコードと同じ値を指し、リストは複製する
+	for (const auto& member : proto.values)
+	{
+		const Address derivedAddress = derived.values.at(member.first);
+		if (member.first == "k7" || member.first == "k150" || member.first == "list")
+		{
+			BOOST_CHECK(derivedAddress != member.second);
+		}
+		else
+		{
+			BOOST_CHECK(derivedAddress == member.second);
+			BOOST_CHECK(context.isSharedValue(derivedAddress));
+		}
+	}
+	BOOST_CHECK_EQUAL(AsDouble(context.expand(LRValue(derived.values.at("k7")), LocationInfo())), 700.0);
+	BOOST_CHECK_EQUAL(AsDouble(context.expand(LRValue(proto.values.at("k7")), LocationInfo())), 7.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_record_members_bulk_insert)
+{
+	RecordMembers<Address> members;
+	members["m0500"] = Address(1);
+	members["zz"] = Address(2);
+	const RecordMembers<Address> copy = members;
+
+	//名前の逆順に並んだメンバと、同じキーの重複
+	std::vector<std::pair<std::string, Address>> newMembers;
+	for (int i = 999; 0 <= i; --i)
+	{
+		char key[8];
+		std::sprintf(key, "m%04d", i);
+		newMembers.emplace_back(key, Address(static_cast<unsigned>(i + 10)));
+	}
+	newMembers.emplace_back("m0010", Address(5000));
+	members.insertOrAssign(newMembers);
+
+	BOOST_CHECK_EQUAL(members.size(), 1001u);
+	BOOST_CHECK(std::is_sorted(members.begin(), members.end(),
+		[](const std::pair<std::string, Address>& a, const std::pair<std::string, Address>& b) { return a.first < b.first; }));
+	BOOST_CHECK(members.at("m0500") == Address(510));
+	BOOST_CHECK(members.at("m0010") == Address(5000));
+	BOOST_CHECK(members.at("zz") == Address(2));
+
+	//元のメンバ表を共有していたコピーは変わらない
+	BOOST_CHECK_EQUAL(copy.size(), 2u);
+	BOOST_CHECK(copy.at("m0500") == Address(1));
+
+	//名前順でない多数のキーを持つレコード式と、その継承
+	std::stringstream source;
+	source << "(\n\tr = {";
+	for (int i = 299; 0 <= i; --i)
+	{
+		source << "k" << i << ": " << i << (i == 0 ? "}\n" : ", ");
+	}
+	source << "\ts = r{k7: 700, k150: 15000}\n";
+	source << "\t[r.k0, r.k7, r.k299, s.k7, s.k150, s.k298]\n)\n";
+
+	CheckSameNumbers(EvaluateNumbers(source.str()), { 0, 7, 299, 700, 15000, 298 }, 1.0e-9);
+}
+
+BOOST_AUTO_TEST_CASE(test_address_generation)
+{
+	//同じスロットを解放して取り直し続けても、最初のアドレスが別の値を指すことはない
+	Values<Val> values;
+	const Address first = values.add(0);
+	values.gc({});
+
+	for (unsigned i = 0; i < 1000; ++i)
+	{
+		const Address address = values.add(static_cast<int>(i));
+		BOOST_CHECK(address != first);
+		BOOST_CHECK(values.at(first) == nullptr);
+		values.gc({});
+	}
+
+	//スロット番号と世代はどちらも32ビット全体を使える
+	const Address largest = Address::FromSlot(Address::SlotMask, Address::GenerationMask);
+	BOOST_CHECK_EQUAL(largest.slot(), Address::SlotMask);
+	BOOST_CHECK_EQUAL(largest.generation(), Address::GenerationMask);
+	BOOST_CHECK(Address::FromSlot(1, 1) != Address::FromSlot(1, 0));
+
+	//世代が一周したスロットは二度と使わない
+	Values<Val> wrapping;
+	const Address last = Address::FromSlot(1, Address::GenerationMask);
+	wrapping.bind(last, 0);
+	wrapping.gc({});
+	const Address next = wrapping.add(1);
+	BOOST_CHECK_NE(next.slot(), 1u);
+	BOOST_CHECK(wrapping.at(last) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_remembered_set)
+{
+	const auto rememberedCount = [](const Values<Val>& values)
+	{
+		size_t count = 0;
+		values.forEachRemembered([&](Address, const Val&) { ++count; });
+		return count;
+	};
+
+	Values<Val> values;
+	const Address oldAddress = values.add(List());
+	values.gcYoung({ oldAddress });
+	BOOST_CHECK(values.isOld(oldAddress));
+	BOOST_CHECK_EQUAL(values.youngSize(), 0u);
+
+	//読むだけなら記録しない
+	const Values<Val>& constValues = values;
+	BOOST_CHECK(constValues.at(oldAddress) != nullptr);
+	BOOST_CHECK_EQUAL(rememberedCount(values), 0u);
+
+	//書き換えられる参照を渡したら古い値を記録する
+	const Address youngAddress = values.add(1);
+	As<List>(*values.at(oldAddress)).data.push_back(youngAddress);
+	BOOST_CHECK_EQUAL(rememberedCount(values), 1u);
+
+	//若い世代のGCで生き残った値は古い世代に移るが、書き換えられる参照が残っているかもしれないので記録は外さない
+	values.gcYoung({ oldAddress, youngAddress });
+	BOOST_CHECK(values.isOld(youngAddress));
+	BOOST_CHECK_EQUAL(rememberedCount(values), 1u);
+
+	//GCの後に同じ参照から書き込んだ若い値も辿れる
+	const Address laterAddress = values.add(2);
+	As<List>(*values.at(oldAddress)).data.push_back(laterAddress);
+	values.gcYoung({ oldAddress });
+	BOOST_CHECK(values.at(laterAddress) != nullptr);
+	BOOST_CHECK(values.isOld(laterAddress));
+
+	//記録はスロットが解放された時に外れる
+	values.gc({});
+	BOOST_CHECK_EQUAL(rememberedCount(values), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_young_gc)
+{
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	//古い世代のレコードを内側のスコープで書き換えて若い値を指させる
+	//スコープを抜けた後は古いレコードからしか辿れないので、若い世代のGCで回収されてはいけない
+	Program program;
+	program.executeInline(u8R"*(
+(
+	old = {a: [1, 2, 3]}
+	for i in 0:50000 do(t = i)
+
+	(
+		old.a = [4, 5, 6]
+	)
+	for i in 0:50000 do(t = i)
+	Assert(old.a[1] == 5, "young gc write barrier(0)")
+
+	(
+		old.a = [7, 8, 9]
+	)
+	for i in 0:50000 do(t = i)
+	Assert(old.a[2] == 9, "young gc write barrier(1)")
+
+	Print("Passed")
+)
+)*", false);
+	BOOST_CHECK(program.isSucceeded());
+
+	const GCTelemetry& gc = program.getContext()->gcTelemetry();
+	BOOST_CHECK(3 <= gc.youngCount);
+	BOOST_CHECK(0 < gc.collectedValues);
+	BOOST_CHECK(0.0 <= gc.youngPauseSec && gc.youngPauseSec <= gc.maxPauseSec * gc.youngCount);
+}
+
+BOOST_AUTO_TEST_CASE(test_young_gc_in_literal)
+{
+	isDebugMode = true;
+	isBlockingMode = false;
+
+	//レコードやリストのリテラルを評価している途中で若い世代のGCが走っても、評価済みの要素が回収されてはいけない
+	Program program;
+	program.executeInline(u8R"*(
+(
+	old = {a: 0}
+	for i in 0:50000 do(t = i)
+
+	r = {x: [1, 2], y: (for i in 0:50000 do(t = i)), z: {w: 3}}
+	l = [[4, 5], (for i in 0:50000 do(t = i)), {v: 6}]
+	(
+		old.a = {p: [7, 8], q: (for i in 0:50000 do(t = i)), s: [9]}
+	)
+	for i in 0:50000 do(t = i)
+
+	Assert(r.x[1] == 2 & r.z.w == 3, "young gc in record literal")
+	Assert(l[0][1] == 5 & l[2].v == 6, "young gc in list literal")
+	Assert(old.a.p[1] == 8 & old.a.s[0] == 9, "young gc in assigned literal")
+
+	Print("Passed")
+)
+)*", false);
+	BOOST_CHECK(program.isSucceeded());
+	BOOST_CHECK(4 <= program.getContext()->gcTelemetry().youngCount);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_constraint_groups)
+{
+	//並列化はデバッグモードでは無効になる
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	//互いにfree変数を共有しない4つの制約グループ
+	const std::string source = u8R"*(
+(
+	r = {
+		a: 0.0
+		b: 0.0
+		c: 0.0
+		d: 0.0
+		sat(a == 1.5 & b*2 == -4 & c >= 3.25 & c <= 3.5 & d + 1 == 1.5)
+		var(a, b, c, d)
+	}
+	[r.a, r.b, r.c, r.d]
+)
+)*";
+
+	useParallelConstraintGroups = false;
+	const std::vector<double> sequential = EvaluateNumbers(source);
+	useParallelConstraintGroups = true;
+	const std::vector<double> parallel = EvaluateNumbers(source);
+
+	CheckSameNumbers(parallel, sequential, 1e-6);
+	CheckSameNumbers(parallel, { 1.5, -2.0, parallel[2], 0.5 }, 1e-3);
+	BOOST_CHECK(3.25 - 1e-3 <= parallel[2] && parallel[2] <= 3.5 + 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_cmaes_evaluation)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	const std::string source = u8R"*(
+(
+	r = {
+		a: 0.0
+		b: 0.0
+		sat(Cmaes() & a + b == 2 & a - b == 4)
+		var(a, b)
+	}
+	[r.a, r.b]
+)
+)*";
+
+	useParallelCmaesEvaluation = false;
+	const std::vector<double> serial = EvaluateNumbers(source);
+	useParallelCmaesEvaluation = true;
+	const std::vector<double> parallel = EvaluateNumbers(source);
+
+	CheckSameNumbers(serial, { 3.0, -1.0 }, 1e-2);
+	CheckSameNumbers(parallel, { 3.0, -1.0 }, 1e-2);
+	CheckSameNumbers(parallel, serial, 2e-2);
+}
+
+BOOST_AUTO_TEST_CASE(test_sat_expr_tape_gradient)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	//Min/Maxは組み込み関数ではなく、ライブラリと同じ形のクロージャとして定義する
+	Program program;
+	program.executeInline(u8R"*(
+{
+	Min: (a, b -> if a < b then a else b)
+	Max: (a, b -> if b < a then a else b)
+}
+)*", false);
+	BOOST_REQUIRE(program.isSucceeded());
+
+	std::shared_ptr<Context> pEnv = program.getContext();
+	const Record functions = As<Record>(program.getVal().get());
+
+	pEnv->enterScope();
+	pEnv->bindValueID("Min", functions.values.find("Min")->second);
+	pEnv->bindValueID("Max", functions.values.find("Max")->second);
+	pEnv->bindNewValue("x", 0.0);
+	pEnv->bindNewValue("y", 0.0);
+
+	std::unordered_map<Address, int> invRefs;
+	invRefs[pEnv->findAddress("x")] = 0;
+	invRefs[pEnv->findAddress("y")] = 1;
+
+	auto exprOpt = ParseFromSourceCode("Min(x*y, Sin(y)) + Max(x, y)^2 + Abs(x - 2*y) + Cos(x)/y");
+	BOOST_REQUIRE(exprOpt);
+	const auto linesOpt = AsOpt<Lines>(exprOpt.get());
+	const Expr expr = linesOpt ? linesOpt.get().exprs.front() : exprOpt.get();
+
+	SatExprTape tape;
+	BOOST_REQUIRE(SatExprCompiler::Compile(pEnv, expr, invRefs, tape));
+
+	//Min/Maxは関数呼び出しではなくテープ上の命令に変換される
+	size_t numOfMinMax = 0;
+	for (const auto& inst : tape.instructions)
+	{
+		if (inst.op == SatExprTape::OpCode::Min || inst.op == SatExprTape::OpCode::Max)
+		{
+			++numOfMinMax;
+		}
+	}
+	BOOST_CHECK_EQUAL(numOfMinMax, 2);
+
+	//Min/MaxやAbsの切り替わる点を避けた値で、自動微分と中心差分の勾配を比べる
+	const std::vector<std::vector<double>> points = {
+		{ 0.3, 1.7 }, { 2.5, 0.4 }, { -1.2, 0.8 }, { 3.0, -2.0 }
+	};
+	for (const auto& point : points)
+	{
+		std::vector<double> grad;
+		const double value = tape.gradient(point, grad);
+		BOOST_CHECK_SMALL(value - tape.evaluate(point), 1e-12);
+		BOOST_REQUIRE_EQUAL(grad.size(), point.size());
+
+		for (size_t i = 0; i < point.size(); ++i)
+		{
+			const double h = 1e-6;
+			std::vector<double> plus = point, minus = point;
+			plus[i] += h;
+			minus[i] -= h;
+			const double numerical = (tape.evaluate(plus) - tape.evaluate(minus)) / (2.0*h);
+			BOOST_CHECK_SMALL(grad[i] - numerical, 1e-5);
+		}
+	}
+
+	pEnv->exitScope();
+}
+
+BOOST_AUTO_TEST_CASE(test_cmaes_step_size)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	//範囲外に最適値がある変数は境界に張り付き、範囲内に最適値がある変数はそこに収束する
+	//範囲の無い変数は初期値の大きさに応じた歩幅で探索する
+	const std::vector<double> result = EvaluateNumbers(u8R"*(
+(
+	r = {
+		a: 0.0
+		b: 0.0
+		c: 5000.0
+		sat(Cmaes() & a == 100 & b*b == 4 & b < 0 & c == 5300)
+		var(a in [2, 5], b in [-3, 3], c)
+	}
+	[r.a, r.b, r.c]
+)
+)*");
+
+	BOOST_CHECK(2.0 <= result[0] && result[0] <= 5.0);
+	BOOST_CHECK_SMALL(result[0] - 5.0, 1e-2);
+	BOOST_CHECK(-3.0 <= result[1] && result[1] <= 3.0);
+	BOOST_CHECK_SMALL(result[1] + 2.0, 1e-2);
+	BOOST_CHECK_SMALL(result[2] - 5300.0, 1e-1);
+}
+
+BOOST_AUTO_TEST_CASE(test_solver_portfolio)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	const std::string cacheDirectory = "solver_portfolio_test_cache";
+	filesystem::remove_all(cacheDirectory);
+
+	const auto makeSource = [](const std::string& initialA)
+	{
+		return std::string() + u8R"*(
+(
+	r = {
+		a: )*" + initialA + u8R"*(
+		b: 0.0
+		sat(a + b == 2 & a - b == 4)
+		var(a, b)
+	}
+	[r.a, r.b]
+)
+)*";
+	};
+
+	//ポートフォリオを使わない単一ソルバーの解
+	isPortfolioMode = false;
+	solutionCacheDirectory.clear();
+	const std::vector<double> single = EvaluateNumbers(makeSource("0.0"));
+
+	isPortfolioMode = true;
+	solutionCacheDirectory = cacheDirectory;
+
+	std::string winner;
+	{
+		Program program;
+		program.executeInline(makeSource("0.0"), false);
+		BOOST_REQUIRE(program.isSucceeded());
+		BOOST_REQUIRE(!program.solverTelemetry().empty());
+
+		const SolverTelemetry& telemetry = program.solverTelemetry().back();
+		const std::string prefix = "Portfolio(";
+		BOOST_REQUIRE(telemetry.solver.compare(0, prefix.size(), prefix) == 0);
+		BOOST_CHECK(telemetry.isSatisfied);
+		winner = telemetry.solver.substr(prefix.size(), telemetry.solver.size() - prefix.size() - 1);
+
+		CheckSameNumbers(ResultNumbers(program), single, 1e-3);
+	}
+
+	//初期値が変わって解のキャッシュには当たらなくても、制約の形が同じなら前回の勝者を直接使う
+	{
+		Program program;
+		program.executeInline(makeSource("1.0"), false);
+		BOOST_REQUIRE(program.isSucceeded());
+		BOOST_REQUIRE(!program.solverTelemetry().empty());
+		BOOST_CHECK_EQUAL(program.solverTelemetry().back().solver, winner);
+
+		CheckSameNumbers(ResultNumbers(program), single, 1e-3);
+	}
+
+	isPortfolioMode = false;
+	solutionCacheDirectory.clear();
+	filesystem::remove_all(cacheDirectory);
+}
+
+BOOST_AUTO_TEST_CASE(test_solver_telemetry_json)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	Program program;
+	program.executeInline(u8R"*(
+(
+	r = {
+		a: 0.0
+		b: 0.0
+		sat(a + b == 2 & a - b == 4)
+		var(a, b)
+	}
+	[r.a, r.b]
+)
+)*", false);
+	BOOST_REQUIRE(program.isSucceeded());
+
+	std::stringstream json;
+	program.outputSolverTelemetry(json);
+
+	boost::property_tree::ptree root;
+	BOOST_REQUIRE_NO_THROW(boost::property_tree::read_json(json, root));
+
+	BOOST_CHECK(root.get_child_optional("profile"));
+	BOOST_CHECK(root.get_child_optional("gc"));
+
+	const auto& constraints = root.get_child("constraints");
+	BOOST_REQUIRE_EQUAL(constraints.size(), program.solverTelemetry().size());
+	BOOST_REQUIRE(!constraints.empty());
+
+	const auto& constraint = constraints.back().second;
+	const SolverTelemetry& telemetry = program.solverTelemetry().back();
+	BOOST_CHECK_EQUAL(constraint.get<size_t>("freeVariables"), 2);
+	BOOST_CHECK_EQUAL(constraint.get<std::string>("solver"), telemetry.solver);
+	BOOST_CHECK(!constraint.get<std::string>("solver").empty());
+	BOOST_CHECK_EQUAL(constraint.get<size_t>("evaluations"), telemetry.evaluationCount);
+	BOOST_CHECK(0 < constraint.get<size_t>("evaluations"));
+	BOOST_CHECK(constraint.get<bool>("satisfied"));
+	BOOST_CHECK(constraint.get<double>("finalCost") < 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(test_solution_cache)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	const std::string cacheDirectory = "solution_cache_test_cache";
+	filesystem::remove_all(cacheDirectory);
+	solutionCacheDirectory = cacheDirectory;
+
+	const auto makeSource = [](const std::string& initialA, const std::string& rangeA)
+	{
+		return std::string() + u8R"*(
+(
+	r = {
+		a: )*" + initialA + u8R"*(
+		b: 0.0
+		sat(a + b == 2 & a - b == 4)
+		var(a in )*" + rangeA + u8R"*(, b)
+	}
+	[r.a, r.b]
+)
+)*";
+	};
+
+	//求解に使ったソルバーと解を返す
+	const auto solve = [](const std::string& source)
+	{
+		Program program;
+		program.executeInline(source, false);
+		BOOST_REQUIRE(program.isSucceeded());
+		BOOST_REQUIRE(!program.solverTelemetry().empty());
+		const std::vector<double> xs = ResultNumbers(program);
+		CheckSameNumbers(xs, { 3.0, -1.0 }, 1e-3);
+		return program.solverTelemetry().back().solver;
+	};
+
+	const std::string source = makeSource("0.0", "[-10, 10]");
+
+	//1回目は解いて保存し、別のProgramで同じ制約を解くとキャッシュに当たる（キーが実行ごとに変わらない）
+	BOOST_CHECK_NE(solve(source), "Cache");
+	const std::vector<std::string> entries = SolutionCacheEntries(cacheDirectory);
+	BOOST_REQUIRE_EQUAL(entries.size(), 1);
+	BOOST_CHECK_EQUAL(solve(source), "Cache");
+	BOOST_CHECK(SolutionCacheEntries(cacheDirectory) == entries);
+
+	//初期値や範囲が変わると別のキーになる
+	BOOST_CHECK_NE(solve(makeSource("1.0", "[-10, 10]")), "Cache");
+	BOOST_CHECK_NE(solve(makeSource("0.0", "[-20, 10]")), "Cache");
+	BOOST_CHECK_EQUAL(SolutionCacheEntries(cacheDirectory).size(), 3);
+
+	const std::string entryPath = entries.front();
+	const auto overwriteEntry = [&](const std::string& content)
+	{
+		std::ofstream ofs(entryPath);
+		ofs << content;
+	};
+
+	//キーが一致しても、現在の制約を満たさない解は使わない
+	overwriteEntry("2\n100\n100\n");
+	BOOST_CHECK_NE(solve(source), "Cache");
+
+	//途中で切れたファイルや壊れたファイルは読み飛ばして解き直す
+	overwriteEntry("2\n3\n");
+	BOOST_CHECK_NE(solve(source), "Cache");
+	overwriteEntry("not a solution");
+	BOOST_CHECK_NE(solve(source), "Cache");
+	overwriteEntry("99999999999999\n3\n-1\n");
+	BOOST_CHECK_NE(solve(source), "Cache");
+
+	//解き直した解で置き換えられ、再び当たるようになる
+	BOOST_CHECK_EQUAL(solve(source), "Cache");
+
+	solutionCacheDirectory.clear();
+	filesystem::remove_all(cacheDirectory);
+}
+
+BOOST_AUTO_TEST_CASE(test_incremental_unit_constraints)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+	useParallelConstraintGroups = false;
+
+	//3つのfreeな矩形と固定された矩形の間に多数のAvoidがあり、BFGSの差分近似では1変数ずつ値が変わる
+	//変化した変数に依存する単位制約だけを評価し直した結果が、毎回全体を評価した結果と一致することを確かめる
+	const std::string source = u8R"*(
+(
+	square = [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.0}, {x: 10.0, y: 10.0}, {x: 0.0, y: 10.0}]
+	r = {
+		a: {polygon: square, pos: {x: 2.0, y: 0.0}}
+		b: {polygon: square, pos: {x: 4.0, y: 0.0}}
+		c: {polygon: square, pos: {x: 6.0, y: 0.0}}
+		o1: {polygon: square, pos: {x: 0.0, y: 40.0}}
+		o2: {polygon: square, pos: {x: 30.0, y: 40.0}}
+		o3: {polygon: square, pos: {x: 60.0, y: 40.0}}
+		sat(
+			Avoid(a, b) & Avoid(b, c) & Avoid(a, c) &
+			Avoid(a, o1) & Avoid(a, o2) & Avoid(a, o3) &
+			Avoid(b, o1) & Avoid(b, o2) & Avoid(b, o3) &
+			Avoid(c, o1) & Avoid(c, o2) & Avoid(c, o3) &
+			a.pos.x == 0 & b.pos.x == 30 & c.pos.x == 60 &
+			a.pos.y == 0 & b.pos.y == 0 & c.pos.y == 0
+		)
+		var(a.pos, b.pos, c.pos)
+	}
+	[r.a.pos.x, r.a.pos.y, r.b.pos.x, r.b.pos.y, r.c.pos.x, r.c.pos.y]
+)
+)*";
+
+	useIncrementalUnitConstraints = false;
+	const std::vector<double> full = EvaluateNumbers(source);
+	useIncrementalUnitConstraints = true;
+	const std::vector<double> incremental = EvaluateNumbers(source);
+
+	CheckSameNumbers(incremental, full, 1e-3);
+	CheckSameNumbers(incremental, { 0.0, 0.0, 30.0, 0.0, 60.0, 0.0 }, 1e-2);
+
+	useParallelConstraintGroups = true;
+}
+
+BOOST_AUTO_TEST_CASE(test_pairwise_avoid_rewrite)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	Program program;
+	program.executeInline(u8R"*(
+(
+	square = [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.0}, {x: 10.0, y: 10.0}, {x: 0.0, y: 10.0}]
+	[{polygon: square, pos: {x: 0.0, y: 0.0}}, {polygon: square, pos: {x: 5.0, y: 0.0}}, {polygon: square, pos: {x: 8.0, y: 3.0}}]
+)
+)*", false);
+	BOOST_REQUIRE(program.isSucceeded());
+
+	std::shared_ptr<Context> pEnv = program.getContext();
+	pEnv->enterScope();
+	pEnv->bindNewValue("ss", program.getVal().get());
+	pEnv->bindNewValue("x", 0.0);
+
+	const std::unordered_map<Address, int> invRefs;
+	const auto parse = [](const std::string& source)
+	{
+		auto exprOpt = ParseFromSourceCode(source);
+		BOOST_REQUIRE(exprOpt);
+		const auto linesOpt = AsOpt<Lines>(exprOpt.get());
+		return linesOpt ? linesOpt.get().exprs.front() : exprOpt.get();
+	};
+	const auto evaluate = [&](const Expr& expr)
+	{
+		Eval evaluator(pEnv);
+		return AsDouble(pEnv->expand(boost::apply_visitor(evaluator, expr), LocationInfo()));
+	};
+
+	//全ての組が揃っていればAvoid(ss)にまとめられ、残りの単位制約はそのまま残る
+	const Expr pairwise = parse("Avoid(ss[0], ss[1]) & x == 1 & Avoid(ss[2], ss[0]) & Avoid(ss[1], ss[2])");
+	const auto rewrittenOpt = PairwiseAvoidRewriter::Rewrite(pEnv, pairwise, invRefs);
+	BOOST_REQUIRE(rewrittenOpt);
+
+	ConjunctionSeparater separater;
+	boost::apply_visitor(separater, rewrittenOpt.get());
+	BOOST_REQUIRE_EQUAL(separater.conjunctions.size(), 2);
+
+	const double avoidSum = evaluate(parse("Avoid(ss[0], ss[1]) + Avoid(ss[0], ss[2]) + Avoid(ss[1], ss[2])"));
+	BOOST_CHECK(0.0 < avoidSum);
+	BOOST_CHECK_SMALL(evaluate(separater.conjunctions.front()) - avoidSum, 1e-6);
+
+	//組が欠けていたり重複している場合はコストが変わるのでまとめない
+	BOOST_CHECK(!PairwiseAvoidRewriter::Rewrite(pEnv, parse("Avoid(ss[0], ss[1]) & Avoid(ss[1], ss[2])"), invRefs));
+	BOOST_CHECK(!PairwiseAvoidRewriter::Rewrite(pEnv, parse("Avoid(ss[0], ss[1]) & Avoid(ss[1], ss[0]) & Avoid(ss[1], ss[2])"), invRefs));
+
+	pEnv->exitScope();
+}
+
+BOOST_AUTO_TEST_CASE(test_convex_fast_path)
+{
+	isDebugMode = false;
+	isBlockingMode = false;
+
+	//凸多角形の高速パスとGEOSだけで計算した Distance/Avoid/Near が一致することを確かめる
+	//重なり・辺での接触・頂点での接触・離れている場合と、細長い多角形やほぼ一直線に並んだ頂点を含む多角形を扱う
+	const std::string source = u8R"*(
+(
+	square = [{x: 0.0, y: 0.0}, {x: 20.0, y: 0.0}, {x: 20.0, y: 20.0}, {x: 0.0, y: 20.0}]
+	triangle = [{x: 0.0, y: 0.0}, {x: 20.0, y: 0.0}, {x: 10.0, y: 15.0}]
+	sliver = [{x: 0.0, y: 0.0}, {x: 30.0, y: 0.0}, {x: 30.0, y: 0.000001}, {x: 0.0, y: 0.000001}]
+	almostCollinear = [{x: 0.0, y: 0.0}, {x: 10.0, y: 0.000000001}, {x: 20.0, y: 0.0}, {x: 20.0, y: 20.0}, {x: 0.0, y: 20.0}]
+
+	s = {polygon: square, pos: {x: 0.0, y: 0.0}}
+	pairs = [
+		[s, {polygon: square, pos: {x: 10.0, y: 10.0}}],
+		[s, {polygon: square, pos: {x: 20.0, y: 0.0}}],
+		[s, {polygon: square, pos: {x: 20.0, y: 20.0}}],
+		[s, {polygon: square, pos: {x: 10.0, y: 20.0}}],
+		[s, {polygon: square, pos: {x: 23.0, y: 5.0}}],
+		[s, {polygon: square, pos: {x: 40.0, y: 30.0}}],
+		[s, {polygon: triangle, pos: {x: 20.0, y: 5.0}}],
+		[s, {polygon: triangle, pos: {x: 15.0, y: 5.0}}],
+		[s, {polygon: sliver, pos: {x: -5.0, y: 10.0}}],
+		[s, {polygon: sliver, pos: {x: -5.0, y: 20.0}}],
+		[s, {polygon: sliver, pos: {x: -5.0, y: 22.0}}],
+		[s, {polygon: almostCollinear, pos: {x: 5.0, y: -20.0}}],
+		[s, {polygon: almostCollinear, pos: {x: 5.0, y: -10.0}}]
+	]
+
+	results = []
+	for i in 0:12 do(
+		a = pairs[i][0]
+		b = pairs[i][1]
+		results = results @ [Distance(a, b), Avoid(a, b), Near(a, b)]
+	)
+	results
+)
+)*";
+
+	useConvexFastPath = false;
+	const std::vector<double> geos = EvaluateNumbers(source);
+	useConvexFastPath = true;
+	const std::vector<double> convex = EvaluateNumbers(source);
+
+	BOOST_REQUIRE_EQUAL(geos.size(), 13 * 3);
+	CheckSameNumbers(convex, geos, 1e-6);
+
+	//接触している場合は距離も重なりも0になる
+	for (const size_t pairIndex : { 1, 2, 3, 9 })
+	{
+		BOOST_CHECK_SMALL(convex[pairIndex * 3 + 0], 1e-9);
+		BOOST_CHECK_SMALL(convex[pairIndex * 3 + 1], 1e-9);
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()